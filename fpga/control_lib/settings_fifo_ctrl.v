@@ -106,7 +106,8 @@ module settings_fifo_ctrl
 
     //------------------------------------------------------------------
     //-- Input state machine:
-    //-- Read input packet and fill a command fifo entry.
+    //-- Read input packet and fill a command fifo entry per
+    //-- (header, data) pair of the payload, all with the packet time.
     //------------------------------------------------------------------
     localparam READ_LINE0     = 0;
     localparam VITA_HDR       = 1;
@@ -134,6 +135,14 @@ module settings_fifo_ctrl
     wire has_tsf = in_data[21:20] != 0;
     reg has_sid_reg, has_cid_reg, has_tsi_reg, has_tsf_reg;
 
+    //vita words left in the packet, to find the next pair or the padding
+    reg [15:0] in_words_left;
+    reg in_eof_reg, in_more_reg;
+    always @(posedge clock) begin
+        if (in_state == VITA_HDR) in_words_left <= in_data[15:0] - 1;
+        else if (reading)         in_words_left <= in_words_left - 1;
+    end
+
     assign in_ready = (in_state < STORE_CMD);
     assign command_fifo_write  = (in_state == STORE_CMD);
     assign in_command_ticks    = in_ticks_reg;
@@ -205,21 +214,27 @@ module settings_fifo_ctrl
             end
 
             READ_HDR: begin
-                if (reading) in_state <= READ_DATA;
+                if (reading) in_state <= (in_data[33])? START_STATE : READ_DATA;
                 in_hdr_reg <= in_data[31:0];
             end
 
             READ_DATA: begin
-                if (reading) in_state <= (in_data[33])? STORE_CMD : WAIT_EOF;
+                if (reading) in_state <= STORE_CMD;
                 in_data_reg <= in_data[31:0];
+                in_eof_reg <= in_data[33];
+                in_more_reg <= ~in_data[33] && (in_words_left > 2); //another pair follows
             end
 
-            WAIT_EOF: begin
-                if (reading && in_data[33]) in_state <= STORE_CMD;
+            WAIT_EOF: begin //padding or a stray word after the last pair, already stored
+                if (reading && in_data[33]) in_state <= START_STATE;
             end
 
             STORE_CMD: begin
-                if (~command_fifo_full) in_state <= START_STATE;
+                if (~command_fifo_full) begin
+                    if      (in_more_reg) in_state <= READ_HDR;
+                    else if (in_eof_reg)  in_state <= START_STATE;
+                    else                  in_state <= WAIT_EOF;
+                end
             end
 
             endcase //in_state
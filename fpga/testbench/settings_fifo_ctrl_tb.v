@@ -0,0 +1,204 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Command packets through settings_fifo_ctrl: one pair, several pairs,
+// padding after the last pair and an odd trailing word. Every command
+// must give exactly one strobe (pokes) and one ack, in sequence order.
+// make settings_fifo_ctrl && ./settings_fifo_ctrl_tb
+
+module settings_fifo_ctrl_tb();
+
+   reg clk = 0;
+   reg rst = 1;
+   initial #1000 rst = 0;
+   always #50 clk = ~clk;
+
+   initial $dumpfile("settings_fifo_ctrl_tb.vcd");
+   initial $dumpvars(0,settings_fifo_ctrl_tb);
+
+   localparam SID = 32'h00000010;
+
+   reg [35:0]  in_data = 0;
+   reg 	       in_valid = 0;
+   wire        in_ready;
+   wire [35:0] out_data;
+   wire        out_valid;
+   wire        strobe;
+   wire [7:0]  addr;
+   wire [31:0] data;
+
+   settings_fifo_ctrl #(.XPORT_HDR(1), .PROT_DEST(0), .PROT_HDR(1), .ACK_SID(SID)) settings_fifo_ctrl
+     (.clock(clk), .reset(rst), .clear(1'b0),
+      .vita_time(64'd0), .perfs_ready(1'b1),
+      .in_data(in_data), .in_valid(in_valid), .in_ready(in_ready),
+      .out_data(out_data), .out_valid(out_valid), .out_ready(1'b1),
+      .strobe(strobe), .addr(addr), .data(data),
+      .word00(32'hA0000000), .word01(32'hA0000001), .word02(32'hA0000002), .word03(32'hA0000003),
+      .word04(32'hA0000004), .word05(32'hA0000005), .word06(32'hA0000006), .word07(32'hA0000007),
+      .word08(32'hA0000008), .word09(32'hA0000009), .word10(32'hA000000A), .word11(32'hA000000B),
+      .word12(32'hA000000C), .word13(32'hA000000D), .word14(32'hA000000E), .word15(32'hA000000F),
+      .debug());
+
+   // Expected strobes and acks, in order
+   reg [31:0]  exp_strobe [0:63];
+   reg [31:0]  exp_ack [0:63];
+   integer     num_exp_strobes = 0, num_exp_acks = 0;
+   integer     num_strobes = 0, num_acks = 0, errors = 0;
+
+   // Command payload of the next packet
+   reg [31:0]  payload [0:31];
+   integer     num_payload = 0;
+   reg [15:0]  seq = 1;
+
+   task poke;
+      input [7:0] reg_addr;
+      input [31:0] value;
+      begin
+	 payload[num_payload] = {seq, 7'b0, 1'b1, reg_addr};
+	 payload[num_payload+1] = value;
+	 num_payload = num_payload + 2;
+	 exp_strobe[num_exp_strobes] = {reg_addr, value[23:0]};
+	 num_exp_strobes = num_exp_strobes + 1;
+	 exp_ack[num_exp_acks] = {seq, 7'b0, 1'b1, reg_addr};
+	 num_exp_acks = num_exp_acks + 1;
+	 seq = seq + 1;
+      end
+   endtask // poke
+
+   task peek;
+      input [3:0] rb_addr;
+      begin
+	 payload[num_payload] = {seq, 12'b0, rb_addr};
+	 payload[num_payload+1] = 0;
+	 num_payload = num_payload + 2;
+	 exp_ack[num_exp_acks] = {seq, 12'b0, rb_addr};
+	 num_exp_acks = num_exp_acks + 1;
+	 seq = seq + 1;
+      end
+   endtask // peek
+
+   task send_word;
+      input sof;
+      input eof;
+      input [31:0] word;
+      begin
+	 @(negedge clk);
+	 in_data <= {2'b00, eof, sof, word};
+	 in_valid <= 1;
+	 @(posedge clk);
+	 while (~in_ready)
+	   @(posedge clk);
+      end
+   endtask // send_word
+
+   // Send the payload, the vita length counts vita_extra more words
+   // and the frame carries pad more words after those
+   task send_pkt;
+      input integer vita_extra;
+      input integer pad;
+      integer i, frame_words;
+      reg [15:0] vita_len;
+      begin
+	 frame_words = num_payload + vita_extra + pad;
+	 vita_len = num_payload + vita_extra + 2;
+	 send_word(1, 0, 32'h0);                         // transport header
+	 send_word(0, 0, {4'h5, 12'h000, vita_len});     // context, has sid
+	 send_word(0, 0, SID);
+	 for (i = 0; i < frame_words; i = i + 1)
+	   send_word(0, i == frame_words-1, (i < num_payload) ? payload[i] : 32'hDEADBEEF);
+	 @(negedge clk);
+	 in_valid <= 0;
+	 num_payload = 0;
+      end
+   endtask // send_pkt
+
+   // Check the strobes
+   always @(posedge clk)
+     if (strobe) begin
+	if (num_strobes >= num_exp_strobes || {addr, data[23:0]} != exp_strobe[num_strobes]) begin
+	   $display("ERROR: strobe %d addr %x data %x", num_strobes, addr, data);
+	   errors = errors + 1;
+	end
+	num_strobes = num_strobes + 1;
+     end
+
+   // Check the acks: prot hdr, vrt hdr, sid, command hdr, readback
+   integer out_line = 0;
+   reg [31:0] ack_hdr;
+   always @(posedge clk)
+     if (out_valid) begin
+	if (out_data[32])
+	  out_line = 0;
+	if (out_line == 3)
+	  ack_hdr = out_data[31:0];
+	if (out_data[33]) begin
+	   if (num_acks >= num_exp_acks || ack_hdr != exp_ack[num_acks]) begin
+	      $display("ERROR: ack %d hdr %x", num_acks, ack_hdr);
+	      errors = errors + 1;
+	   end
+	   else if (~ack_hdr[8] && out_data[31:0] != {28'hA000000, ack_hdr[3:0]}) begin
+	      $display("ERROR: ack %d readback %x", num_acks, out_data[31:0]);
+	      errors = errors + 1;
+	   end
+	   num_acks = num_acks + 1;
+	end
+	out_line = out_line + 1;
+     end
+
+   initial begin
+      @(negedge rst);
+      repeat (10) @(posedge clk);
+
+      // One pair
+      poke(8'h05, 32'h11);
+      send_pkt(0, 0);
+
+      // Several pairs with a peek in the middle
+      poke(8'h06, 32'h22);
+      peek(4'h3);
+      poke(8'h07, 32'h33);
+      poke(8'h08, 32'h44);
+      send_pkt(0, 0);
+
+      // Padding after the last pair
+      poke(8'h09, 32'h55);
+      poke(8'h0A, 32'h66);
+      send_pkt(0, 2);
+
+      // Odd length, a stray word after the last pair
+      poke(8'h0B, 32'h77);
+      send_pkt(1, 0);
+
+      // The next packets must be whole again
+      peek(4'h5);
+      send_pkt(0, 0);
+      poke(8'h0C, 32'h88);
+      poke(8'h0D, 32'h99);
+      poke(8'h0E, 32'hAA);
+      send_pkt(0, 0);
+
+      repeat (200) @(posedge clk);
+      if (num_strobes != num_exp_strobes || num_acks != num_exp_acks) begin
+	 $display("ERROR: %d strobes of %d, %d acks of %d", num_strobes, num_exp_strobes, num_acks, num_exp_acks);
+	 errors = errors + 1;
+      end
+      if (errors == 0) $display("PASS: %d commands", num_acks);
+      else             $display("FAIL: %d errors", errors);
+      $finish;
+   end
+
+endmodule // settings_fifo_ctrl_tb
@@ -30,14 +30,22 @@
 #include <uhd/transport/vrt_if_packet.hpp>
 #include <uhd/transport/zero_copy.hpp>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/array.hpp>
+#include <boost/static_assert.hpp>
 #include <boost/foreach.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/barrier.hpp>
+#include "../missing/platform.hpp"
+#include "../umtrx_rx_view.hpp"
+#include "../umtrx_stream_stats.hpp"
+#include "../umtrx_spin_barrier.hpp"
 #include <iostream>
 #include <vector>
+#include <cstring>
 
 // Included for debugging
 #ifdef UHD_TXRX_DEBUG_PRINTS
@@ -61,27 +69,186 @@ typedef boost::function<void(void)> handle_overflow_type;
 static inline void handle_overflow_nop(void){}
 
 /***********************************************************************
- * Super receive packet handler
- *
- * A receive packet handler represents a group of channels.
- * The channel group shares a common sample rate.
- * All channels are received in unison in recv().
+ * Fixed channel count storage:
+ * The alignment logic keeps one slot and one todo bit per channel.
+ * With the channel count known at compile time the slots are a plain
+ * array, padded to whole cache lines so that the converter threads of
+ * neighbouring channels do not write into the same line, and the todo
+ * list is a machine word instead of a dynamic_bitset.
  **********************************************************************/
-class recv_packet_handler{
+static const size_t RECV_CACHE_LINE_SIZE = 64;
+
+template <typename T, size_t PAD_BYTES>
+struct recv_cache_padded{
+    recv_cache_padded(void): elem(){}
+    T elem;
+    char pad[PAD_BYTES];
+};
+
+template <typename T>
+struct recv_cache_padded<T, 0>{
+    recv_cache_padded(void): elem(){}
+    T elem;
+};
+
+template <typename T, size_t NUM_CHANS>
+class recv_chan_array{
 public:
+    recv_chan_array(const size_t size){
+        UHD_ASSERT_THROW(size == NUM_CHANS);
+    }
+
+    size_t size(void) const{
+        return NUM_CHANS;
+    }
+
+    T &operator[](const size_t i){return _elems[i].elem;}
+    const T &operator[](const size_t i) const{return _elems[i].elem;}
+    T &at(const size_t i){return _elems.at(i).elem;}
+    const T &at(const size_t i) const{return _elems.at(i).elem;}
+
+private:
+    static const size_t PAD_BYTES = (RECV_CACHE_LINE_SIZE - sizeof(T)%RECV_CACHE_LINE_SIZE)%RECV_CACHE_LINE_SIZE;
+    boost::array<recv_cache_padded<T, PAD_BYTES>, NUM_CHANS> _elems;
+};
+
+//! The subset of boost::dynamic_bitset used by the alignment logic
+template <size_t NUM_CHANS>
+class recv_chan_mask{
+public:
+    //same meaning as the dynamic_bitset constructor: the value sets the low bits
+    recv_chan_mask(const size_t size, const unsigned long value = 0):
+        _bits(boost::uint32_t(value) & ALL_BITS)
+    {
+        UHD_ASSERT_THROW(size == NUM_CHANS);
+    }
+
+    void set(void){_bits = ALL_BITS;}
+    void set(const size_t i){_bits |= boost::uint32_t(1) << i;}
+    void reset(void){_bits = 0;}
+    void reset(const size_t i){_bits &= ~(boost::uint32_t(1) << i);}
+    bool test(const size_t i) const{return ((_bits >> i) & 0x1) != 0;}
+    bool any(void) const{return _bits != 0;}
+
+    //! No more bits is any index past the end, same as dynamic_bitset::npos
+    size_t find_first(void) const{
+        return this->find_from(0);
+    }
+
+    size_t find_next(const size_t i) const{
+        return this->find_from(i+1);
+    }
+
+private:
+    size_t find_from(const size_t first) const{
+        for (size_t i = first; i < NUM_CHANS; i++){
+            if ((_bits >> i) & 0x1) return i;
+        }
+        return NUM_CHANS;
+    }
+
+    BOOST_STATIC_ASSERT(NUM_CHANS > 0 and NUM_CHANS <= 32);
+    static const boost::uint32_t ALL_BITS = boost::uint32_t((boost::uint64_t(1) << NUM_CHANS) - 1);
+    boost::uint32_t _bits;
+};
+
+//! Select the slot and todo list types for a channel count, 0 means any
+template <size_t NUM_CHANS>
+struct recv_chan_storage{
+    template <typename T> struct slots{typedef recv_chan_array<T, NUM_CHANS> type;};
+    typedef recv_chan_mask<NUM_CHANS> mask_type;
+};
+
+template <>
+struct recv_chan_storage<0>{
+    template <typename T> struct slots{typedef std::vector<T> type;};
+    typedef boost::dynamic_bitset<> mask_type;
+};
+
+//! Types shared by the receive packet handlers of all channel counts
+struct recv_packet_handler_types{
     typedef boost::function<managed_recv_buffer::sptr(double)> get_buff_type;
     typedef boost::function<void(const size_t)> handle_flowctrl_type;
     typedef boost::function<void(const stream_cmd_t&)> issue_stream_cmd_type;
     typedef void(*vrt_unpacker_type)(const boost::uint32_t *, vrt::if_packet_info_t &);
     //typedef boost::function<void(const boost::uint32_t *, vrt::if_packet_info_t &)> vrt_unpacker_type;
 
+    //! What recv() does about the samples lost to a sequence error
+    enum gap_fill_type{
+        GAP_FILL_NONE, //!< report an overflow with out_of_sequence set
+        GAP_FILL_ZEROS, //!< insert zeros, the timeline stays contiguous
+        GAP_FILL_FLAG //!< insert zeros and set out_of_sequence on them
+    };
+};
+
+/***********************************************************************
+ * Receive packet streamer interface:
+ * The setup calls of the packet handler, so that the device code can
+ * configure a streamer without knowing the channel count it was built
+ * for. See recv_packet_handler_impl for the documentation of the calls.
+ **********************************************************************/
+class recv_packet_streamer : public recv_packet_handler_types, public rx_streamer, public umtrx_rx_view_streamer{
+public:
+    typedef boost::shared_ptr<recv_packet_streamer> sptr;
+
+    /*!
+     * Make a new streamer, specialized when there are 1 to 4 channels
+     * \param num_chans the number of transport channels
+     * \param max_num_samps the maximum samples per packet
+     */
+    static sptr make(const size_t num_chans, const size_t max_num_samps);
+
+    virtual void resize(const size_t size) = 0;
+    virtual void set_converter_threads(const size_t num_threads, const std::vector<int> &cpus = std::vector<int>()) = 0;
+    virtual size_t get_converter_threads(void) const = 0;
+    virtual void set_vrt_unpacker(const vrt_unpacker_type &vrt_unpacker, const size_t header_offset_words32 = 0) = 0;
+    virtual void set_alignment_failure_threshold(const size_t threshold) = 0;
+    virtual void set_tick_rate(const double rate) = 0;
+    virtual void set_samp_rate(const double rate) = 0;
+    virtual void set_xport_chan_get_buff(const size_t xport_chan, const get_buff_type &get_buff, const bool flush = false) = 0;
+    virtual void flush_all(const double timeout = 0.0) = 0;
+    virtual void set_xport_handle_flowctrl(const size_t xport_chan, const handle_flowctrl_type &handle_flowctrl, const size_t update_window, const bool do_init = false) = 0;
+    virtual void set_converter(const uhd::convert::id_type &id) = 0;
+    virtual void set_overflow_handler(const size_t xport_chan, const handle_overflow_type &handle_overflow) = 0;
+    virtual void set_scale_factor(const double scale_factor) = 0;
+    virtual void set_issue_stream_cmd(const size_t xport_chan, const issue_stream_cmd_type &issue_stream_cmd) = 0;
+    virtual void set_gap_fill(const gap_fill_type mode, const double max_gap_secs) = 0;
+    virtual void set_xport_chan_stats(const size_t xport_chan, const umtrx_stream_stats::sptr &stats) = 0;
+};
+
+/***********************************************************************
+ * Super receive packet handler
+ *
+ * A receive packet handler represents a group of channels.
+ * The channel group shares a common sample rate.
+ * All channels are received in unison in recv().
+ *
+ * NUM_CHANS fixes the channel count at compile time, 0 for any.
+ * The base type is recv_packet_streamer for the streamers,
+ * so that the calls below implement the streamer interface.
+ **********************************************************************/
+template <size_t NUM_CHANS, typename base_type = recv_packet_handler_types>
+class recv_packet_handler_impl : public base_type{
+public:
+    typedef recv_packet_handler_types::get_buff_type get_buff_type;
+    typedef recv_packet_handler_types::handle_flowctrl_type handle_flowctrl_type;
+    typedef recv_packet_handler_types::issue_stream_cmd_type issue_stream_cmd_type;
+    typedef recv_packet_handler_types::vrt_unpacker_type vrt_unpacker_type;
+    typedef recv_packet_handler_types::gap_fill_type gap_fill_type;
+
     /*!
      * Make a new packet handler for receive
      * \param size the number of transport channels
      */
-    recv_packet_handler(const size_t size = 1):
+    recv_packet_handler_impl(const size_t size = (NUM_CHANS == 0)? 1 : NUM_CHANS):
         _queue_error_for_next_call(false),
-        _buffers_infos_index(0)
+        _gap_fill(recv_packet_handler_types::GAP_FILL_NONE),
+        _max_gap_secs(0.0),
+        _gap_pending(false),
+        _next_time_valid(false),
+        _gap_nsamps_left(0),
+        _buffers_infos_index(0),
+        _num_convert_threads(1)
     {
         #ifdef  ERROR_INJECT_DROPPED_PACKETS
         recvd_packets = 0;
@@ -91,28 +258,50 @@ public:
         set_alignment_failure_threshold(1000);
     }
 
-    ~recv_packet_handler(void){
-        _task_barrier.interrupt();
+    ~recv_packet_handler_impl(void){
+        if (_task_barrier) _task_barrier->interrupt();
         _task_handlers.clear();
     }
 
     //! Resize the number of transport channels
     void resize(const size_t size){
-        if (this->size() == size) return;
+        if (NUM_CHANS != 0 and size != NUM_CHANS) throw uhd::value_error(str(
+            boost::format("recv packet handler built for %u channels, cannot resize to %u") % NUM_CHANS % size));
+        if (_props.size() == size) return;
         _task_handlers.clear();
+        _num_convert_threads = 1;
         _props.resize(size);
         //re-initialize all buffers infos by re-creating the vector
         _buffers_infos = std::vector<buffers_info_type>(4, buffers_info_type(size));
-        _task_barrier.resize(size);
-        _task_handlers.resize(size);
-        for (size_t i = 1/*skip 0*/; i < size; i++){
-            //_task_handlers[i] = task::make(boost::bind(&recv_packet_handler::converter_thread_task, this, i));
-        };
+    }
+
+    /*!
+     * Spread the conversion of the transport channels over several threads.
+     * The calling thread converts too, so num_threads-1 workers are spawned.
+     * Channels are dealt round-robin: thread t handles t, t+N, t+2N...
+     * \param num_threads total number of converting threads (1 = serial)
+     * \param cpus optional cpu to pin each worker to, in worker order
+     */
+    void set_converter_threads(const size_t num_threads, const std::vector<int> &cpus = std::vector<int>()){
+        _task_handlers.clear(); //interrupts and joins the old workers
+        _num_convert_threads = std::max<size_t>(1, std::min(num_threads, this->size()));
+        if (_num_convert_threads == 1) return;
+        //fresh barrier, the old one may hold counts from the joined workers
+        _task_barrier.reset(new umtrx_spin_barrier(_num_convert_threads));
+        for (size_t i = 1/*skip 0*/; i < _num_convert_threads; i++){
+            const int cpu = (i-1 < cpus.size())? cpus[i-1] : -1;
+            _task_handlers.push_back(task::make(boost::bind(&recv_packet_handler_impl::converter_worker_task, this, i, cpu)));
+        }
+    }
+
+    //! Get the number of threads used in conversion
+    size_t get_converter_threads(void) const{
+        return _num_convert_threads;
     }
 
     //! Get the channel width of this handler
     size_t size(void) const{
-        return _props.size();
+        return (NUM_CHANS == 0)? _props.size() : NUM_CHANS;
     }
 
     //! Setup the vrt unpacker function and offset
@@ -184,6 +373,11 @@ public:
         _bytes_per_cpu_item = uhd::convert::get_bytes_per_item(id.output_format);
     }
 
+    //! Set the counters the transport channel updates, null for none
+    void set_xport_chan_stats(const size_t xport_chan, const umtrx_stream_stats::sptr &stats){
+        _props.at(xport_chan).stats = stats;
+    }
+
     //! Set the transport channel's overflow handler
     void set_overflow_handler(const size_t xport_chan, const handle_overflow_type &handle_overflow){
         _props.at(xport_chan).handle_overflow = handle_overflow;
@@ -200,6 +394,18 @@ public:
         _props.at(xport_chan).issue_stream_cmd = issue_stream_cmd;
     }
 
+    /*!
+     * Fill the samples lost to a sequence error.
+     * The size of the gap comes from the timestamps of the packets
+     * around it, gaps longer than the maximum are reported as before.
+     * \param mode what to do about a gap
+     * \param max_gap_secs the longest gap to fill in seconds
+     */
+    void set_gap_fill(const gap_fill_type mode, const double max_gap_secs){
+        _gap_fill = mode;
+        _max_gap_secs = max_gap_secs;
+    }
+
     //! Overload call to issue stream commands
     void issue_stream_cmd(const stream_cmd_t &stream_cmd)
     {
@@ -256,6 +462,8 @@ public:
                 _queue_error_for_next_call = true;
                 break;
             }
+            //flag the whole buffer when part of it was filled in
+            if (_queue_metadata.out_of_sequence) metadata.out_of_sequence = true;
             accum_num_samps += num_samps;
         }
 #ifdef UHD_TXRX_DEBUG_PRINTS
@@ -264,6 +472,63 @@ public:
         return accum_num_samps;
     }
 
+    /*******************************************************************
+     * Receive view:
+     * Same alignment and fragment logic as a one packet recv(),
+     * but the view takes the transport buffers instead of converting.
+     ******************************************************************/
+    size_t recv_view(
+        umtrx_rx_view &view,
+        uhd::rx_metadata_t &metadata,
+        const double timeout = 0.1
+    ){
+        view.release();
+
+        //handle metadata queued from a previous receive
+        if (_queue_error_for_next_call){
+            _queue_error_for_next_call = false;
+            metadata = _queue_metadata;
+            if (_queue_metadata.error_code != rx_metadata_t::ERROR_CODE_TIMEOUT) return 0;
+        }
+
+        //get the next buffer if the current one has expired
+        if (get_curr_buffer_info().data_bytes_to_copy == 0)
+        {
+            get_aligned_buffs(timeout);
+        }
+
+        //there is no transport buffer to view the zeros of a gap in,
+        //report the gap like one that could not be filled instead,
+        //the next view is the packet after the gap
+        if (_gap_nsamps_left != 0){
+            _gap_nsamps_left = 0;
+            metadata.reset();
+            metadata.has_time_spec = true;
+            metadata.time_spec = _gap_time;
+            metadata.out_of_sequence = true;
+            metadata.error_code = rx_metadata_t::ERROR_CODE_OVERFLOW;
+            return 0;
+        }
+
+        buffers_info_type &info = get_curr_buffer_info();
+        metadata = info.metadata;
+        metadata.time_spec += time_spec_t::from_ticks(info.fragment_offset_in_samps, _samp_rate);
+        if (metadata.error_code != rx_metadata_t::ERROR_CODE_NONE) return 0;
+
+        //hand the rest of every channel's payload to the view
+        const size_t nsamps = info.data_bytes_to_copy/_bytes_per_otw_item;
+        for (size_t i = 0; i < this->size(); i++){
+            view.hold(info[i].buff, info[i].copy_buff, nsamps);
+            info[i].buff.reset();
+        }
+
+        metadata.more_fragments = false;
+        metadata.fragment_offset = info.fragment_offset_in_samps;
+        info.fragment_offset_in_samps += nsamps;
+        info.data_bytes_to_copy = 0;
+        return nsamps;
+    }
+
 private:
     vrt_unpacker_type _vrt_unpacker;
     size_t _header_offset_words32;
@@ -271,11 +536,19 @@ private:
     bool _queue_error_for_next_call;
     size_t _alignment_faulure_threshold;
     rx_metadata_t _queue_metadata;
+    gap_fill_type _gap_fill;
+    double _max_gap_secs;
+    bool _gap_pending; //a sequence error was seen while aligning
+    time_spec_t _next_time; //the time right after the last aligned packet
+    bool _next_time_valid;
+    size_t _gap_nsamps_left;
+    time_spec_t _gap_time;
     struct xport_chan_props_type{
         xport_chan_props_type(void):
             packet_count(0),
             handle_overflow(&handle_overflow_nop),
-            fc_update_window(0)
+            fc_update_window(0),
+            convert_count(0)
         {}
         get_buff_type get_buff;
         issue_stream_cmd_type issue_stream_cmd;
@@ -283,6 +556,8 @@ private:
         handle_overflow_type handle_overflow;
         handle_flowctrl_type handle_flowctrl;
         size_t fc_update_window;
+        umtrx_stream_stats::sptr stats;
+        size_t convert_count; //picks the conversions to time
     };
     std::vector<xport_chan_props_type> _props;
     size_t _num_outputs;
@@ -307,10 +582,12 @@ private:
     };
 
     //!information stored for a set of aligned buffers
-    struct buffers_info_type : std::vector<per_buffer_info_type> {
+    typedef typename recv_chan_storage<NUM_CHANS>::template slots<per_buffer_info_type>::type slots_type;
+    struct buffers_info_type : slots_type {
         buffers_info_type(const size_t size):
-            std::vector<per_buffer_info_type>(size),
+            slots_type(size),
             indexes_todo(size, true),
+            indexes_peeked(size),
             alignment_time_valid(false),
             data_bytes_to_copy(0),
             fragment_offset_in_samps(0)
@@ -318,15 +595,17 @@ private:
         void reset()
         {
             indexes_todo.set();
+            indexes_peeked.reset();
             alignment_time = time_spec_t(0.0);
             alignment_time_valid = false;
             data_bytes_to_copy = 0;
             fragment_offset_in_samps = 0;
             metadata.reset();
-            for (size_t i = 0; i < size(); i++)
-                at(i).reset();
+            for (size_t i = 0; i < this->size(); i++)
+                this->at(i).reset();
         }
-        boost::dynamic_bitset<> indexes_todo; //used in alignment logic
+        typename recv_chan_storage<NUM_CHANS>::mask_type indexes_todo; //used in alignment logic
+        typename recv_chan_storage<NUM_CHANS>::mask_type indexes_peeked; //used in alignment logic
         time_spec_t alignment_time; //used in alignment logic
         bool alignment_time_valid; //used in alignment logic
         size_t data_bytes_to_copy; //keeps track of state
@@ -396,6 +675,12 @@ private:
         info.time = time_spec_t::from_ticks(info.ifpi.tsf, _tick_rate); //assumes has_tsf is true
         info.copy_buff = reinterpret_cast<const char *>(info.vrt_hdr + info.ifpi.num_header_words32);
 
+        umtrx_stream_stats *stats = _props[index].stats.get();
+        if (stats){
+            stats->packets.add(1);
+            stats->bytes.add(buff->size());
+        }
+
         //handle flow control
         if (_props[index].handle_flowctrl)
         {
@@ -421,6 +706,7 @@ private:
         const size_t expected_packet_count = _props[index].packet_count;
         _props[index].packet_count = (info.ifpi.packet_count + 1) & seq_mask;
         if (expected_packet_count != info.ifpi.packet_count){
+            if (stats) stats->seq_errors.add(1);
             return PACKET_SEQUENCE_ERROR;
         }
         #endif
@@ -487,7 +773,39 @@ private:
 
         //if the sequence id is older:
         //  continue with the same index to try again
-        //else if (info[index].time < info.alignment_time)...
+        else if (_props[index].stats){
+            _props[index].stats->align_retries.add(1);
+        }
+    }
+
+    /*******************************************************************
+     * Alignment order:
+     * Take the head packet of every channel before draining any of them,
+     * so the alignment time goes straight to the newest head and each
+     * channel behind it is drained in one go. Draining in index order
+     * could drain a channel up to a time that a later channel then
+     * overtakes, and start over on the drained channel.
+     ******************************************************************/
+    UHD_INLINE size_t next_alignment_index(const buffers_info_type &info) const{
+        for (size_t i = info.indexes_todo.find_first(); i < this->size(); i = info.indexes_todo.find_next(i)){
+            if (not info.indexes_peeked.test(i)) return i;
+        }
+        return info.indexes_todo.find_first();
+    }
+
+    /*******************************************************************
+     * Unreachable alignment:
+     * An older packet which ends after the alignment time means that the
+     * packet boundaries of the channels are offset, ex: one dsp restarted
+     * after an overflow. Draining can never find a match, so give up now
+     * instead of after a socket buffer worth of packets.
+     ******************************************************************/
+    UHD_INLINE bool alignment_unreachable(const size_t index, const buffers_info_type &info) const{
+        if (not info.alignment_time_valid or not info.indexes_todo.test(index)) return false;
+        if (not (info[index].time < info.alignment_time)) return false;
+        const double lag = (info.alignment_time - info[index].time).get_real_secs()*_samp_rate;
+        const double nsamps = double(info[index].ifpi.num_payload_bytes/_bytes_per_otw_item);
+        return lag > 0.5 and lag < nsamps - 0.5; //half a sample for the rounding of the rates
     }
 
     /*******************************************************************
@@ -514,7 +832,8 @@ private:
         while (curr_info.indexes_todo.any()){
 
             //get the index to process for this iteration
-            const size_t index = curr_info.indexes_todo.find_first();
+            const size_t index = this->next_alignment_index(curr_info);
+            curr_info.indexes_peeked.set(index);
             packet_type packet;
 
             //receive a single packet from the transport
@@ -556,6 +875,7 @@ private:
                 curr_info.metadata.time_spec = next_info[index].time;
                 curr_info.metadata.error_code = rx_metadata_t::error_code_t(get_context_code(next_info[index].vrt_hdr, next_info[index].ifpi));
                 if (curr_info.metadata.error_code == rx_metadata_t::ERROR_CODE_OVERFLOW){
+                    if (_props[index].stats) _props[index].stats->overflows.add(1);
                     rx_metadata_t metadata = curr_info.metadata;
                     _props[index].handle_overflow();
                     curr_info.metadata = metadata;
@@ -569,6 +889,13 @@ private:
                 return;
 
             case PACKET_SEQUENCE_ERROR:
+                if (_gap_fill != recv_packet_handler_types::GAP_FILL_NONE){
+                    //keep aligning, the gap is measured on the aligned timestamps
+                    _gap_pending = true;
+                    alignment_check(index, curr_info);
+                    UHD_MSG(fastpath) << "D";
+                    break;
+                }
                 alignment_check(index, curr_info);
                 std::swap(curr_info, next_info); //save progress from curr -> next
                 curr_info.metadata.has_time_spec = prev_info.metadata.has_time_spec;
@@ -581,8 +908,8 @@ private:
 
             }
 
-            //too many iterations: detect alignment failure
-            if (iterations++ > _alignment_faulure_threshold){
+            //too many iterations or offset packets: detect alignment failure
+            if (this->alignment_unreachable(index, curr_info) or iterations++ > _alignment_faulure_threshold){
                 UHD_MSG(error) << boost::format(
                     "The receive packet handler failed to time-align packets.\n"
                     "%u received packets were processed by the handler.\n"
@@ -605,6 +932,75 @@ private:
         curr_info.metadata.end_of_burst = curr_info[0].ifpi.eob;
         curr_info.metadata.error_code = rx_metadata_t::ERROR_CODE_NONE;
 
+        //the gap could not be filled: report it like the sequence error
+        if (not this->check_for_gap(curr_info)){
+            std::swap(curr_info, next_info); //save progress from curr -> next
+            curr_info.metadata.has_time_spec = true;
+            curr_info.metadata.time_spec = _gap_time;
+            curr_info.metadata.out_of_sequence = true;
+            curr_info.metadata.error_code = rx_metadata_t::ERROR_CODE_OVERFLOW;
+        }
+    }
+
+    /*******************************************************************
+     * Gap check:
+     * Track the time after the aligned packet, and after a sequence
+     * error set up the zeros up to the time of the aligned packet.
+     * Returns false when the gap is too long or cannot be measured.
+     ******************************************************************/
+    UHD_INLINE bool check_for_gap(const buffers_info_type &info){
+        if (_gap_fill == recv_packet_handler_types::GAP_FILL_NONE) return true;
+        const time_spec_t expected_time = _next_time;
+        const bool expected_time_valid = _next_time_valid;
+        _next_time = info.metadata.time_spec + time_spec_t::from_ticks(info.data_bytes_to_copy/_bytes_per_otw_item, _samp_rate);
+        _next_time_valid = info.metadata.has_time_spec;
+
+        if (not _gap_pending) return true;
+        _gap_pending = false;
+        _gap_time = expected_time;
+        if (not expected_time_valid or not info.metadata.has_time_spec) return false;
+
+        const time_spec_t gap = info.metadata.time_spec - expected_time;
+        if (gap.get_real_secs() > _max_gap_secs) return false;
+        const long long nsamps = gap.to_ticks(_samp_rate);
+        if (nsamps <= 0) return true; //the lost packet was not in the aligned timeline
+
+        _gap_nsamps_left = size_t(nsamps);
+        return true;
+    }
+
+    /*******************************************************************
+     * Fill a gap:
+     * Write zeros into the user's IO buffers in place of lost samples.
+     ******************************************************************/
+    UHD_INLINE size_t fill_gap(
+        const uhd::rx_streamer::buffs_type &buffs,
+        const size_t nsamps_per_buff,
+        uhd::rx_metadata_t &metadata,
+        const size_t buffer_offset_bytes
+    ){
+        const size_t nsamps = std::min(nsamps_per_buff, _gap_nsamps_left);
+        for (size_t i = 0; i < this->size()*_num_outputs; i++){
+            std::memset(reinterpret_cast<char *>(buffs[i]) + buffer_offset_bytes, 0, nsamps*_bytes_per_cpu_item);
+        }
+
+        metadata.reset();
+        metadata.has_time_spec = true;
+        metadata.time_spec = _gap_time;
+        metadata.out_of_sequence = _gap_fill == recv_packet_handler_types::GAP_FILL_FLAG;
+        metadata.error_code = rx_metadata_t::ERROR_CODE_NONE;
+
+        //count the zeros as they go out, recv_view() reports a gap instead
+        for (size_t i = 0; i < this->size(); i++){
+            umtrx_stream_stats *stats = _props[i].stats.get();
+            if (not stats) continue;
+            if (nsamps == _gap_nsamps_left) stats->gaps.add(1);
+            stats->gap_samps.add(nsamps);
+        }
+
+        _gap_time += time_spec_t::from_ticks(nsamps, _samp_rate);
+        _gap_nsamps_left -= nsamps;
+        return nsamps;
     }
 
     /*******************************************************************
@@ -627,6 +1023,11 @@ private:
             get_aligned_buffs(timeout);
         }
 
+        //the zeros of a filled gap go before the packet after the gap
+        if (_gap_nsamps_left != 0){
+            return fill_gap(buffs, nsamps_per_buff, metadata, buffer_offset_bytes);
+        }
+
         buffers_info_type &info = get_curr_buffer_info();
         metadata = info.metadata;
 
@@ -646,7 +1047,14 @@ private:
         _convert_bytes_to_copy = bytes_to_copy;
 
         //perform N channels of conversion
-        for (size_t i = 0; i < this->size(); i++) this->converter_thread_task(i);
+        if (_num_convert_threads == 1){
+            for (size_t i = 0; i < this->size(); i++) this->converter_thread_task(i);
+        }
+        else{
+            _task_barrier->wait(); //release the workers
+            for (size_t i = 0; i < this->size(); i += _num_convert_threads) this->converter_thread_task(i);
+            _task_barrier->wait_others(); //workers are parked at the next wait
+        }
 
         //update the copy buffer's availability
         info.data_bytes_to_copy -= bytes_to_copy;
@@ -660,14 +1068,43 @@ private:
     }
 
     /*******************************************************************
-     * Perform one thread's work of the conversion task.
-     * The entry and exit use a dual synchronization barrier,
-     * to wait for data to become ready and block until completion.
+     * Conversion worker thread body:
+     * The entry uses the synchronization barrier to wait for data.
+     * Upon exit the worker parks in the next wait, which is the
+     * completion condition the caller blocks on with wait_others().
+     * The loop only terminates through an interrupt of the barrier,
+     * or an error, which fails the barrier so that recv() throws it.
      ******************************************************************/
-    UHD_INLINE void converter_thread_task(const size_t index)
+    void converter_worker_task(const size_t thread_index, const int cpu)
     {
-        //_task_barrier.wait();
+        if (not set_thread_affinity(cpu)){
+            UHD_MSG(warning) << boost::format("Failed to pin the converter thread to cpu %d") % cpu << std::endl;
+        }
+        try{
+            while (true){
+                _task_barrier->wait();
+                for (size_t i = thread_index; i < this->size(); i += _num_convert_threads){
+                    this->converter_thread_task(i);
+                }
+            }
+        }
+        catch(const boost::thread_interrupted &){
+            throw;
+        }
+        catch(const std::exception &ex){
+            _task_barrier->fail(str(boost::format("RX converter thread %u: %s") % thread_index % ex.what()));
+        }
+        catch(...){
+            _task_barrier->fail(str(boost::format("RX converter thread %u: unknown exception") % thread_index));
+        }
+        throw boost::thread_interrupted(); //ends the task loop, the error is thrown by the caller's wait
+    }
 
+    /*******************************************************************
+     * Perform one channel's work of the conversion task.
+     ******************************************************************/
+    UHD_INLINE void converter_thread_task(const size_t index)
+    {
         //shortcut references to local data structures
         buffers_info_type &buff_info = get_curr_buffer_info();
         per_buffer_info_type &info = buff_info[index];
@@ -681,8 +1118,12 @@ private:
         }
         const ref_vector<void *> out_buffs(io_buffs, _num_outputs);
 
-        //perform the conversion operation
+        //perform the conversion operation, timed now and then when there are counters
+        umtrx_stream_stats *stats = _props[index].stats.get();
+        const bool timed = stats and (_props[index].convert_count++ % UMTRX_STATS_CONVERT_PERIOD) == 0;
+        const boost::uint64_t start_ns = timed? umtrx_stats_now_ns() : 0;
         _converter->conv(info.copy_buff, out_buffs, _convert_nsamps);
+        if (timed) stats->convert_ns.add(size_t(umtrx_stats_now_ns() - start_ns)*UMTRX_STATS_CONVERT_PERIOD);
 
         //advance the pointer for the source buffer
         info.copy_buff += _convert_bytes_to_copy;
@@ -691,13 +1132,12 @@ private:
         if (buff_info.data_bytes_to_copy == _convert_bytes_to_copy){
             info.buff.reset(); //effectively a release
         }
-
-        //if (index == 0) _task_barrier.wait_others();
     }
 
     //! Shared variables for the worker threads
-    reusable_barrier _task_barrier;
+    boost::scoped_ptr<umtrx_spin_barrier> _task_barrier;
     std::vector<task::sptr> _task_handlers;
+    size_t _num_convert_threads;
     size_t _convert_nsamps;
     const rx_streamer::buffs_type *_convert_buffs;
     size_t _convert_buffer_offset_bytes;
@@ -764,9 +1204,13 @@ private:
 #endif
 };
 
-class recv_packet_streamer : public recv_packet_handler, public rx_streamer{
+//! The packet handler for any channel count, not tied to a streamer
+typedef recv_packet_handler_impl<0> recv_packet_handler;
+
+template <size_t NUM_CHANS>
+class recv_packet_streamer_impl : public recv_packet_handler_impl<NUM_CHANS, recv_packet_streamer>{
 public:
-    recv_packet_streamer(const size_t max_num_samps){
+    recv_packet_streamer_impl(const size_t max_num_samps){
         _max_num_samps = max_num_samps;
     }
 
@@ -778,25 +1222,23 @@ public:
         return _max_num_samps;
     }
 
-    size_t recv(
-        const rx_streamer::buffs_type &buffs,
-        const size_t nsamps_per_buff,
-        uhd::rx_metadata_t &metadata,
-        const double timeout,
-        const bool one_packet
-    ){
-        return recv_packet_handler::recv(buffs, nsamps_per_buff, metadata, timeout, one_packet);
-    }
-
-    void issue_stream_cmd(const stream_cmd_t &stream_cmd)
-    {
-        return recv_packet_handler::issue_stream_cmd(stream_cmd);
-    }
-
 private:
     size_t _max_num_samps;
 };
 
+inline recv_packet_streamer::sptr recv_packet_streamer::make(const size_t num_chans, const size_t max_num_samps)
+{
+    switch (num_chans){
+    case 1: return sptr(new recv_packet_streamer_impl<1>(max_num_samps));
+    case 2: return sptr(new recv_packet_streamer_impl<2>(max_num_samps));
+    case 3: return sptr(new recv_packet_streamer_impl<3>(max_num_samps));
+    case 4: return sptr(new recv_packet_streamer_impl<4>(max_num_samps));
+    }
+    sptr streamer(new recv_packet_streamer_impl<0>(max_num_samps));
+    streamer->resize(num_chans);
+    return streamer;
+}
+
 }}} //namespace
 
 #endif /* INCLUDED_LIBUHD_TRANSPORT_SUPER_RECV_PACKET_HANDLER_HPP */
@@ -32,7 +32,16 @@
 #include <boost/thread/thread_time.hpp>
 #include <boost/foreach.hpp>
 #include <boost/function.hpp>
+#include <boost/format.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "../missing/platform.hpp"
+#include "../umtrx_stream_stats.hpp"
+#include "../umtrx_spin_barrier.hpp"
+#include "../umtrx_tx_template.hpp"
+#include <boost/shared_ptr.hpp>
 #include <iostream>
+#include <cstring>
 #include <vector>
 
 #ifdef UHD_TXRX_DEBUG_PRINTS
@@ -58,6 +67,7 @@ namespace sph {
 class send_packet_handler{
 public:
     typedef boost::function<managed_send_buffer::sptr(double)> get_buff_type;
+    typedef boost::function<void(void)> flush_type;
     typedef boost::function<bool(uhd::async_metadata_t &, const double)> async_receiver_type;
     typedef void(*vrt_packer_type)(boost::uint32_t *, vrt::if_packet_info_t &);
     //typedef boost::function<void(boost::uint32_t *, vrt::if_packet_info_t &)> vrt_packer_type;
@@ -67,14 +77,15 @@ public:
      * \param size the number of transport channels
      */
     send_packet_handler(const size_t size = 1):
-        _next_packet_seq(0), _cached_metadata(false)
+        _scale_factor(0.0), _next_packet_seq(0), _cached_metadata(false),
+        _num_convert_threads(1)
     {
         this->set_enable_trailer(true);
         this->resize(size);
     }
 
     ~send_packet_handler(void){
-        _task_barrier.interrupt();
+        if (_task_barrier) _task_barrier->interrupt();
         _task_handlers.clear();
     }
 
@@ -82,14 +93,34 @@ public:
     void resize(const size_t size){
         if (this->size() == size) return;
         _task_handlers.clear();
+        _num_convert_threads = 1;
         _props.resize(size);
         static const boost::uint64_t zero = 0;
         _zero_buffs.resize(size, &zero);
-        _task_barrier.resize(size);
-        _task_handlers.resize(size);
-        for (size_t i = 1/*skip 0*/; i < size; i++){
-            //_task_handlers[i] = task::make(boost::bind(&send_packet_handler::converter_thread_task, this, i));
-        };
+    }
+
+    /*!
+     * Spread the packing, conversion and commit of the channels over threads.
+     * The calling thread works too, so num_threads-1 workers are spawned.
+     * Channels are dealt round-robin: thread t handles t, t+N, t+2N...
+     * \param num_threads total number of converting threads (1 = serial)
+     * \param cpus optional cpu to pin each worker to, in worker order
+     */
+    void set_converter_threads(const size_t num_threads, const std::vector<int> &cpus = std::vector<int>()){
+        _task_handlers.clear(); //interrupts and joins the old workers
+        _num_convert_threads = std::max<size_t>(1, std::min(num_threads, this->size()));
+        if (_num_convert_threads == 1) return;
+        //fresh barrier, the old one may hold counts from the joined workers
+        _task_barrier.reset(new umtrx_spin_barrier(_num_convert_threads));
+        for (size_t i = 1/*skip 0*/; i < _num_convert_threads; i++){
+            const int cpu = (i-1 < cpus.size())? cpus[i-1] : -1;
+            _task_handlers.push_back(task::make(boost::bind(&send_packet_handler::converter_worker_task, this, i, cpu)));
+        }
+    }
+
+    //! Get the number of threads used in conversion
+    size_t get_converter_threads(void) const{
+        return _num_convert_threads;
     }
 
     //! Get the channel width of this handler
@@ -133,6 +164,28 @@ public:
         _props.at(xport_chan).get_buff = get_buff;
     }
 
+    /*!
+     * Set the function to flush frames queued by the transport.
+     * It gets called by the streamer at the end of every send().
+     * \param xport_chan which transport channel
+     * \param flush the flush function
+     */
+    void set_xport_chan_flush(const size_t xport_chan, const flush_type &flush){
+        _props.at(xport_chan).flush = flush;
+    }
+
+    //! Set the counters the transport channel updates, null for none
+    void set_xport_chan_stats(const size_t xport_chan, const umtrx_stream_stats::sptr &stats){
+        _props.at(xport_chan).stats = stats;
+    }
+
+    //! Flush the queued frames of all transports
+    void flush_xports(void){
+        BOOST_FOREACH(xport_chan_props_type &props, _props){
+            if (props.flush) props.flush();
+        }
+    }
+
     //! Set the conversion routine for all channels
     void set_converter(const uhd::convert::id_type &id){
         _num_inputs = id.num_inputs;
@@ -154,6 +207,7 @@ public:
     //! Set the scale factor used in float conversion
     void set_scale_factor(const double scale_factor){
         _converter->set_scalar(scale_factor);
+        _scale_factor = scale_factor; //the templates are converted again when sent
     }
 
     //! Set the callback to get async messages
@@ -184,32 +238,7 @@ public:
     ){
         //translate the metadata to vrt if packet info
         vrt::if_packet_info_t if_packet_info;
-        if_packet_info.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
-        //if_packet_info.has_sid = false; //set per channel
-        if_packet_info.has_cid = false;
-        if_packet_info.has_tlr = _has_tlr;
-        if_packet_info.has_tsi = false;
-        if_packet_info.has_tsf = metadata.has_time_spec;
-        if_packet_info.tsf     = metadata.time_spec.to_ticks(_tick_rate);
-        if_packet_info.sob     = metadata.start_of_burst;
-        if_packet_info.eob     = metadata.end_of_burst;
-
-        /*
-         * Metadata is cached when we get a send requesting a start of burst with no samples.
-         * It is applied here on the next call to send() that actually has samples to send.
-         */
-        if (_cached_metadata && nsamps_per_buff != 0)
-        {
-            // If the new metada has a time_spec, do not use the cached time_spec.
-            if (!metadata.has_time_spec)
-            {
-                if_packet_info.has_tsf = _metadata_cache.has_time_spec;
-                if_packet_info.tsf     = _metadata_cache.time_spec.to_ticks(_tick_rate);
-            }
-            if_packet_info.sob     = _metadata_cache.start_of_burst;
-            if_packet_info.eob     = _metadata_cache.end_of_burst;
-            _cached_metadata = false;
-        }
+        this->load_metadata(if_packet_info, metadata, nsamps_per_buff);
 
         if (nsamps_per_buff <= _max_samples_per_packet){
 
@@ -278,23 +307,100 @@ public:
 		return nsamps_sent;
     }
 
+    /*******************************************************************
+     * Templates:
+     * A waveform converted once into packet payloads per channel,
+     * sent again by packing the headers and copying the payloads.
+     ******************************************************************/
+    size_t register_template(
+        const uhd::tx_streamer::buffs_type &buffs,
+        const size_t nsamps_per_buff
+    ){
+        if (nsamps_per_buff == 0) throw uhd::value_error("register_template: no samples");
+        boost::shared_ptr<tx_template_type> tmpl(new tx_template_type());
+        tmpl->nsamps = nsamps_per_buff;
+
+        //keep the host samples, a new scale factor needs them converted again
+        tmpl->samps.resize(this->size()*_num_inputs);
+        for (size_t i = 0; i < tmpl->samps.size(); i++){
+            const char *b = reinterpret_cast<const char *>(buffs[i]);
+            tmpl->samps[i].assign(b, b + nsamps_per_buff*_bytes_per_cpu_item);
+        }
+
+        //split like send() does, the payloads in the wire format
+        for (size_t offset = 0; offset < nsamps_per_buff; offset += _max_samples_per_packet){
+            tmpl->packets.push_back(tx_template_type::packet_type());
+            tx_template_type::packet_type &packet = tmpl->packets.back();
+            packet.nsamps = std::min(_max_samples_per_packet, nsamps_per_buff - offset);
+            packet.num_payload_bytes = packet.nsamps*_num_inputs*_bytes_per_otw_item;
+            packet.payloads.resize(this->size());
+            for (size_t index = 0; index < this->size(); index++){
+                packet.payloads[index].resize((packet.num_payload_bytes + 3/*round up*/)/sizeof(boost::uint32_t));
+            }
+        }
+        this->convert_template(*tmpl);
+
+        //the first free handle
+        for (size_t handle = 0; handle < _templates.size(); handle++){
+            if (_templates[handle]) continue;
+            _templates[handle] = tmpl;
+            return handle;
+        }
+        _templates.push_back(tmpl);
+        return _templates.size()-1;
+    }
+
+    void release_template(const size_t handle){
+        this->get_template(handle); //throws on a bad handle
+        _templates[handle].reset();
+        while (not _templates.empty() and not _templates.back()) _templates.pop_back();
+    }
+
+    UHD_INLINE size_t send_template(
+        const size_t handle,
+        const uhd::tx_metadata_t &metadata,
+        const double timeout
+    ){
+        tx_template_type &tmpl = this->get_template(handle);
+        if (tmpl.scale_factor != _scale_factor) this->convert_template(tmpl);
+        vrt::if_packet_info_t if_packet_info;
+        this->load_metadata(if_packet_info, metadata, tmpl.nsamps);
+
+        //the fragments follow the time of the first, cached or not
+        const time_spec_t time_spec = time_spec_t::from_ticks(if_packet_info.tsf, _tick_rate);
+        const bool eob = if_packet_info.eob;
+        size_t total_num_samps_sent = 0;
+        for (size_t i = 0; i < tmpl.packets.size(); i++){
+            if_packet_info.eob = eob and i+1 == tmpl.packets.size();
+            if (not send_one_template_packet(tmpl.packets[i], if_packet_info, timeout)) break;
+            total_num_samps_sent += tmpl.packets[i].nsamps;
+            if_packet_info.tsf = (time_spec + time_spec_t::from_ticks(total_num_samps_sent, _samp_rate)).to_ticks(_tick_rate);
+            if_packet_info.sob = false;
+        }
+        return total_num_samps_sent;
+    }
+
 private:
 
     vrt_packer_type _vrt_packer;
     size_t _header_offset_words32;
     double _tick_rate, _samp_rate;
     struct xport_chan_props_type{
-        xport_chan_props_type(void):has_sid(false),sid(0){}
+        xport_chan_props_type(void):has_sid(false),sid(0),convert_count(0){}
         get_buff_type get_buff;
+        flush_type flush;
         bool has_sid;
         boost::uint32_t sid;
         managed_send_buffer::sptr buff;
+        umtrx_stream_stats::sptr stats;
+        size_t convert_count; //picks the conversions to time
     };
     std::vector<xport_chan_props_type> _props;
     size_t _num_inputs;
     size_t _bytes_per_otw_item; //used in conversion
     size_t _bytes_per_cpu_item; //used in conversion
     uhd::convert::converter::sptr _converter; //used in conversion
+    double _scale_factor; //of the converter, the templates follow it
     size_t _max_samples_per_packet;
     std::vector<const void *> _zero_buffs;
     size_t _next_packet_seq;
@@ -303,6 +409,79 @@ private:
     bool _cached_metadata;
     uhd::tx_metadata_t _metadata_cache;
 
+    //! A registered waveform: the converted payload of every packet per channel
+    struct tx_template_type{
+        struct packet_type{
+            size_t nsamps;
+            size_t num_payload_bytes;
+            std::vector<std::vector<boost::uint32_t> > payloads;
+        };
+        size_t nsamps;
+        std::vector<packet_type> packets;
+        std::vector<std::vector<char> > samps; //the host samples per buffer
+        double scale_factor; //the payloads were converted with
+    };
+    std::vector<boost::shared_ptr<tx_template_type> > _templates;
+
+    tx_template_type &get_template(const size_t handle){
+        if (handle >= _templates.size() or not _templates[handle]){
+            throw uhd::key_error(str(boost::format("no TX template with handle %u") % handle));
+        }
+        return *_templates[handle];
+    }
+
+    //! Convert the host samples of a template into its packet payloads
+    void convert_template(tx_template_type &tmpl){
+        size_t offset = 0;
+        for (size_t p = 0; p < tmpl.packets.size(); p++){
+            tx_template_type::packet_type &packet = tmpl.packets[p];
+            for (size_t index = 0; index < this->size(); index++){
+                const void *io_buffs[4/*max interleave*/];
+                for (size_t i = 0; i < _num_inputs; i++){
+                    io_buffs[i] = &tmpl.samps[index*_num_inputs + i].front() + offset*_bytes_per_cpu_item;
+                }
+                const ref_vector<const void *> in_buffs(io_buffs, _num_inputs);
+                _converter->conv(in_buffs, &packet.payloads[index].front(), packet.nsamps);
+            }
+            offset += packet.nsamps;
+        }
+        tmpl.scale_factor = _scale_factor;
+    }
+
+    /*******************************************************************
+     * Translate the metadata into the vrt if packet info:
+     * Metadata is cached when we get a send requesting a start of burst
+     * with no samples. It is applied on the next call with samples.
+     ******************************************************************/
+    UHD_INLINE void load_metadata(
+        vrt::if_packet_info_t &if_packet_info,
+        const uhd::tx_metadata_t &metadata,
+        const size_t nsamps_per_buff
+    ){
+        if_packet_info.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
+        //if_packet_info.has_sid = false; //set per channel
+        if_packet_info.has_cid = false;
+        if_packet_info.has_tlr = _has_tlr;
+        if_packet_info.has_tsi = false;
+        if_packet_info.has_tsf = metadata.has_time_spec;
+        if_packet_info.tsf     = metadata.time_spec.to_ticks(_tick_rate);
+        if_packet_info.sob     = metadata.start_of_burst;
+        if_packet_info.eob     = metadata.end_of_burst;
+
+        if (_cached_metadata && nsamps_per_buff != 0)
+        {
+            // If the new metada has a time_spec, do not use the cached time_spec.
+            if (!metadata.has_time_spec)
+            {
+                if_packet_info.has_tsf = _metadata_cache.has_time_spec;
+                if_packet_info.tsf     = _metadata_cache.time_spec.to_ticks(_tick_rate);
+            }
+            if_packet_info.sob     = _metadata_cache.start_of_burst;
+            if_packet_info.eob     = _metadata_cache.end_of_burst;
+            _cached_metadata = false;
+        }
+    }
+
 #ifdef UHD_TXRX_DEBUG_PRINTS
     struct dbg_send_stat_t {
         dbg_send_stat_t(long wc, size_t nspb, size_t nss, uhd::tx_metadata_t md, double to, double rate):
@@ -377,21 +556,99 @@ private:
         _convert_if_packet_info = &if_packet_info;
 
         //perform N channels of conversion
-        for (size_t i = 0; i < this->size(); i++) this->converter_thread_task(i);
+        if (_num_convert_threads == 1){
+            for (size_t i = 0; i < this->size(); i++) this->converter_thread_task(i);
+        }
+        else{
+            _task_barrier->wait(); //release the workers
+            for (size_t i = 0; i < this->size(); i += _num_convert_threads) this->converter_thread_task(i);
+            _task_barrier->wait_others(); //workers are parked at the next wait
+        }
 
         _next_packet_seq++; //increment sequence after commits
         return nsamps_per_buff;
     }
 
     /*******************************************************************
-     * Perform one thread's work of the conversion task.
-     * The entry and exit use a dual synchronization barrier,
-     * to wait for data to become ready and block until completion.
+     * Send a single packet of a template:
+     * Pack the header and copy the converted payload of every channel.
      ******************************************************************/
-    UHD_INLINE void converter_thread_task(const size_t index)
+    UHD_INLINE size_t send_one_template_packet(
+        const tx_template_type::packet_type &packet,
+        vrt::if_packet_info_t &if_packet_info,
+        const double timeout
+    ){
+        if_packet_info.num_payload_bytes = packet.num_payload_bytes;
+        if_packet_info.num_payload_words32 = packet.payloads.front().size();
+        if_packet_info.packet_count = _next_packet_seq;
+
+        //get a buffer for each channel or timeout
+        BOOST_FOREACH(xport_chan_props_type &props, _props){
+            if (not props.buff) props.buff = props.get_buff(timeout);
+            if (not props.buff) return 0; //timeout
+        }
+
+        for (size_t index = 0; index < this->size(); index++){
+            managed_send_buffer::sptr &buff = _props[index].buff;
+            boost::uint32_t *otw_mem = buff->cast<boost::uint32_t *>() + _header_offset_words32;
+            if_packet_info.has_sid = _props[index].has_sid;
+            if_packet_info.sid = _props[index].sid;
+            _vrt_packer(otw_mem, if_packet_info);
+            std::memcpy(otw_mem + if_packet_info.num_header_words32, &packet.payloads[index].front(),
+                if_packet_info.num_payload_words32*sizeof(boost::uint32_t));
+
+            const size_t num_vita_words32 = _header_offset_words32+if_packet_info.num_packet_words32;
+            buff->commit(num_vita_words32*sizeof(boost::uint32_t));
+            if (umtrx_stream_stats *stats = _props[index].stats.get()){
+                stats->packets.add(1);
+                stats->bytes.add(num_vita_words32*sizeof(boost::uint32_t));
+            }
+            buff.reset(); //effectively a release
+        }
+
+        _next_packet_seq++; //increment sequence after commits
+        return packet.nsamps;
+    }
+
+    /*******************************************************************
+     * Conversion worker thread body:
+     * The entry uses the synchronization barrier to wait for data.
+     * Upon exit the worker parks in the next wait, which is the
+     * completion condition the caller blocks on with wait_others().
+     * An error, ex: a failed commit, fails the barrier so that send()
+     * throws it instead of waiting for this worker forever.
+     ******************************************************************/
+    void converter_worker_task(const size_t thread_index, const int cpu)
     {
-        //_task_barrier.wait();
+        if (not set_thread_affinity(cpu)){
+            UHD_MSG(warning) << boost::format("Failed to pin the converter thread to cpu %d") % cpu << std::endl;
+        }
+        try{
+            while (true){
+                _task_barrier->wait();
+                for (size_t i = thread_index; i < this->size(); i += _num_convert_threads){
+                    this->converter_thread_task(i);
+                }
+            }
+        }
+        catch(const boost::thread_interrupted &){
+            throw;
+        }
+        catch(const std::exception &ex){
+            _task_barrier->fail(str(boost::format("TX converter thread %u: %s") % thread_index % ex.what()));
+        }
+        catch(...){
+            _task_barrier->fail(str(boost::format("TX converter thread %u: unknown exception") % thread_index));
+        }
+        throw boost::thread_interrupted(); //ends the task loop, the error is thrown by the caller's wait
+    }
 
+    /*******************************************************************
+     * Perform one channel's work of the conversion task:
+     * Pack the header, convert the samples and commit the buffer.
+     ******************************************************************/
+    UHD_INLINE void converter_thread_task(const size_t index)
+    {
         //shortcut references to local data structures
         managed_send_buffer::sptr &buff = _props[index].buff;
         vrt::if_packet_info_t if_packet_info = *_convert_if_packet_info;
@@ -412,20 +669,27 @@ private:
         _vrt_packer(otw_mem, if_packet_info);
         otw_mem += if_packet_info.num_header_words32;
 
-        //perform the conversion operation
+        //perform the conversion operation, timed now and then when there are counters
+        umtrx_stream_stats *stats = _props[index].stats.get();
+        const bool timed = stats and (_props[index].convert_count++ % UMTRX_STATS_CONVERT_PERIOD) == 0;
+        const boost::uint64_t start_ns = timed? umtrx_stats_now_ns() : 0;
         _converter->conv(in_buffs, otw_mem, _convert_nsamps);
+        if (timed) stats->convert_ns.add(size_t(umtrx_stats_now_ns() - start_ns)*UMTRX_STATS_CONVERT_PERIOD);
 
         //commit the samples to the zero-copy interface
         const size_t num_vita_words32 = _header_offset_words32+if_packet_info.num_packet_words32;
         buff->commit(num_vita_words32*sizeof(boost::uint32_t));
+        if (stats){
+            stats->packets.add(1);
+            stats->bytes.add(num_vita_words32*sizeof(boost::uint32_t));
+        }
         buff.reset(); //effectively a release
-
-        //if (index == 0) _task_barrier.wait_others();
     }
 
     //! Shared variables for the worker threads
-    reusable_barrier _task_barrier;
+    boost::scoped_ptr<umtrx_spin_barrier> _task_barrier;
     std::vector<task::sptr> _task_handlers;
+    size_t _num_convert_threads;
     size_t _convert_nsamps;
     const tx_streamer::buffs_type *_convert_buffs;
     size_t _convert_buffer_offset_bytes;
@@ -433,7 +697,7 @@ private:
 
 };
 
-class send_packet_streamer : public send_packet_handler, public tx_streamer{
+class send_packet_streamer : public send_packet_handler, public tx_streamer, public umtrx_tx_template_streamer{
 public:
     send_packet_streamer(const size_t max_num_samps){
         _max_num_samps = max_num_samps;
@@ -454,7 +718,9 @@ public:
         const uhd::tx_metadata_t &metadata,
         const double timeout
     ){
-        return send_packet_handler::send(buffs, nsamps_per_buff, metadata, timeout);
+        const size_t nsamps_sent = send_packet_handler::send(buffs, nsamps_per_buff, metadata, timeout);
+        send_packet_handler::flush_xports();
+        return nsamps_sent;
     }
 
     bool recv_async_msg(
@@ -463,6 +729,27 @@ public:
         return send_packet_handler::recv_async_msg(async_metadata, timeout);
     }
 
+    size_t register_template(
+        const tx_streamer::buffs_type &buffs,
+        const size_t nsamps_per_buff
+    ){
+        return send_packet_handler::register_template(buffs, nsamps_per_buff);
+    }
+
+    void release_template(const size_t handle){
+        send_packet_handler::release_template(handle);
+    }
+
+    size_t send_template(
+        const size_t handle,
+        const uhd::tx_metadata_t &metadata,
+        const double timeout
+    ){
+        const size_t nsamps_sent = send_packet_handler::send_template(handle, metadata, timeout);
+        send_packet_handler::flush_xports();
+        return nsamps_sent;
+    }
+
 private:
     size_t _max_num_samps;
 };
@@ -16,6 +16,7 @@
 //
 
 #include "time64_core_200.hpp"
+#include "../umtrx_fifo_ctrl.hpp"
 #include <uhd/exception.hpp>
 #include <uhd/utils/assert_has.hpp>
 #include <boost/math/special_functions/round.hpp>
@@ -46,7 +47,7 @@ public:
         const readback_bases_type &readback_bases,
         const size_t mimo_delay_cycles
     ):
-        _iface(iface), _base(base),
+        _iface(iface), _async(boost::dynamic_pointer_cast<umtrx_fifo_ctrl>(iface)), _base(base),
         _readback_bases(readback_bases),
         _tick_rate(0.0),
         _mimo_delay_cycles(mimo_delay_cycles)
@@ -67,10 +68,8 @@ public:
 
     uhd::time_spec_t get_time_now(void){
         for (size_t i = 0; i < 3; i++){ //special algorithm because we cant read 64 bits synchronously
-            const boost::uint32_t ticks_hi = _iface->peek32(_readback_bases.rb_hi_now);
-            const boost::uint32_t ticks_lo = _iface->peek32(_readback_bases.rb_lo_now);
-            if (ticks_hi != _iface->peek32(_readback_bases.rb_hi_now)) continue;
-            const boost::uint64_t ticks = (boost::uint64_t(ticks_hi) << 32) | ticks_lo;
+            boost::uint64_t ticks;
+            if (not this->read_ticks(_readback_bases.rb_hi_now, _readback_bases.rb_lo_now, ticks)) continue;
             return time_spec_t::from_ticks(ticks, _tick_rate);
         }
         throw uhd::runtime_error("time64_core_200: get time now timeout");
@@ -78,10 +77,8 @@ public:
 
     uhd::time_spec_t get_time_last_pps(void){
         for (size_t i = 0; i < 3; i++){ //special algorithm because we cant read 64 bits synchronously
-            const boost::uint32_t ticks_hi = _iface->peek32(_readback_bases.rb_hi_pps);
-            const boost::uint32_t ticks_lo = _iface->peek32(_readback_bases.rb_lo_pps);
-            if (ticks_hi != _iface->peek32(_readback_bases.rb_hi_pps)) continue;
-            const boost::uint64_t ticks = (boost::uint64_t(ticks_hi) << 32) | ticks_lo;
+            boost::uint64_t ticks;
+            if (not this->read_ticks(_readback_bases.rb_hi_pps, _readback_bases.rb_lo_pps, ticks)) continue;
             return time_spec_t::from_ticks(ticks, _tick_rate);
         }
         throw uhd::runtime_error("time64_core_200: get time last pps timeout");
@@ -126,7 +123,29 @@ public:
     }
 
 private:
+    //! Read hi, lo and hi again, false when the hi word changed in between
+    bool read_ticks(const wb_iface::wb_addr_type rb_hi, const wb_iface::wb_addr_type rb_lo, boost::uint64_t &ticks){
+        boost::uint32_t ticks_hi, ticks_lo, ticks_hi_again;
+        if (_async){ //the three peeks in one round trip
+            umtrx_fifo_ctrl_peeks peeks(_async);
+            const size_t hi = peeks.peek32(rb_hi);
+            const size_t lo = peeks.peek32(rb_lo);
+            const size_t hi_again = peeks.peek32(rb_hi);
+            ticks_hi = peeks.collect(hi);
+            ticks_lo = peeks.collect(lo);
+            ticks_hi_again = peeks.collect(hi_again);
+        }
+        else{
+            ticks_hi = _iface->peek32(rb_hi);
+            ticks_lo = _iface->peek32(rb_lo);
+            ticks_hi_again = _iface->peek32(rb_hi);
+        }
+        ticks = (boost::uint64_t(ticks_hi) << 32) | ticks_lo;
+        return ticks_hi == ticks_hi_again;
+    }
+
     wb_iface::sptr _iface;
+    umtrx_fifo_ctrl::sptr _async; //null when the iface is not the fifo control
     const size_t _base;
     const readback_bases_type _readback_bases;
     double _tick_rate;
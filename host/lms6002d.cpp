@@ -16,36 +16,77 @@
 
 #include "lms6002d.hpp"
 #include <boost/thread.hpp>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <string>
 
 #define usleep(x) boost::this_thread::sleep(boost::posix_time::microseconds(x))
 
 static int verbosity = 0;
 
+// Width of the temperature bands of the VCOCAP cache, from -20C
+static const double VCOCAP_TEMP_BAND_C = 10.0;
+static const double VCOCAP_TEMP_MIN_C = -20.0;
+
 /************************************************************************/
 /* LMS6002D Control Class implementation                                */
 /************************************************************************/
 
+bool lms6002d_dev::is_reserved_reg(uint8_t addr)
+{
+    switch (addr) {
+        case 0x0C:
+        case 0x0D:
+        case 0x37:
+        case 0x38:
+        case 0x39:
+        case 0x3A:
+        case 0x3B:
+        case 0x3C:
+        case 0x3D:
+        case 0x69:
+        case 0x6A:
+        case 0x6B:
+        case 0x6C:
+        case 0x6D:
+            return true;
+    }
+    return addr > 127;
+}
+
+bool lms6002d_dev::is_volatile_reg(uint8_t addr)
+{
+    switch (addr) {
+        // DC_REGVAL, and RCCAL_LPFCAL DC_LOCK DC_CLBR_DONE DC_UD of the
+        // top, TX LPF, RX LPF and RX VGA2 DC calibration modules
+        case 0x00:
+        case 0x01:
+        case 0x30:
+        case 0x31:
+        case 0x50:
+        case 0x51:
+        case 0x60:
+        case 0x61:
+        // VTUNE_H VTUNE_L VCO comparators of the TX and RX PLLs
+        case 0x1A:
+        case 0x2A:
+            return true;
+    }
+    return false;
+}
+
 void lms6002d_dev::dump()
 {
+    uint8_t addrs[128], vals[128];
+    size_t count = 0;
     for (int i = 0; i < 128; i++) {
-        switch (i) {
-            case 0x0C:
-            case 0x0D:
-            case 0x37:
-            case 0x38:
-            case 0x39:
-            case 0x3A:
-            case 0x3B:
-            case 0x3C:
-            case 0x3D:
-            case 0x69:
-            case 0x6A:
-            case 0x6B:
-            case 0x6C:
-            case 0x6D:
-                continue;
-        }
-        printf("reg[0x%02x] = 0x%02x\n", i, read_reg(i));
+        if (is_reserved_reg(i)) continue;
+        addrs[count++] = i;
+    }
+    read_regs(addrs, vals, count);
+    for (size_t i = 0; i < count; i++) {
+        printf("reg[0x%02x] = 0x%02x\n", addrs[i], vals[i]);
     }
 }
 
@@ -111,6 +152,27 @@ double lms6002d_dev::txrx_pll_tune(uint8_t reg, double ref_clock, double out_fre
     // DEBUG
     //reg_dump();
 
+    // The buckets are in units of the reference clock, a new one starts a new cache
+    if (!same_ref_clock(ref_clock, _vcocap_ref_clock)) {
+        _vcocap_cache.clear();
+        _vcocap_ref_clock = ref_clock;
+    }
+
+    // Try the VCOCAP found for this VCO frequency and temperature,
+    // one lock check instead of the sweep when it still holds
+    const uint16_t bucket = uint16_t(((nint << 3) | (nfrac >> 20)) & 0xfff);
+    const uint32_t key = vcocap_key(reg, found_freqsel, bucket, uint8_t(_vcocap_temp_band.read()));
+    std::map<uint32_t, uint8_t>::const_iterator cached = _vcocap_cache.find(key);
+    if (cached != _vcocap_cache.end()) {
+        lms_write_bits(reg + 0x09, 0x3f, cached->second);
+        usleep(50);
+        if (get_txrx_pll_locked(reg)) {
+            if (verbosity>0) printf("CACHED VCOCAP=%d\n", cached->second);
+            return actual_freq;
+        }
+        if (verbosity>0) printf("Cached VCOCAP=%d is out of lock, sweeping\n", cached->second);
+    }
+
     // Poll VOVCO
     int start_i = -1;
     int stop_i = -1;
@@ -156,11 +218,55 @@ double lms6002d_dev::txrx_pll_tune(uint8_t reg, double ref_clock, double out_fre
     int avg_i = (start_i + stop_i) / 2;
     if (verbosity>0) printf("START=%d STOP=%d SET=%d\n", start_i, stop_i, avg_i);
     lms_write_bits(reg + 0x09, 0x3f, avg_i);
+    _vcocap_cache[key] = avg_i;
 
     // Return actual frequency we've tuned to
     return actual_freq;
 }
 
+void lms6002d_dev::set_temperature(double celsius)
+{
+    const int band = int(std::floor((celsius - VCOCAP_TEMP_MIN_C) / VCOCAP_TEMP_BAND_C));
+    _vcocap_temp_band.write(uint32_t(std::max(0, std::min(int(VCOCAP_TEMP_UNKNOWN) - 1, band))));
+}
+
+void lms6002d_dev::save_vcocap_cache(std::ostream &os) const
+{
+    os << "# LMS6002D VCOCAP: PLL FREQSEL NINT/NFRAC_bucket temperature_band VCOCAP" << std::endl;
+    char line[64];
+    snprintf(line, sizeof(line), "ref_clock %.3f", _vcocap_ref_clock);
+    os << line << std::endl;
+    for (std::map<uint32_t, uint8_t>::const_iterator it = _vcocap_cache.begin(); it != _vcocap_cache.end(); ++it) {
+        snprintf(line, sizeof(line), "%02x %02x %03x %x %d",
+            (it->first >> 24) & 0xff, (it->first >> 16) & 0xff, (it->first >> 4) & 0xfff, it->first & 0xf, it->second);
+        os << line << std::endl;
+    }
+}
+
+size_t lms6002d_dev::load_vcocap_cache(std::istream &is, double ref_clock)
+{
+    // Keep what was found with this reference clock only, the values
+    // of another one, or of a file without it, would be for other buckets
+    if (!same_ref_clock(ref_clock, _vcocap_ref_clock)) {
+        _vcocap_cache.clear();
+        _vcocap_ref_clock = ref_clock;
+    }
+    double file_ref_clock = 0;
+    size_t count = 0;
+    std::string line;
+    while (std::getline(is, line)) {
+        if (sscanf(line.c_str(), "ref_clock %lf", &file_ref_clock) == 1) continue;
+        unsigned reg, freqsel, bucket, temp_band;
+        int vcocap;
+        if (sscanf(line.c_str(), "%x %x %x %x %d", &reg, &freqsel, &bucket, &temp_band, &vcocap) != 5) continue;
+        if ((reg != 0x10 && reg != 0x20) || freqsel > 0x3f || bucket > 0xfff || temp_band > 0xf || vcocap < 0 || vcocap > 63) continue;
+        if (!same_ref_clock(file_ref_clock, ref_clock)) continue;
+        _vcocap_cache[vcocap_key(reg, freqsel, bucket, temp_band)] = vcocap;
+        count++;
+    }
+    return count;
+}
+
 void lms6002d_dev::init()
 {
     if (verbosity>0) printf("lms6002d_dev::init()\n");
@@ -509,8 +615,11 @@ int lms6002d_dev::rxvga2_dc_calibration()
 void lms6002d_dev::lpf_bandwidth_tuning(int ref_clock, uint8_t lpf_bandwidth_code)
 {
     // Save registers 0x05 and 0x09, because we will modify them during tx_enable()
-    uint8_t reg_save_05 = read_reg(0x05);
-    uint8_t reg_save_09 = read_reg(0x09);
+    static const uint8_t save_addrs[] = {0x05, 0x09};
+    uint8_t reg_save[2];
+    read_regs(save_addrs, reg_save, 2);
+    uint8_t reg_save_05 = reg_save[0];
+    uint8_t reg_save_09 = reg_save[1];
 
     // Enable TxPLL and tune it to 320MHz
     tx_enable();
@@ -570,13 +679,17 @@ void lms6002d_dev::auto_calibration(int ref_clock, int lpf_bandwidth_code)
     uint8_t lna = get_rx_lna();
     //   1. Select LNA1
     set_rx_lna(1);
+    //   Save the registers changed by steps 2 and 3
+    static const uint8_t save_addrs[] = {0x71, 0x7C};
+    uint8_t reg_save[2];
+    read_regs(save_addrs, reg_save, 2);
+    uint8_t reg_save_71 = reg_save[0];
+    uint8_t reg_save_7C = reg_save[1];
     //   2. Connect LNA to external inputs.
     //      IN1SEL_MIX_RXFE: Selects the input to the mixer
-    uint8_t reg_save_71 = read_reg(0x71);
     lms_clear_bits(0x71, (1 << 7));
     //   3. Enable internal termination resistor.
     //      RINEN_MIX_RXFE: Termination resistor on external mixer input enable
-    uint8_t reg_save_7C = read_reg(0x7C);
     lms_set_bits(0x7C, (1 << 2));
     // Set RxVGA2 gain to max
     uint8_t rx_vga2gain = set_rx_vga2gain(30);
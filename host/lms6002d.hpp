@@ -22,6 +22,9 @@
 #include <stdint.h>
 #include <assert.h>
 #include <cmath>
+#include <map>
+#include <iosfwd>
+#include <uhd/utils/atomic.hpp>
 
 /*!
  * LMS6002D control class
@@ -36,7 +39,10 @@ public:
 
     lms6002d_dev()
         :_lpf_rccal(3) // Value recommended by LimeMicro
-    {}
+        ,_vcocap_ref_clock(0)
+    {
+        _vcocap_temp_band.write(VCOCAP_TEMP_UNKNOWN);
+    }
     ~lms6002d_dev() {}
 
     /** Dump chip registers to console (for debug use only) */
@@ -55,6 +61,24 @@ public:
     virtual void write_reg(uint8_t addr, uint8_t val) = 0;
     /** Read through SPI */
     virtual uint8_t read_reg(uint8_t addr) = 0;
+    /** Read several registers, the interface may overlap the transactions */
+    virtual void read_regs(const uint8_t *addrs, uint8_t *vals, size_t count) {
+        for (size_t i = 0; i < count; i++) vals[i] = read_reg(addrs[i]);
+    }
+    /** Reload the registers the interface keeps a copy of, after a reset or an access around it */
+    virtual void resync() {}
+
+    /** Chip temperature in C, selects the band of the VCOCAP cache, from any thread */
+    void set_temperature(double celsius);
+    /** Write the VCOCAP values found by the PLL tuning, one per line */
+    void save_vcocap_cache(std::ostream &os) const;
+    /** Add the VCOCAP values written by save_vcocap_cache() with this reference clock, returns how many were kept */
+    size_t load_vcocap_cache(std::istream &is, double ref_clock);
+
+    /** Reserved addresses, never accessed */
+    static bool is_reserved_reg(uint8_t addr);
+    /** Registers the chip changes by itself: VCO comparators, calibration results and status */
+    static bool is_volatile_reg(uint8_t addr);
 
     /** Tune TX PLL to a given frequency. */
     double tx_pll_tune(double ref_clock, double out_freq) {
@@ -593,6 +617,20 @@ protected:
 
     uint8_t _lpf_rccal;  // Saved value for RCCAL_LPFCAL
 
+    // VCOCAP found by the sweep of txrx_pll_tune(), the key is
+    // PLL base register, FREQSEL, NINT/NFRAC bucket and temperature band,
+    // all for the reference clock of the buckets
+    static uint32_t vcocap_key(uint8_t reg, uint8_t freqsel, uint16_t bucket, uint8_t temp_band) {
+        return (uint32_t(reg) << 24) | (uint32_t(freqsel) << 16) | (uint32_t(bucket) << 4) | temp_band;
+    }
+    enum { VCOCAP_TEMP_UNKNOWN = 0xf };
+    static bool same_ref_clock(double a, double b) {
+        return std::fabs(a - b) < 1.0; // the tuning may get it truncated to Hz
+    }
+    std::map<uint32_t, uint8_t> _vcocap_cache;
+    double _vcocap_ref_clock; // of the cached values, 0 for none yet
+    uhd::atomic_uint32_t _vcocap_temp_band; // set by the status monitor thread, read by the tuning
+
 };
 
 #endif /* INCLUDED_LMS6002D_HPP */
@@ -4,8 +4,10 @@
 
 #include "lms6002d_ctrl.hpp"
 #include "lms6002d.hpp"
+#include "umtrx_fifo_ctrl.hpp"
 #include "cores/adf4350_regs.hpp"
 
+#include <uhd/exception.hpp>
 #include <uhd/utils/log.hpp>
 #include <uhd/utils/static.hpp>
 #include <uhd/utils/assert_has.hpp>
@@ -26,6 +28,8 @@
 #include <cmath>
 #include <cfloat>
 #include <limits>
+#include <algorithm>
+#include <fstream>
 
 using namespace uhd;
 using namespace uhd::usrp;
@@ -110,21 +114,69 @@ static int verbosity = 0;
 
 class umtrx_lms6002d_dev: public lms6002d_dev {
     uhd::spi_iface::sptr _spiface;
+    umtrx_fifo_ctrl::sptr _fifo_ctrl; // null when the SPI goes through the firmware
     const int _slaveno;
+    // Write through copy of the registers, the volatile and reserved ones are never valid
+    uint8_t _shadow[128];
+    bool _shadow_valid[128];
 public:
-    umtrx_lms6002d_dev(uhd::spi_iface::sptr spiface, const int slaveno) : _spiface(spiface), _slaveno(slaveno) {};
+    umtrx_lms6002d_dev(uhd::spi_iface::sptr spiface, const int slaveno) :
+        _spiface(spiface), _fifo_ctrl(boost::dynamic_pointer_cast<umtrx_fifo_ctrl>(spiface)), _slaveno(slaveno) {
+        std::fill(_shadow_valid, _shadow_valid + 128, false);
+    };
 
     virtual void write_reg(uint8_t addr, uint8_t data) {
         if (verbosity>2) printf("umtrx_lms6002d_dev::write_reg(addr=0x%x, data=0x%x)\n", addr, data);
         uint16_t command = (((uint16_t)0x80 | (uint16_t)addr) << 8) | (uint16_t)data;
         _spiface->write_spi(_slaveno, spi_config_t::EDGE_RISE, command, 16);
+        this->store(addr, data);
     }
     virtual uint8_t read_reg(uint8_t addr) {
         if(addr > 127) return 0; // incorrect address, 7 bit long expected
+        if (_shadow_valid[addr]) return _shadow[addr];
         uint8_t data = _spiface->read_spi(_slaveno, spi_config_t::EDGE_RISE, addr << 8, 16);
         if (verbosity>2) printf("umtrx_lms6002d_dev::read_reg(addr=0x%x) data=0x%x\n", addr, data);
+        this->store(addr, data);
         return data;
     }
+    virtual void read_regs(const uint8_t *addrs, uint8_t *vals, size_t count) {
+        if (not _fifo_ctrl) return lms6002d_dev::read_regs(addrs, vals, count);
+        // All the readbacks not in the shadow in flight, then collect them in order,
+        // the ones left behind by an exception are cancelled with the peeks
+        static const size_t NO_PEEK = ~size_t(0);
+        umtrx_fifo_ctrl_peeks peeks(_fifo_ctrl);
+        std::vector<size_t> index(count, NO_PEEK);
+        for (size_t i = 0; i < count; i++) {
+            if(addrs[i] > 127 or _shadow_valid[addrs[i]]) continue;
+            index[i] = peeks.read_spi(_slaveno, spi_config_t::EDGE_RISE, addrs[i] << 8, 16);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if(addrs[i] > 127) vals[i] = 0; // incorrect address, 7 bit long expected
+            else if (index[i] == NO_PEEK) vals[i] = _shadow[addrs[i]];
+            else {
+                vals[i] = uint8_t(peeks.collect(index[i]));
+                if (verbosity>2) printf("umtrx_lms6002d_dev::read_regs(addr=0x%x) data=0x%x\n", addrs[i], vals[i]);
+                this->store(addrs[i], vals[i]);
+            }
+        }
+    }
+    virtual void resync() {
+        std::fill(_shadow_valid, _shadow_valid + 128, false);
+        uint8_t addrs[128], vals[128];
+        size_t count = 0;
+        for (int i = 0; i < 128; i++) {
+            if (is_reserved_reg(i) or is_volatile_reg(i)) continue;
+            addrs[count++] = i;
+        }
+        this->read_regs(addrs, vals, count);
+    }
+
+private:
+    void store(uint8_t addr, uint8_t data) {
+        if (addr > 127 or is_reserved_reg(addr) or is_volatile_reg(addr)) return;
+        _shadow[addr] = data;
+        _shadow_valid[addr] = true;
+    }
 };
 
 // LMS6002D virtual daughter board for UmTRX
@@ -501,6 +553,32 @@ protected:
         return lms.get_rxvga2b_dc_q();
     }
 
+    void resync_registers(void) {
+        boost::recursive_mutex::scoped_lock l(_mutex);
+        if (verbosity>0) printf("lms6002d_ctrl_impl::resync_registers()\n");
+        lms.resync();
+    }
+
+    void set_temperature(const double celsius) {
+        boost::recursive_mutex::scoped_lock l(_mutex);
+        lms.set_temperature(celsius);
+    }
+
+    void load_vcocap_cache(const std::string &path) {
+        boost::recursive_mutex::scoped_lock l(_mutex);
+        std::ifstream is(path.c_str());
+        if (not is) return;
+        const size_t count = lms.load_vcocap_cache(is, _clock_rate);
+        if (verbosity>0) printf("lms6002d_ctrl_impl::load_vcocap_cache(%s) %d values\n", path.c_str(), int(count));
+    }
+
+    void save_vcocap_cache(const std::string &path) {
+        boost::recursive_mutex::scoped_lock l(_mutex);
+        std::ofstream os(path.c_str());
+        lms.save_vcocap_cache(os);
+        if (not os) throw uhd::io_error("lms6002d_ctrl: cannot write the VCOCAP cache to " + path);
+    }
+
 private:
     umtrx_lms6002d_dev lms;        // Interface to the LMS chip.
     int tx_vga1gain, tx_vga2gain;  // Stored values of Tx VGA1 and VGA2 gains.
@@ -74,6 +74,16 @@ public:
     virtual uint8_t get_rxvga2b_dc_i() = 0;
     virtual void set_rxvga2b_dc_q(uint8_t value) = 0;
     virtual uint8_t get_rxvga2b_dc_q() = 0;
+
+    //! Reload the register shadow from the chip, after a reset or an SPI access around this class
+    virtual void resync_registers(void) = 0;
+
+    //! Chip temperature in C, selects the band of the VCOCAP cache
+    virtual void set_temperature(const double celsius) = 0;
+    //! Load the VCOCAP values of earlier tunings, a missing file is not an error
+    virtual void load_vcocap_cache(const std::string &path) = 0;
+    //! Save the VCOCAP values found by the tunings so far
+    virtual void save_vcocap_cache(const std::string &path) = 0;
 };
 
 #endif /* INCLUDED_LMS6002D_CTRL_HPP */
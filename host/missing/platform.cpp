@@ -23,6 +23,10 @@
 #else
 #include <unistd.h>
 #endif
+#ifdef UHD_PLATFORM_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace uhd {
 
@@ -55,4 +59,18 @@ namespace uhd {
         boost::hash_combine(hash, uhd::get_host_id());
         return boost::uint32_t(hash);
     }
+
+    bool set_thread_affinity(const int cpu) {
+        if (cpu < 0) return true;
+#if defined(UHD_PLATFORM_LINUX)
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#elif defined(UHD_PLATFORM_WIN32)
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+        return false;
+#endif
+    }
 }
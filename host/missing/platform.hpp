@@ -31,6 +31,9 @@ namespace uhd {
     /* Get a unique identifier for the current machine and process */
     boost::uint32_t get_process_hash();
 
+    /* Pin the calling thread to a cpu, a negative cpu is a no-op; returns true on success */
+    bool set_thread_affinity(const int cpu);
+
 } //namespace uhd
 
 #endif /* INCLUDED_UHD_UTILS_PLATFORM_HPP_COPY */
@@ -0,0 +1,195 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "umtrx_async_loop.hpp"
+#include "missing/platform.hpp"
+#include <uhd/exception.hpp>
+#include <uhd/utils/msg.hpp>
+#include <uhd/utils/tasks.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <map>
+#include <cstring>
+
+#ifdef UHD_PLATFORM_LINUX
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+#ifdef UHD_PLATFORM_LINUX
+
+static const int MAX_EVENTS = 8;
+static const int WAIT_TIMEOUT_MS = 100; //so the thread notices interruption
+
+class umtrx_async_loop_impl : public umtrx_async_loop
+{
+public:
+    umtrx_async_loop_impl(const int cpu, const float priority):
+        _cpu(cpu), _priority(priority),
+        _num_packets(0), _sum_latency_us(0.0), _max_latency_us(0.0),
+        _num_events(0), _sum_handler_us(0.0), _max_handler_us(0.0)
+    {
+        _epoll_fd = ::epoll_create(MAX_EVENTS);
+        if (_epoll_fd < 0) throw uhd::os_error(str(boost::format("umtrx_async_loop: epoll_create failed: %s") % strerror(errno)));
+        _task = uhd::task::make(boost::bind(&umtrx_async_loop_impl::loop, this));
+    }
+
+    ~umtrx_async_loop_impl(void)
+    {
+        _task.reset(); //interrupts and joins the loop
+        ::close(_epoll_fd);
+    }
+
+    void add_fd(const int fd, const handler_type &handler)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            throw uhd::os_error(str(boost::format("umtrx_async_loop: epoll_ctl add failed: %s") % strerror(errno)));
+        }
+        _handlers[fd] = handler;
+    }
+
+    void remove_fd(const int fd)
+    {
+        //the loop holds the mutex while dispatching, so no handler is running past this lock
+        boost::mutex::scoped_lock lock(_mutex);
+        epoll_event ev; //non-null for old kernels
+        ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+        _handlers.erase(fd);
+    }
+
+    void add_latency(const boost::uint64_t arrival_ns)
+    {
+        if (arrival_ns == 0) return; //no receive time
+        timespec ts;
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        const boost::uint64_t now_ns = boost::uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+        const double latency_us = (now_ns > arrival_ns)? (now_ns - arrival_ns)/1e3 : 0.0;
+
+        boost::mutex::scoped_lock lock(_stats_mutex);
+        _num_packets++;
+        _sum_latency_us += latency_us;
+        _max_latency_us = std::max(_max_latency_us, latency_us);
+    }
+
+    stats_t get_stats(void)
+    {
+        boost::mutex::scoped_lock lock(_stats_mutex);
+        stats_t stats;
+        stats.num_packets = _num_packets;
+        stats.avg_latency_us = (_num_packets == 0)? 0.0 : _sum_latency_us/_num_packets;
+        stats.max_latency_us = _max_latency_us;
+        stats.num_events = _num_events;
+        stats.avg_handler_us = (_num_events == 0)? 0.0 : _sum_handler_us/_num_events;
+        stats.max_handler_us = _max_handler_us;
+        return stats;
+    }
+
+private:
+    void loop(void)
+    {
+        uhd::set_thread_priority_safe(_priority);
+        if (not uhd::set_thread_affinity(_cpu))
+        {
+            UHD_MSG(warning) << boost::format("Failed to pin the async loop thread to cpu %d") % _cpu << std::endl;
+        }
+        while (not boost::this_thread::interruption_requested())
+        {
+            this->run_once();
+        }
+    }
+
+    void run_once(void)
+    {
+        epoll_event events[MAX_EVENTS];
+        const int num_events = ::epoll_wait(_epoll_fd, events, MAX_EVENTS, WAIT_TIMEOUT_MS);
+        if (num_events <= 0) return; //timeout or EINTR
+
+        boost::mutex::scoped_lock lock(_mutex);
+        for (int i = 0; i < num_events; i++)
+        {
+            //the fd may have been removed after the wait returned
+            std::map<int, handler_type>::iterator it = _handlers.find(events[i].data.fd);
+            if (it == _handlers.end()) continue;
+            const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+            try
+            {
+                it->second();
+            }
+            catch (const std::exception &e)
+            {
+                UHD_MSG(error) << "Error in umtrx_async_loop handler: " << e.what() << std::endl;
+            }
+            this->update_stats(double((boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()));
+        }
+    }
+
+    void update_stats(const double handler_us)
+    {
+        boost::mutex::scoped_lock lock(_stats_mutex);
+        _num_events++;
+        _sum_handler_us += handler_us;
+        _max_handler_us = std::max(_max_handler_us, handler_us);
+    }
+
+    const int _cpu;
+    const float _priority;
+    int _epoll_fd;
+    boost::mutex _mutex;
+    std::map<int, handler_type> _handlers;
+    boost::mutex _stats_mutex;
+    size_t _num_packets;
+    double _sum_latency_us, _max_latency_us;
+    size_t _num_events;
+    double _sum_handler_us, _max_handler_us;
+    uhd::task::sptr _task;
+};
+
+#endif /* UHD_PLATFORM_LINUX */
+
+/***********************************************************************
+ * Factory
+ **********************************************************************/
+umtrx_async_loop::sptr umtrx_async_loop::make(const int cpu, const float priority)
+{
+#ifdef UHD_PLATFORM_LINUX
+    return sptr(new umtrx_async_loop_impl(cpu, priority));
+#else
+    throw uhd::not_implemented_error("umtrx_async_loop requires epoll which is only available on Linux");
+#endif
+}
+
+bool umtrx_async_loop::is_supported(void)
+{
+#ifdef UHD_PLATFORM_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
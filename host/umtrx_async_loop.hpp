@@ -0,0 +1,93 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_ASYNC_LOOP_HPP
+#define INCLUDED_UMTRX_ASYNC_LOOP_HPP
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+
+/*!
+ * The umtrx async event loop:
+ * One thread which waits on several sockets with epoll,
+ * and calls the handler of every socket that became readable.
+ * Used to service the flow control and async reports of all TX channels.
+ * This is only available on Linux, see is_supported().
+ */
+class umtrx_async_loop : boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<umtrx_async_loop> sptr;
+    typedef boost::function<void(void)> handler_type;
+
+    /*!
+     * Event statistics:
+     * - latency: per packet, from its arrival in the socket (the kernel
+     *   receive time) until its handler was done with it, see add_latency()
+     * - handler: the run time of the handlers, how long the loop is
+     *   busy with one socket, not how long a packet waited in it
+     */
+    struct stats_t
+    {
+        stats_t(void):
+            num_packets(0), avg_latency_us(0.0), max_latency_us(0.0),
+            num_events(0), avg_handler_us(0.0), max_handler_us(0.0){}
+        size_t num_packets;
+        double avg_latency_us;
+        double max_latency_us;
+        size_t num_events;
+        double avg_handler_us;
+        double max_handler_us;
+    };
+
+    /*!
+     * Make a new event loop and start its thread.
+     * \param cpu the cpu to pin the thread to, negative for no pinning
+     * \param priority the thread priority, see uhd::set_thread_priority_safe()
+     */
+    static sptr make(const int cpu, const float priority);
+
+    //! True when the platform provides epoll
+    static bool is_supported(void);
+
+    virtual ~umtrx_async_loop(void){}
+
+    /*!
+     * Add a socket to the loop.
+     * The handler is called from the loop thread when the socket is readable,
+     * it should drain everything that is available without blocking.
+     */
+    virtual void add_fd(const int fd, const handler_type &handler) = 0;
+
+    //! Remove a socket, the handler is not running and will not be called after this returns
+    virtual void remove_fd(const int fd) = 0;
+
+    /*!
+     * Record the latency of a packet that a handler is done with.
+     * Called by the handlers from the loop thread.
+     * \param arrival_ns the kernel receive time in ns of CLOCK_REALTIME
+     */
+    virtual void add_latency(const boost::uint64_t arrival_ns) = 0;
+
+    //! Get the event statistics since the loop was started
+    virtual stats_t get_stats(void) = 0;
+};
+
+#endif /* INCLUDED_UMTRX_ASYNC_LOOP_HPP */
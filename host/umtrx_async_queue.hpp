@@ -0,0 +1,173 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_ASYNC_QUEUE_HPP
+#define INCLUDED_UMTRX_ASYNC_QUEUE_HPP
+
+#include <uhd/config.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/***********************************************************************
+ * Bounded lock-free queue for the async metadata
+ *
+ * A drop-in for the bounded_buffer calls used by the async path.
+ * Every cell carries a sequence number which tells the producers and
+ * the consumers whose turn it is, and the head and tail are claimed
+ * with a cas, so any number of threads can push and pop without a lock.
+ * When the queue is full the oldest element is popped and counted
+ * as dropped. A consumer which finds the queue empty and wants to wait
+ * registers as a waiter, the producers only take the mutex to notify
+ * when they see a registered waiter.
+ **********************************************************************/
+template <typename elem_type>
+class umtrx_async_queue : boost::noncopyable{
+public:
+
+    /*!
+     * Make a new async queue.
+     * \param capacity the minimum number of elements, rounded up to a power of two
+     */
+    umtrx_async_queue(const size_t capacity):
+        _mask(round_up_pow2(capacity)-1),
+        _cells(new cell_type[_mask+1])
+    {
+        for (size_t i = 0; i <= _mask; i++) _cells[i].seq.write(boost::uint32_t(i));
+    }
+
+    /*!
+     * Push a new element into the queue.
+     * Pop the oldest element when the queue is full.
+     * \param elem the element to push
+     * \return true if the element fit without popping
+     */
+    UHD_INLINE bool push_with_pop_on_full(const elem_type &elem){
+        bool fit = true;
+        while (not this->try_push(elem)){
+            elem_type dropped;
+            if (this->try_pop(dropped)) _num_dropped.inc();
+            fit = false;
+        }
+        //cas as a fenced read: the waiter count must be loaded after the element is published
+        if (_num_waiters.cas(0, 0) != 0){
+            boost::mutex::scoped_lock lock(_mutex);
+            lock.unlock();
+            _cond.notify_one();
+        }
+        return fit;
+    }
+
+    /*!
+     * Pop an element from the queue, do not wait.
+     * \param elem the element reference pop to
+     * \return false when the queue was empty
+     */
+    UHD_INLINE bool pop_with_haste(elem_type &elem){
+        return this->try_pop(elem);
+    }
+
+    /*!
+     * Pop an element from the queue, wait up to the timeout.
+     * \param elem the element reference pop to
+     * \param timeout the timeout in seconds
+     * \return false when the timeout occurred
+     */
+    UHD_INLINE bool pop_with_timed_wait(elem_type &elem, double timeout){
+        if (this->try_pop(elem)) return true;
+        if (timeout <= 0.0) return false;
+
+        //register as a waiter, then re-check after the registration;
+        //the pop is not passed as the wait predicate because boost
+        //evaluates the predicate once more after it returned true
+        const boost::system_time deadline = boost::get_system_time() +
+            boost::posix_time::microseconds(long(timeout*1e6));
+        boost::mutex::scoped_lock lock(_mutex);
+        _num_waiters.inc();
+        bool ok = this->try_pop(elem);
+        while (not ok){
+            const bool notified = _cond.timed_wait(lock, deadline);
+            ok = this->try_pop(elem);
+            if (not notified) break;
+        }
+        _num_waiters.dec();
+        return ok;
+    }
+
+    //! The number of elements popped because the queue was full
+    size_t get_num_dropped(void){
+        return _num_dropped.read();
+    }
+
+private:
+    struct cell_type{
+        uhd::atomic_uint32_t seq;
+        elem_type elem;
+    };
+
+    static size_t round_up_pow2(const size_t n){
+        size_t pow2 = 1;
+        while (pow2 < n) pow2 <<= 1;
+        return pow2;
+    }
+
+    //the cell at the tail is free when its sequence equals the tail position
+    bool try_push(const elem_type &elem){
+        boost::uint32_t pos = _tail.read();
+        while (true){
+            const boost::int32_t diff = boost::int32_t(_cells[pos & _mask].seq.read() - pos);
+            if (diff < 0) return false; //full: the cell still holds an element of the previous lap
+            if (diff == 0 and _tail.cas(pos+1, pos) == pos) break;
+            pos = _tail.read(); //another producer claimed it
+        }
+        cell_type &cell = _cells[pos & _mask];
+        cell.elem = elem;
+        cell.seq.write(pos+1); //publish to the consumers
+        return true;
+    }
+
+    //the cell at the head is full when its sequence is one past the head position
+    bool try_pop(elem_type &elem){
+        boost::uint32_t pos = _head.read();
+        while (true){
+            const boost::int32_t diff = boost::int32_t(_cells[pos & _mask].seq.read() - (pos+1));
+            if (diff < 0) return false; //empty: the cell was not published yet
+            if (diff == 0 and _head.cas(pos+1, pos) == pos) break;
+            pos = _head.read(); //another consumer claimed it
+        }
+        cell_type &cell = _cells[pos & _mask];
+        elem = cell.elem;
+        cell.seq.write(boost::uint32_t(pos+_mask+1)); //free for the next lap
+        return true;
+    }
+
+    const size_t _mask;
+    boost::scoped_array<cell_type> _cells;
+    uhd::atomic_uint32_t _head, _tail;
+    uhd::atomic_uint32_t _num_dropped;
+    uhd::atomic_uint32_t _num_waiters;
+    boost::mutex _mutex;
+    boost::condition_variable _cond;
+};
+
+#endif /* INCLUDED_UMTRX_ASYNC_QUEUE_HPP */
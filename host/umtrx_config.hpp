@@ -0,0 +1,32 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_CONFIG_HPP
+#define INCLUDED_UMTRX_CONFIG_HPP
+
+/*!
+ * Export the streamer extensions from the module. The module is built
+ * with hidden visibility, the application finds the extensions with a
+ * dynamic_cast, so their typeinfo has to be the same on both sides.
+ */
+#if defined(__GNUG__) && __GNUG__ >= 4
+    #define UMTRX_API __attribute__((visibility("default")))
+#else
+    #define UMTRX_API
+#endif
+
+#endif /* INCLUDED_UMTRX_CONFIG_HPP */
@@ -0,0 +1,231 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "umtrx_convert.hpp"
+#include <uhd/utils/static.hpp>
+#include <uhd/utils/byteswap.hpp>
+#include <boost/bind.hpp>
+#include <math.h>
+
+/***********************************************************************
+ * Generic kernels
+ **********************************************************************/
+static UHD_INLINE boost::int16_t clip_round(const float x)
+{
+    //same as the simd kernels: round to nearest and saturate
+    if (x >= 32767.0f) return 32767;
+    if (x <= -32768.0f) return -32768;
+    return boost::int16_t(lrintf(x));
+}
+
+static void generic_item32_to_fc32(const boost::uint32_t *in, std::complex<float> *out, const size_t nsamps, const float scale)
+{
+    for (size_t i = 0; i < nsamps; i++)
+    {
+        const boost::uint32_t item = uhd::ntohx(in[i]);
+        out[i] = std::complex<float>(
+            float(boost::int16_t(item >> 16))*scale,
+            float(boost::int16_t(item >> 0))*scale);
+    }
+}
+
+static void generic_item32_to_sc16(const boost::uint32_t *in, std::complex<boost::int16_t> *out, const size_t nsamps)
+{
+    for (size_t i = 0; i < nsamps; i++)
+    {
+        const boost::uint32_t item = uhd::ntohx(in[i]);
+        out[i] = std::complex<boost::int16_t>(
+            boost::int16_t(item >> 16),
+            boost::int16_t(item >> 0));
+    }
+}
+
+static void generic_fc32_to_item32(const std::complex<float> *in, boost::uint32_t *out, const size_t nsamps, const float scale)
+{
+    for (size_t i = 0; i < nsamps; i++)
+    {
+        const boost::uint16_t real = boost::uint16_t(clip_round(in[i].real()*scale));
+        const boost::uint16_t imag = boost::uint16_t(clip_round(in[i].imag()*scale));
+        out[i] = uhd::htonx(boost::uint32_t((real << 16) | imag));
+    }
+}
+
+static void generic_sc16_to_item32(const std::complex<boost::int16_t> *in, boost::uint32_t *out, const size_t nsamps)
+{
+    for (size_t i = 0; i < nsamps; i++)
+    {
+        const boost::uint16_t real = boost::uint16_t(in[i].real());
+        const boost::uint16_t imag = boost::uint16_t(in[i].imag());
+        out[i] = uhd::htonx(boost::uint32_t((real << 16) | imag));
+    }
+}
+
+const umtrx_convert_kernels umtrx_convert_generic = {
+    "generic",
+    &generic_item32_to_fc32,
+    &generic_item32_to_sc16,
+    &generic_fc32_to_item32,
+    &generic_sc16_to_item32
+};
+
+/***********************************************************************
+ * Runtime dispatch
+ **********************************************************************/
+static bool cpu_has(const char *isa)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (std::string(isa) == "sse2") return __builtin_cpu_supports("sse2");
+    if (std::string(isa) == "avx2") return __builtin_cpu_supports("avx2");
+#else
+    (void)isa;
+#endif
+    return false;
+}
+
+std::vector<const umtrx_convert_kernels *> umtrx_convert_get_kernels(void)
+{
+    std::vector<const umtrx_convert_kernels *> kernels;
+    kernels.push_back(&umtrx_convert_generic);
+#ifdef UMTRX_HAVE_SSE2
+    if (cpu_has("sse2")) kernels.push_back(&umtrx_convert_sse2);
+#endif
+#ifdef UMTRX_HAVE_AVX2
+    if (cpu_has("avx2")) kernels.push_back(&umtrx_convert_avx2);
+#endif
+    return kernels;
+}
+
+/***********************************************************************
+ * Converters
+ **********************************************************************/
+class convert_item32_to_fc32 : public uhd::convert::converter
+{
+public:
+    convert_item32_to_fc32(const umtrx_convert_kernels *kernels): _kernels(kernels), _scalar(1.0f){}
+
+    void set_scalar(const double scalar)
+    {
+        _scalar = float(scalar);
+    }
+
+private:
+    void operator()(const input_type &inputs, const output_type &outputs, const size_t nsamps)
+    {
+        _kernels->item32_to_fc32(
+            reinterpret_cast<const boost::uint32_t *>(inputs[0]),
+            reinterpret_cast<std::complex<float> *>(outputs[0]), nsamps, _scalar);
+    }
+
+    const umtrx_convert_kernels *_kernels;
+    float _scalar;
+};
+
+class convert_item32_to_sc16 : public uhd::convert::converter
+{
+public:
+    convert_item32_to_sc16(const umtrx_convert_kernels *kernels): _kernels(kernels){}
+
+    void set_scalar(const double)
+    {
+        //sc16 is passed through unscaled, like the uhd converters
+    }
+
+private:
+    void operator()(const input_type &inputs, const output_type &outputs, const size_t nsamps)
+    {
+        _kernels->item32_to_sc16(
+            reinterpret_cast<const boost::uint32_t *>(inputs[0]),
+            reinterpret_cast<std::complex<boost::int16_t> *>(outputs[0]), nsamps);
+    }
+
+    const umtrx_convert_kernels *_kernels;
+};
+
+class convert_fc32_to_item32 : public uhd::convert::converter
+{
+public:
+    convert_fc32_to_item32(const umtrx_convert_kernels *kernels): _kernels(kernels), _scalar(1.0f){}
+
+    void set_scalar(const double scalar)
+    {
+        _scalar = float(scalar);
+    }
+
+private:
+    void operator()(const input_type &inputs, const output_type &outputs, const size_t nsamps)
+    {
+        _kernels->fc32_to_item32(
+            reinterpret_cast<const std::complex<float> *>(inputs[0]),
+            reinterpret_cast<boost::uint32_t *>(outputs[0]), nsamps, _scalar);
+    }
+
+    const umtrx_convert_kernels *_kernels;
+    float _scalar;
+};
+
+class convert_sc16_to_item32 : public uhd::convert::converter
+{
+public:
+    convert_sc16_to_item32(const umtrx_convert_kernels *kernels): _kernels(kernels){}
+
+    void set_scalar(const double)
+    {
+        //sc16 is passed through unscaled, like the uhd converters
+    }
+
+private:
+    void operator()(const input_type &inputs, const output_type &outputs, const size_t nsamps)
+    {
+        _kernels->sc16_to_item32(
+            reinterpret_cast<const std::complex<boost::int16_t> *>(inputs[0]),
+            reinterpret_cast<boost::uint32_t *>(outputs[0]), nsamps);
+    }
+
+    const umtrx_convert_kernels *_kernels;
+};
+
+template <typename converter_type>
+static uhd::convert::converter::sptr make_converter(const umtrx_convert_kernels *kernels)
+{
+    return uhd::convert::converter::sptr(new converter_type(kernels));
+}
+
+static void register_converter(
+    const std::string &input_format,
+    const std::string &output_format,
+    const uhd::convert::function_type &fcn
+){
+    uhd::convert::id_type id;
+    id.input_format = input_format;
+    id.num_inputs = 1;
+    id.output_format = output_format;
+    id.num_outputs = 1;
+    uhd::convert::register_converter(id, fcn, UMTRX_CONVERT_PRIORITY);
+}
+
+UHD_STATIC_BLOCK(register_umtrx_converters)
+{
+    //the generic kernels are no better than the uhd ones, only register simd
+    const umtrx_convert_kernels *best = umtrx_convert_get_kernels().back();
+    if (best == &umtrx_convert_generic) return;
+
+    register_converter("sc16_item32_be", "fc32", boost::bind(&make_converter<convert_item32_to_fc32>, best));
+    register_converter("sc16_item32_be", "sc16", boost::bind(&make_converter<convert_item32_to_sc16>, best));
+    register_converter("fc32", "sc16_item32_be", boost::bind(&make_converter<convert_fc32_to_item32>, best));
+    register_converter("sc16", "sc16_item32_be", boost::bind(&make_converter<convert_sc16_to_item32>, best));
+}
@@ -0,0 +1,62 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_CONVERT_HPP
+#define INCLUDED_UMTRX_CONVERT_HPP
+
+#include <uhd/convert.hpp>
+#include <boost/cstdint.hpp>
+#include <complex>
+#include <string>
+#include <vector>
+
+/***********************************************************************
+ * UmTRX sample converters for the sc16_item32_be wire format.
+ *
+ * Each kernel does the byteswap, the widen or narrow and the scale in
+ * a single pass over the buffer. The kernels are compiled once per
+ * instruction set (see umtrx_convert_sse2.cpp, umtrx_convert_avx2.cpp)
+ * and the best one supported by the running cpu is registered with
+ * uhd::convert above the priorities of the converters shipped by UHD.
+ **********************************************************************/
+
+//! Registration priority, above the UHD general, orc and simd converters
+static const uhd::convert::priority_type UMTRX_CONVERT_PRIORITY = 4;
+
+//! One set of conversion kernels for an instruction set
+struct umtrx_convert_kernels
+{
+    const char *name;
+    void (*item32_to_fc32)(const boost::uint32_t *in, std::complex<float> *out, const size_t nsamps, const float scale);
+    void (*item32_to_sc16)(const boost::uint32_t *in, std::complex<boost::int16_t> *out, const size_t nsamps);
+    void (*fc32_to_item32)(const std::complex<float> *in, boost::uint32_t *out, const size_t nsamps, const float scale);
+    void (*sc16_to_item32)(const std::complex<boost::int16_t> *in, boost::uint32_t *out, const size_t nsamps);
+};
+
+//! The portable kernels, also used for the tails of the simd kernels
+extern const umtrx_convert_kernels umtrx_convert_generic;
+#ifdef UMTRX_HAVE_SSE2
+extern const umtrx_convert_kernels umtrx_convert_sse2;
+#endif
+#ifdef UMTRX_HAVE_AVX2
+extern const umtrx_convert_kernels umtrx_convert_avx2;
+#endif
+
+//! All kernels which were built and are supported by this cpu, best last
+std::vector<const umtrx_convert_kernels *> umtrx_convert_get_kernels(void);
+
+#endif /* INCLUDED_UMTRX_CONVERT_HPP */
@@ -0,0 +1,100 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * AVX2 conversion kernels, this file is built with -mavx2.
+ * Eight samples per iteration, the tail goes to the generic kernels.
+ * Only called after the cpu was checked for avx2 support.
+ **********************************************************************/
+
+#include "umtrx_convert.hpp"
+#include <immintrin.h>
+
+//swap the bytes of every 16 bit lane: the item32 word is I then Q, both big endian
+static inline __m256i bswap16(const __m256i v)
+{
+    return _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+}
+
+static void avx2_item32_to_fc32(const boost::uint32_t *in, std::complex<float> *out, const size_t nsamps, const float scale)
+{
+    const __m256 scalar = _mm256_set1_ps(scale);
+    float *outf = reinterpret_cast<float *>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamps; i += 8)
+    {
+        const __m256i v = bswap16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i)));
+
+        //sign extend each half into eight 32 bit lanes
+        const __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+        const __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+
+        _mm256_storeu_ps(outf + 2*i + 0, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scalar));
+        _mm256_storeu_ps(outf + 2*i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scalar));
+    }
+    umtrx_convert_generic.item32_to_fc32(in + i, out + i, nsamps - i, scale);
+}
+
+static void avx2_item32_to_sc16(const boost::uint32_t *in, std::complex<boost::int16_t> *out, const size_t nsamps)
+{
+    size_t i = 0;
+    for (; i + 8 <= nsamps; i += 8)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bswap16(v));
+    }
+    umtrx_convert_generic.item32_to_sc16(in + i, out + i, nsamps - i);
+}
+
+static void avx2_fc32_to_item32(const std::complex<float> *in, boost::uint32_t *out, const size_t nsamps, const float scale)
+{
+    const __m256 scalar = _mm256_set1_ps(scale);
+    const __m256 max = _mm256_set1_ps(32767.0f), min = _mm256_set1_ps(-32768.0f);
+    const float *inf = reinterpret_cast<const float *>(in);
+    size_t i = 0;
+    for (; i + 8 <= nsamps; i += 8)
+    {
+        //scale, clip and round to nearest, the clip keeps cvtps away from its overflow value
+        const __m256 lo = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(inf + 2*i + 0), scalar), max), min);
+        const __m256 hi = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(inf + 2*i + 8), scalar), max), min);
+
+        //the pack works within 128 bit lanes, put the 64 bit quarters back in order
+        const __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi));
+        const __m256i v = _mm256_permute4x64_epi64(packed, 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bswap16(v));
+    }
+    umtrx_convert_generic.fc32_to_item32(in + i, out + i, nsamps - i, scale);
+}
+
+static void avx2_sc16_to_item32(const std::complex<boost::int16_t> *in, boost::uint32_t *out, const size_t nsamps)
+{
+    size_t i = 0;
+    for (; i + 8 <= nsamps; i += 8)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bswap16(v));
+    }
+    umtrx_convert_generic.sc16_to_item32(in + i, out + i, nsamps - i);
+}
+
+const umtrx_convert_kernels umtrx_convert_avx2 = {
+    "avx2",
+    &avx2_item32_to_fc32,
+    &avx2_item32_to_sc16,
+    &avx2_fc32_to_item32,
+    &avx2_sc16_to_item32
+};
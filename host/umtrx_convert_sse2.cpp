@@ -0,0 +1,96 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * SSE2 conversion kernels, this file is built with -msse2.
+ * Four samples per iteration, the tail goes to the generic kernels.
+ **********************************************************************/
+
+#include "umtrx_convert.hpp"
+#include <emmintrin.h>
+
+//swap the bytes of every 16 bit lane: the item32 word is I then Q, both big endian
+static inline __m128i bswap16(const __m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static void sse2_item32_to_fc32(const boost::uint32_t *in, std::complex<float> *out, const size_t nsamps, const float scale)
+{
+    const __m128 scalar = _mm_set1_ps(scale);
+    float *outf = reinterpret_cast<float *>(out);
+    size_t i = 0;
+    for (; i + 4 <= nsamps; i += 4)
+    {
+        const __m128i v = bswap16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+
+        //sign extend the 16 bit lanes into 32 bits: duplicate and shift back down
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+        _mm_storeu_ps(outf + 2*i + 0, _mm_mul_ps(_mm_cvtepi32_ps(lo), scalar));
+        _mm_storeu_ps(outf + 2*i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scalar));
+    }
+    umtrx_convert_generic.item32_to_fc32(in + i, out + i, nsamps - i, scale);
+}
+
+static void sse2_item32_to_sc16(const boost::uint32_t *in, std::complex<boost::int16_t> *out, const size_t nsamps)
+{
+    size_t i = 0;
+    for (; i + 4 <= nsamps; i += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bswap16(v));
+    }
+    umtrx_convert_generic.item32_to_sc16(in + i, out + i, nsamps - i);
+}
+
+static void sse2_fc32_to_item32(const std::complex<float> *in, boost::uint32_t *out, const size_t nsamps, const float scale)
+{
+    const __m128 scalar = _mm_set1_ps(scale);
+    const __m128 max = _mm_set1_ps(32767.0f), min = _mm_set1_ps(-32768.0f);
+    const float *inf = reinterpret_cast<const float *>(in);
+    size_t i = 0;
+    for (; i + 4 <= nsamps; i += 4)
+    {
+        //scale, clip and round to nearest, the clip keeps cvtps away from its overflow value
+        const __m128 lo = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(inf + 2*i + 0), scalar), max), min);
+        const __m128 hi = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(inf + 2*i + 4), scalar), max), min);
+        const __m128i v = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bswap16(v));
+    }
+    umtrx_convert_generic.fc32_to_item32(in + i, out + i, nsamps - i, scale);
+}
+
+static void sse2_sc16_to_item32(const std::complex<boost::int16_t> *in, boost::uint32_t *out, const size_t nsamps)
+{
+    size_t i = 0;
+    for (; i + 4 <= nsamps; i += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), bswap16(v));
+    }
+    umtrx_convert_generic.sc16_to_item32(in + i, out + i, nsamps - i);
+}
+
+const umtrx_convert_kernels umtrx_convert_sse2 = {
+    "sse2",
+    &sse2_item32_to_fc32,
+    &sse2_item32_to_sc16,
+    &sse2_fc32_to_item32,
+    &sse2_sc16_to_item32
+};
@@ -0,0 +1,358 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "umtrx_fault_xport.hpp"
+#include <uhd/utils/msg.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/format.hpp>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+using namespace uhd;
+using namespace uhd::transport;
+
+static const size_t NUM_COPY_FRAMES = 8; //duplicates and truncated packets in flight
+
+/***********************************************************************
+ * Random numbers:
+ * xorshift32, its cheap and repeatable for a seed,
+ * the quality is more than enough to pick packets.
+ **********************************************************************/
+class fault_rng
+{
+public:
+    fault_rng(const boost::uint32_t seed): _state(seed? seed : 1){}
+
+    //! A uniform number in [0, 1)
+    UHD_INLINE double uniform(void)
+    {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state/4294967296.0;
+    }
+
+    //! True with the given probability
+    UHD_INLINE bool roll(const double probability)
+    {
+        return probability > 0 and this->uniform() < probability;
+    }
+
+private:
+    boost::uint32_t _state;
+};
+
+/***********************************************************************
+ * Copy frame:
+ * Holds a copy of a received packet for the duplicates and truncation.
+ * Claimed until the user releases the managed buffer.
+ **********************************************************************/
+class fault_recv_frame : public managed_recv_buffer
+{
+public:
+    fault_recv_frame(const size_t frame_size):
+        _mem(frame_size)
+    {
+        _claimed.write(0);
+    }
+
+    void release(void)
+    {
+        _claimed.write(0);
+    }
+
+    UHD_INLINE bool claimed(void)
+    {
+        return _claimed.read() != 0;
+    }
+
+    UHD_INLINE sptr get_new(const void *mem, const size_t len)
+    {
+        _claimed.write(1);
+        std::memcpy(&_mem.front(), mem, len);
+        return make(this, &_mem.front(), len);
+    }
+
+private:
+    std::vector<char> _mem;
+    atomic_uint32_t _claimed;
+};
+
+/***********************************************************************
+ * Send frame:
+ * The user fills a private frame, the commit copies it into a frame
+ * of the wrapped transport unless the packet is dropped.
+ **********************************************************************/
+class umtrx_fault_xport_impl;
+
+class fault_send_frame : public managed_send_buffer
+{
+public:
+    fault_send_frame(umtrx_fault_xport_impl *xport, const size_t frame_size):
+        _xport(xport), _mem(frame_size)
+    {
+        _claimed.write(0);
+    }
+
+    void release(void); //commits to the wrapped transport
+
+    UHD_INLINE bool claimed(void)
+    {
+        return _claimed.read() != 0;
+    }
+
+    UHD_INLINE void unclaim(void)
+    {
+        _claimed.write(0);
+    }
+
+    UHD_INLINE sptr get_new(void)
+    {
+        _claimed.write(1);
+        return make(this, &_mem.front(), _mem.size());
+    }
+
+private:
+    umtrx_fault_xport_impl *_xport;
+    std::vector<char> _mem;
+    atomic_uint32_t _claimed;
+};
+
+/***********************************************************************
+ * Fault injection transport implementation
+ **********************************************************************/
+class umtrx_fault_xport_impl : public umtrx_fault_xport
+{
+public:
+    umtrx_fault_xport_impl(zero_copy_if::sptr xport, const params_t &params):
+        _xport(xport), _params(params),
+        _recv_rng(params.seed), _send_rng(params.seed ^ 0x5a5a5a5a)
+    {
+        for (size_t i = 0; i < NUM_COPY_FRAMES; i++)
+        {
+            _copy_frames.push_back(boost::shared_ptr<fault_recv_frame>(new fault_recv_frame(_xport->get_recv_frame_size())));
+        }
+        if (_params.send_drop > 0) for (size_t i = 0; i < _xport->get_num_send_frames(); i++)
+        {
+            _send_frames.push_back(boost::shared_ptr<fault_send_frame>(new fault_send_frame(this, _xport->get_send_frame_size())));
+        }
+        _drops.write(0);
+        _reorders.write(0);
+        _dups.write(0);
+        _delays.write(0);
+        _truncs.write(0);
+        _send_drops.write(0);
+    }
+
+    ~umtrx_fault_xport_impl(void)
+    {
+        _pending.clear(); //give the held frames back before the copies go
+        const stats_t stats = this->get_stats();
+        UHD_MSG(status) << boost::format(
+            "Fault injection: %u drops, %u reorders, %u dups, %u delays, %u truncs, %u send drops")
+            % stats.drops % stats.reorders % stats.dups % stats.delays % stats.truncs % stats.send_drops << std::endl;
+    }
+
+    /*******************************************************************
+     * Receive implementation:
+     * The packets held back by a reorder or a duplicate come first,
+     * they do not go through the faults a second time.
+     ******************************************************************/
+    managed_recv_buffer::sptr get_recv_buff(double timeout)
+    {
+        if (not _pending.empty())
+        {
+            managed_recv_buffer::sptr buff = _pending.front();
+            _pending.pop_front();
+            return buff;
+        }
+
+        managed_recv_buffer::sptr buff = _xport->get_recv_buff(timeout);
+        while (buff and _recv_rng.roll(_params.drop))
+        {
+            _drops.inc();
+            buff = _xport->get_recv_buff(timeout);
+        }
+        if (not buff) return buff;
+
+        if (_recv_rng.roll(_params.delay))
+        {
+            _delays.inc();
+            boost::this_thread::sleep(boost::posix_time::microseconds(long(_recv_rng.uniform()*_params.delay_us)));
+        }
+
+        if (_recv_rng.roll(_params.trunc) and buff->size() > 2*sizeof(boost::uint32_t))
+        {
+            //keep a whole number of words, at least one
+            const size_t num_words32 = 1 + size_t(_recv_rng.uniform()*(buff->size()/sizeof(boost::uint32_t) - 1));
+            managed_recv_buffer::sptr copy = this->copy_buff(buff, num_words32*sizeof(boost::uint32_t));
+            if (copy)
+            {
+                _truncs.inc();
+                buff = copy;
+            }
+        }
+
+        if (_recv_rng.roll(_params.dup))
+        {
+            managed_recv_buffer::sptr copy = this->copy_buff(buff, buff->size());
+            if (copy)
+            {
+                _dups.inc();
+                _pending.push_back(copy);
+            }
+        }
+
+        if (_recv_rng.roll(_params.reorder))
+        {
+            managed_recv_buffer::sptr next = _xport->get_recv_buff(timeout);
+            if (next)
+            {
+                _reorders.inc();
+                _pending.push_front(buff);
+                return next;
+            }
+        }
+
+        return buff;
+    }
+
+    size_t get_num_recv_frames(void) const
+    {
+        return _xport->get_num_recv_frames();
+    }
+
+    size_t get_recv_frame_size(void) const
+    {
+        return _xport->get_recv_frame_size();
+    }
+
+    /*******************************************************************
+     * Send implementation:
+     * Without send drops the frames of the wrapped transport are used.
+     ******************************************************************/
+    managed_send_buffer::sptr get_send_buff(double timeout)
+    {
+        if (_send_frames.empty()) return _xport->get_send_buff(timeout);
+        for (size_t i = 0; i < _send_frames.size(); i++)
+        {
+            if (not _send_frames[i]->claimed()) return _send_frames[i]->get_new();
+        }
+        return managed_send_buffer::sptr(); //all frames are held by the user
+    }
+
+    size_t get_num_send_frames(void) const
+    {
+        return _xport->get_num_send_frames();
+    }
+
+    size_t get_send_frame_size(void) const
+    {
+        return _xport->get_send_frame_size();
+    }
+
+    void commit(fault_send_frame *frame, const void *mem, const size_t len)
+    {
+        if (_send_rng.roll(_params.send_drop))
+        {
+            _send_drops.inc();
+        }
+        else
+        {
+            managed_send_buffer::sptr buff = _xport->get_send_buff();
+            if (buff)
+            {
+                std::memcpy(buff->cast<void *>(), mem, len);
+                buff->commit(len);
+            }
+            else _send_drops.inc(); //the wrapped transport had no frame
+        }
+        frame->unclaim();
+    }
+
+    stats_t get_stats(void)
+    {
+        stats_t stats;
+        stats.drops = _drops.read();
+        stats.reorders = _reorders.read();
+        stats.dups = _dups.read();
+        stats.delays = _delays.read();
+        stats.truncs = _truncs.read();
+        stats.send_drops = _send_drops.read();
+        return stats;
+    }
+
+private:
+    managed_recv_buffer::sptr copy_buff(managed_recv_buffer::sptr buff, const size_t len)
+    {
+        for (size_t i = 0; i < _copy_frames.size(); i++)
+        {
+            if (not _copy_frames[i]->claimed()) return _copy_frames[i]->get_new(buff->cast<const void *>(), len);
+        }
+        return managed_recv_buffer::sptr(); //all copies are in use, skip the fault
+    }
+
+    zero_copy_if::sptr _xport;
+    const params_t _params;
+    fault_rng _recv_rng, _send_rng; //one per side, they run on different threads
+    std::deque<managed_recv_buffer::sptr> _pending;
+    std::vector<boost::shared_ptr<fault_recv_frame> > _copy_frames;
+    std::vector<boost::shared_ptr<fault_send_frame> > _send_frames;
+    atomic_uint32_t _drops, _reorders, _dups, _delays, _truncs, _send_drops;
+};
+
+void fault_send_frame::release(void)
+{
+    _xport->commit(this, &_mem.front(), this->size());
+}
+
+/***********************************************************************
+ * Parameters and factory
+ **********************************************************************/
+static double get_fault_param(
+    const device_addr_t &args, const device_addr_t &defaults,
+    const std::string &name, const std::string &chan, const double def
+){
+    const std::string chan_key = "fault_" + name + "_" + chan;
+    const std::string key = "fault_" + name;
+    if (args.has_key(chan_key)) return args.cast<double>(chan_key, def);
+    if (defaults.has_key(chan_key)) return defaults.cast<double>(chan_key, def);
+    if (args.has_key(key)) return args.cast<double>(key, def);
+    return defaults.cast<double>(key, def);
+}
+
+umtrx_fault_xport::params_t umtrx_fault_xport::get_params(const device_addr_t &args, const device_addr_t &defaults, const std::string &chan)
+{
+    params_t params;
+    params.drop = get_fault_param(args, defaults, "drop", chan, params.drop);
+    params.reorder = get_fault_param(args, defaults, "reorder", chan, params.reorder);
+    params.dup = get_fault_param(args, defaults, "dup", chan, params.dup);
+    params.delay = get_fault_param(args, defaults, "delay", chan, params.delay);
+    params.trunc = get_fault_param(args, defaults, "trunc", chan, params.trunc);
+    params.send_drop = get_fault_param(args, defaults, "send_drop", chan, params.send_drop);
+    params.delay_us = get_fault_param(args, defaults, "delay_us", chan, params.delay_us);
+    params.seed = boost::uint32_t(get_fault_param(args, defaults, "seed", chan, params.seed));
+    for (size_t i = 0; i < chan.size(); i++) params.seed = params.seed*31 + chan[i]; //channels fail independently
+    return params;
+}
+
+umtrx_fault_xport::sptr umtrx_fault_xport::make(zero_copy_if::sptr xport, const params_t &params)
+{
+    return sptr(new umtrx_fault_xport_impl(xport, params));
+}
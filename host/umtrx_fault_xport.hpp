@@ -0,0 +1,97 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_FAULT_XPORT_HPP
+#define INCLUDED_UMTRX_FAULT_XPORT_HPP
+
+#include <uhd/transport/zero_copy.hpp>
+#include <uhd/types/device_addr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+/*!
+ * The umtrx fault injection transport:
+ * A zero copy interface wrapped around a streaming transport which
+ * drops, reorders, duplicates, delays and truncates received packets
+ * and drops sent packets at random, to exercise the recovery paths
+ * of the streamers and the flow control without a bad network.
+ *
+ * It is enabled per transport with the fault_* device or stream args,
+ * each one the probability per packet. A key with the channel suffix
+ * overrides the plain key for that channel, the suffixes are rx0..rx3
+ * and tx0..tx1. Ex: fault_drop=0.001,fault_reorder_rx1=0.01
+ *
+ * - fault_drop: drop a received packet
+ * - fault_reorder: swap a received packet with the next one
+ * - fault_dup: receive a packet twice
+ * - fault_delay: hold a received packet for up to fault_delay_us
+ * - fault_trunc: cut a received packet short
+ * - fault_send_drop: drop a sent packet
+ * - fault_seed: the random seed, for repeatable runs
+ *
+ * The received packets of a TX transport are the flow control and
+ * async messages. A wrapped transport is no longer a umtrx_udp_mmsg,
+ * so send batching and the async event loop are not used with it.
+ */
+class umtrx_fault_xport : public uhd::transport::zero_copy_if
+{
+public:
+    typedef boost::shared_ptr<umtrx_fault_xport> sptr;
+
+    //! The fault probabilities of one transport
+    struct params_t
+    {
+        params_t(void): drop(0), reorder(0), dup(0), delay(0), trunc(0), send_drop(0), delay_us(1000), seed(1){}
+        double drop, reorder, dup, delay, trunc, send_drop;
+        double delay_us; //!< the longest delay in microseconds
+        boost::uint32_t seed;
+
+        //! True when there is any fault to inject
+        bool any(void) const
+        {
+            return drop > 0 or reorder > 0 or dup > 0 or delay > 0 or trunc > 0 or send_drop > 0;
+        }
+    };
+
+    //! The injected fault counts of one transport
+    struct stats_t
+    {
+        stats_t(void): drops(0), reorders(0), dups(0), delays(0), truncs(0), send_drops(0){}
+        size_t drops, reorders, dups, delays, truncs, send_drops;
+    };
+
+    /*!
+     * Get the fault parameters of a channel.
+     * \param args the args to look in first, ex: the stream args
+     * \param defaults the args to look in next, ex: the device args
+     * \param chan the channel suffix, ex: rx0
+     */
+    static params_t get_params(const uhd::device_addr_t &args, const uhd::device_addr_t &defaults, const std::string &chan);
+
+    /*!
+     * Wrap a transport.
+     * \param xport the transport to inject the faults into
+     * \param params the fault probabilities
+     */
+    static sptr make(uhd::transport::zero_copy_if::sptr xport, const params_t &params);
+
+    //! Get the injected fault counts
+    virtual stats_t get_stats(void) = 0;
+};
+
+#endif /* INCLUDED_UMTRX_FAULT_XPORT_HPP */
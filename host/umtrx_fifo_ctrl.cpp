@@ -25,6 +25,9 @@
 #include <boost/thread/thread.hpp>
 #include <boost/asio.hpp> //htonl
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <vector>
+#include <map>
 
 using namespace uhd;
 using namespace uhd::transport;
@@ -34,6 +37,7 @@ static const size_t PEEK32_CMD = 0;
 static const double ACK_TIMEOUT = 0.5;
 static const double MASSIVE_TIMEOUT = 10.0; //for when we wait on a timed command
 static const boost::uint32_t MAX_SEQS_OUT = 15;
+static const size_t MAX_ACK_ERRORS = 8; //kept for the report, the rest are counted
 
 #define SPI_DIV SR_SPI_CORE + 0
 #define SPI_CTRL SR_SPI_CORE + 1
@@ -44,15 +48,17 @@ static const boost::uint32_t MAX_SEQS_OUT = 15;
 class umtrx_fifo_ctrl_impl : public umtrx_fifo_ctrl{
 public:
 
-    umtrx_fifo_ctrl_impl(zero_copy_if::sptr xport, const boost::uint32_t sid, const boost::uint32_t window_size):
+    umtrx_fifo_ctrl_impl(zero_copy_if::sptr xport, const boost::uint32_t sid, const boost::uint32_t window_size, const bool batched):
         _xport(xport),
         _sid(sid),
         _window_size(std::min(window_size, MAX_SEQS_OUT)),
+        _batched(batched),
         _seq_out(0),
         _seq_ack(0),
-        _timeout(ACK_TIMEOUT)
+        _timeout(ACK_TIMEOUT),
+        _num_ack_errors(0)
     {
-        UHD_MSG(status) << "fifo_ctrl.window_size = " << _window_size << std::endl;
+        UHD_MSG(status) << "fifo_ctrl.window_size = " << _window_size << (_batched? ", batched" : "") << std::endl;
         while (_xport->get_recv_buff(0.0)){} //flush
         this->set_time(uhd::time_spec_t(0.0));
         this->set_tick_rate(1.0); //something possible but bogus
@@ -62,7 +68,7 @@ public:
     ~umtrx_fifo_ctrl_impl(void){
         _timeout = ACK_TIMEOUT; //reset timeout to something small
         UHD_SAFE_CALL(
-            this->peek32(0); //dummy peek with the purpose of ack'ing all packets
+            this->fence(); //ack all packets
         )
     }
 
@@ -72,17 +78,44 @@ public:
     void poke32(wb_addr_type addr, boost::uint32_t data){
         boost::mutex::scoped_lock lock(_mutex);
 
-        this->send_pkt((addr - SETTING_REGS_BASE)/4, data, POKE32_CMD);
-
-        this->wait_for_ack(_seq_out-_window_size);
+        this->poke_cmd((addr - SETTING_REGS_BASE)/4, data);
     }
 
     boost::uint32_t peek32(wb_addr_type addr){
         boost::mutex::scoped_lock lock(_mutex);
 
-        this->send_pkt((addr - READBACK_BASE)/4, 0, PEEK32_CMD);
+        this->flush_batch();
+        this->peek_cmd((addr - READBACK_BASE)/4);
+
+        const boost::uint32_t data = this->wait_for_ack(_seq_out);
+        this->throw_ack_errors();
+        return data;
+    }
 
-        return this->wait_for_ack(_seq_out);
+    void fence(void){
+        boost::mutex::scoped_lock lock(_mutex);
+        this->flush_batch();
+        this->wait_for_ack(_seq_out);
+        this->throw_ack_errors();
+    }
+
+    /*******************************************************************
+     * Batches of writes
+     ******************************************************************/
+    void begin_batch(void){
+        boost::mutex::scoped_lock lock(_mutex);
+        _batches[boost::this_thread::get_id()].depth++;
+    }
+
+    void commit(void){
+        boost::mutex::scoped_lock lock(_mutex);
+        batches_type::iterator it = _batches.find(boost::this_thread::get_id());
+        if (it == _batches.end()) throw uhd::runtime_error("fifo ctrl commit without a begin_batch");
+        if (--it->second.depth != 0) return;
+        std::vector<ctrl_cmd_type> cmds;
+        cmds.swap(it->second.cmds);
+        _batches.erase(it);
+        this->send_cmds(cmds);
     }
 
     /*******************************************************************
@@ -102,8 +135,7 @@ public:
     void init_spi(void){
         boost::mutex::scoped_lock lock(_mutex);
 
-        this->send_pkt(SPI_DIV, SPI_DIVIDER, POKE32_CMD);
-        this->wait_for_ack(_seq_out-_window_size);
+        this->poke_cmd(SPI_DIV, SPI_DIVIDER);
 
         _ctrl_word_cache = 0; // force update first time around
     }
@@ -117,34 +149,70 @@ public:
     ){
         boost::mutex::scoped_lock lock(_mutex);
 
-        //load control word
-        boost::uint32_t ctrl_word = 0;
-        ctrl_word |= ((which_slave & 0xffffff) << 0);
-        ctrl_word |= ((num_bits & 0x3ff) << 24);
-        if (config.mosi_edge == spi_config_t::EDGE_FALL) ctrl_word |= (1 << 31);
-        if (config.miso_edge == spi_config_t::EDGE_RISE) ctrl_word |= (1 << 30);
-
-        //load data word (must be in upper bits)
-        const boost::uint32_t data_out = data << (32 - num_bits);
+        this->send_spi(which_slave, config, data, num_bits);
 
-        //conditionally send control word
-        if (_ctrl_word_cache != ctrl_word){
-            this->send_pkt(SPI_CTRL, ctrl_word, POKE32_CMD);
-            this->wait_for_ack(_seq_out-_window_size);
-            _ctrl_word_cache = ctrl_word;
+        //conditional readback, the only wait for the whole pipeline
+        if (readback){
+            this->flush_batch();
+            this->peek_cmd(U2_REG_SPI_RB);
+            const boost::uint32_t data = this->wait_for_ack(_seq_out);
+            this->throw_ack_errors();
+            return data;
         }
 
-        //send data word
-        this->send_pkt(SPI_DATA, data_out, POKE32_CMD);
-        this->wait_for_ack(_seq_out-_window_size);
+        return 0;
+    }
 
-        //conditional readback
-        if (readback){
-            this->send_pkt(U2_REG_SPI_RB, 0, PEEK32_CMD);
-            return this->wait_for_ack(_seq_out);
+    /*******************************************************************
+     * Peeks and SPI readbacks without waiting:
+     * The value is kept when its ack goes by, until collected.
+     ******************************************************************/
+    size_t peek32_async(wb_addr_type addr){
+        boost::mutex::scoped_lock lock(_mutex);
+        this->flush_batch();
+        return this->send_async_peek((addr - READBACK_BASE)/4);
+    }
+
+    size_t read_spi_async(
+        int which_slave,
+        const spi_config_t &config,
+        boost::uint32_t data,
+        size_t num_bits
+    ){
+        boost::mutex::scoped_lock lock(_mutex);
+        this->send_spi(which_slave, config, data, num_bits);
+        this->flush_batch();
+        return this->send_async_peek(U2_REG_SPI_RB);
+    }
+
+    boost::uint32_t peek32_collect(const size_t handle){
+        boost::mutex::scoped_lock lock(_mutex);
+        async_peeks_type::iterator it = _async_peeks.find(boost::uint16_t(handle));
+        if (handle > 0xffff or it == _async_peeks.end()){
+            throw uhd::key_error(str(boost::format("fifo ctrl: no peek in flight with handle %u") % handle));
         }
+        //the ack errors of other commands stay for the next readback or fence
+        //the handle is gone on every exit, or a later peek with the same sequence would match it
+        if (not it->second.first){
+            try{
+                this->wait_for_ack(it->first);
+            }
+            catch(...){
+                _async_peeks.erase(it);
+                throw;
+            }
+        }
+        const std::pair<bool, boost::uint32_t> result = it->second;
+        _async_peeks.erase(it);
+        if (not result.first){
+            throw uhd::io_error(str(boost::format("fifo ctrl: the ack of peek %u was lost") % handle));
+        }
+        return result.second;
+    }
 
-        return 0;
+    void peek32_cancel(const size_t handle){
+        boost::mutex::scoped_lock lock(_mutex);
+        if (handle <= 0xffff) _async_peeks.erase(boost::uint16_t(handle));
     }
 
     /*******************************************************************
@@ -152,6 +220,7 @@ public:
      ******************************************************************/
     void set_time(const uhd::time_spec_t &time){
         boost::mutex::scoped_lock lock(_mutex);
+        this->flush_all_batches(); //the queued writes keep their time
         _time = time;
         _use_time = _time != uhd::time_spec_t(0.0);
         if (_use_time) _timeout = MASSIVE_TIMEOUT; //permanently sets larger timeout
@@ -159,6 +228,7 @@ public:
 
     void set_tick_rate(const double rate){
         boost::mutex::scoped_lock lock(_mutex);
+        this->flush_all_batches();
         _tick_rate = rate;
     }
 
@@ -167,21 +237,106 @@ private:
     /*******************************************************************
      * Primary control and interaction private methods
      ******************************************************************/
-    UHD_INLINE void send_pkt(wb_addr_type addr, boost::uint32_t data, int cmd){
+    struct ctrl_cmd_type{
+        boost::uint32_t addr_cmd; //register address and command bits
+        boost::uint32_t data;
+    };
+
+    UHD_INLINE void poke_cmd(wb_addr_type addr, boost::uint32_t data){
+        const ctrl_cmd_type cmd = {boost::uint32_t((addr & 0xff) | POKE32_CMD), data};
+        batches_type::iterator it = _batches.empty()? _batches.end() : _batches.find(boost::this_thread::get_id());
+        if (it == _batches.end()){
+            this->send_pkt(&cmd, 1);
+            this->wait_for_ack(_seq_out-_window_size);
+            return;
+        }
+        it->second.cmds.push_back(cmd);
+        if (it->second.cmds.size() == _window_size) this->send_cmds(it->second.cmds);
+    }
+
+    UHD_INLINE void peek_cmd(wb_addr_type addr){
+        const ctrl_cmd_type cmd = {boost::uint32_t((addr & 0xff) | PEEK32_CMD), 0};
+        this->send_pkt(&cmd, 1);
+    }
+
+    //! Send a peek once there is room in the window, its sequence number is the handle
+    size_t send_async_peek(wb_addr_type addr){
+        this->wait_for_ack(_seq_out + 1 - _window_size);
+        this->peek_cmd(addr);
+        _async_peeks[_seq_out] = std::make_pair(false, boost::uint32_t(0));
+        return _seq_out;
+    }
+
+    //! Queue or send the SPI control and data words, the transaction starts with the latter
+    void send_spi(
+        int which_slave,
+        const spi_config_t &config,
+        boost::uint32_t data,
+        size_t num_bits
+    ){
+        //load control word
+        boost::uint32_t ctrl_word = 0;
+        ctrl_word |= ((which_slave & 0xffffff) << 0);
+        ctrl_word |= ((num_bits & 0x3ff) << 24);
+        if (config.mosi_edge == spi_config_t::EDGE_FALL) ctrl_word |= (1 << 31);
+        if (config.miso_edge == spi_config_t::EDGE_RISE) ctrl_word |= (1 << 30);
+
+        //load data word (must be in upper bits)
+        const boost::uint32_t data_out = data << (32 - num_bits);
+
+        //conditionally send control word
+        if (_ctrl_word_cache != ctrl_word){
+            this->poke_cmd(SPI_CTRL, ctrl_word);
+            _ctrl_word_cache = ctrl_word;
+        }
+
+        //send data word
+        this->poke_cmd(SPI_DATA, data_out);
+    }
+
+    //! Send the writes queued by the calling thread, before its readbacks
+    void flush_batch(void){
+        if (_batches.empty()) return;
+        batches_type::iterator it = _batches.find(boost::this_thread::get_id());
+        if (it != _batches.end()) this->send_cmds(it->second.cmds);
+    }
+
+    //! Send the writes queued by every thread, before a change of the command time
+    void flush_all_batches(void){
+        for (batches_type::iterator it = _batches.begin(); it != _batches.end(); ++it){
+            this->send_cmds(it->second.cmds);
+        }
+    }
+
+    //! Send and clear queued writes, a window full per packet or one per packet when not batched
+    void send_cmds(std::vector<ctrl_cmd_type> &cmds){
+        if (cmds.empty()) return;
+        std::vector<ctrl_cmd_type> batch;
+        batch.swap(cmds);
+        const size_t cmds_per_pkt = _batched? _window_size : 1;
+        for (size_t i = 0; i < batch.size(); i += cmds_per_pkt){
+            const size_t num_cmds = std::min(cmds_per_pkt, batch.size() - i);
+            this->wait_for_ack(_seq_out + num_cmds - _window_size); //room for all of them
+            this->send_pkt(&batch[i], num_cmds);
+        }
+    }
+
+    //! Send commands in one packet, each takes the next sequence number
+    UHD_INLINE void send_pkt(const ctrl_cmd_type *cmds, const size_t num_cmds){
         managed_send_buffer::sptr buff = _xport->get_send_buff(0.0);
         if (not buff){
             throw uhd::runtime_error("fifo ctrl timed out getting a send buffer");
         }
         boost::uint32_t *trans = buff->cast<boost::uint32_t *>();
-        trans[0] = htonl(++_seq_out);
+        trans[0] = htonl(boost::uint16_t(_seq_out + num_cmds));
         boost::uint32_t *pkt = trans + 1;
 
         //load packet info
         vrt::if_packet_info_t packet_info;
         packet_info.packet_type = vrt::if_packet_info_t::PACKET_TYPE_CONTEXT;
-        packet_info.num_payload_words32 = 2;
+        packet_info.num_payload_words32 = 2*num_cmds;
         packet_info.num_payload_bytes = packet_info.num_payload_words32*sizeof(boost::uint32_t);
-        packet_info.packet_count = _seq_out;
+        packet_info.packet_count = _seq_out + 1;
         packet_info.sid = _sid;
         packet_info.tsf = _time.to_ticks(_tick_rate);
         packet_info.sob = false;
@@ -195,10 +350,13 @@ private:
         //load header
         vrt::if_hdr_pack_be(pkt, packet_info);
 
-        //load payload
-        const boost::uint32_t ctrl_word = (addr & 0xff) | cmd | (_seq_out << 16);
-        pkt[packet_info.num_header_words32+0] = htonl(ctrl_word);
-        pkt[packet_info.num_header_words32+1] = htonl(data);
+        //load payload, an (address and command, data) pair per command
+        boost::uint32_t *payload = pkt + packet_info.num_header_words32;
+        for (size_t i = 0; i < num_cmds; i++){
+            const boost::uint32_t ctrl_word = cmds[i].addr_cmd | (boost::uint32_t(++_seq_out) << 16);
+            payload[2*i+0] = htonl(ctrl_word);
+            payload[2*i+1] = htonl(cmds[i].data);
+        }
 
         //send the buffer over the interface
         buff->commit(sizeof(boost::uint32_t)*(packet_info.num_packet_words32+1));
@@ -221,7 +379,25 @@ private:
             vrt::if_packet_info_t packet_info;
             packet_info.num_packet_words32 = buff->size()/sizeof(boost::uint32_t);
             vrt::if_hdr_unpack_be(pkt, packet_info);
-            _seq_ack = ntohl(pkt[packet_info.num_header_words32+0]) >> 16;
+            const boost::uint16_t seq = ntohl(pkt[packet_info.num_header_words32+0]) >> 16;
+
+            //one ack per command in order, a gap is a lost command or ack
+            const boost::uint16_t seq_next = _seq_ack + 1;
+            if (seq != seq_next){
+                if (not wraparound_lt16(_seq_ack, seq) or wraparound_lt16(_seq_out, seq)){
+                    this->add_ack_error(str(boost::format("unexpected ack %u, expected %u") % seq % seq_next));
+                    continue;
+                }
+                this->add_ack_error(str(boost::format("no ack for %u command(s) before %u") % boost::uint16_t(seq - seq_next) % seq));
+            }
+            _seq_ack = seq;
+
+            //keep the value of a peek sent without waiting
+            if (not _async_peeks.empty()){
+                async_peeks_type::iterator it = _async_peeks.find(seq);
+                if (it != _async_peeks.end()) it->second = std::make_pair(true, boost::uint32_t(ntohl(pkt[packet_info.num_header_words32+1])));
+            }
+
             if (_seq_ack == seq_to_ack){
                 return ntohl(pkt[packet_info.num_header_words32+1]);
             }
@@ -230,9 +406,31 @@ private:
         return 0;
     }
 
+    void add_ack_error(const std::string &error){
+        if (_ack_errors.size() < MAX_ACK_ERRORS) _ack_errors.push_back(error);
+        _num_ack_errors++;
+    }
+
+    void throw_ack_errors(void){
+        if (_num_ack_errors == 0) return;
+        std::string msg = str(boost::format("fifo ctrl: %u ack errors since the last readback") % _num_ack_errors);
+        BOOST_FOREACH(const std::string &error, _ack_errors) msg += "\n    " + error;
+        _ack_errors.clear();
+        _num_ack_errors = 0;
+        throw uhd::io_error(msg);
+    }
+
     zero_copy_if::sptr _xport;
     const boost::uint32_t _sid;
     const boost::uint32_t _window_size;
+    const bool _batched;
+    struct batch_type{
+        batch_type(void): depth(0){}
+        size_t depth; //nested begin_batch() calls
+        std::vector<ctrl_cmd_type> cmds;
+    };
+    typedef std::map<boost::thread::id, batch_type> batches_type;
+    batches_type _batches; //the writes are queued per thread, others go out right away
     boost::mutex _mutex;
     boost::uint16_t _seq_out;
     boost::uint16_t _seq_ack;
@@ -241,9 +439,13 @@ private:
     double _tick_rate;
     double _timeout;
     boost::uint32_t _ctrl_word_cache;
+    std::vector<std::string> _ack_errors;
+    size_t _num_ack_errors;
+    typedef std::map<boost::uint16_t, std::pair<bool, boost::uint32_t> > async_peeks_type;
+    async_peeks_type _async_peeks; //acked and the value, by sequence number
 };
 
 
-umtrx_fifo_ctrl::sptr umtrx_fifo_ctrl::make(zero_copy_if::sptr xport, const boost::uint32_t sid, const size_t window_size){
-    return sptr(new umtrx_fifo_ctrl_impl(xport, sid, boost::uint32_t(window_size)));
+umtrx_fifo_ctrl::sptr umtrx_fifo_ctrl::make(zero_copy_if::sptr xport, const boost::uint32_t sid, const size_t window_size, const bool batched){
+    return sptr(new umtrx_fifo_ctrl_impl(xport, sid, boost::uint32_t(window_size), batched));
 }
@@ -25,7 +25,9 @@
 #include <boost/utility.hpp>
 #include <boost/cstdint.hpp>
 #include <uhd/types/wb_iface.hpp>
+#include <uhd/utils/safe_call.hpp>
 #include <string>
+#include <vector>
 
 /*!
  * The umtrx FIFO control class:
@@ -36,14 +38,142 @@ class umtrx_fifo_ctrl : public uhd::wb_iface, public uhd::spi_iface
 public:
     typedef boost::shared_ptr<umtrx_fifo_ctrl> sptr;
 
-    //! Make a new FIFO control object
-    static sptr make(uhd::transport::zero_copy_if::sptr xport, const boost::uint32_t sid, const size_t window_size);
+    /*!
+     * Make a new FIFO control object
+     * \param xport the control transport
+     * \param sid the stream ID of the control packets
+     * \param window_size the most commands in flight, clipped to the hardware maximum
+     * \param batched true when the FPGA takes several commands per packet
+     */
+    static sptr make(uhd::transport::zero_copy_if::sptr xport, const boost::uint32_t sid, const size_t window_size, const bool batched = false);
 
     //! Set the command time that will activate
     virtual void set_time(const uhd::time_spec_t &time) = 0;
 
     //! Set the tick rate (converting time into ticks)
     virtual void set_tick_rate(const double rate) = 0;
+
+    /*!
+     * Wait for the acks of all the commands in flight.
+     * Writes only wait for room in the window, the ack errors
+     * found meanwhile are kept and thrown here or by the next readback.
+     */
+    virtual void fence(void) = 0;
+
+    /*!
+     * Queue the writes until the matching commit(), the pairs nest.
+     * The queued writes go out a window full per packet. A readback,
+     * fence() or set_time() sends them first, so the order holds.
+     * Only the writes of the calling thread are queued, the writes
+     * of other threads meanwhile go out right away.
+     */
+    virtual void begin_batch(void) = 0;
+
+    //! Send the writes queued since the matching begin_batch()
+    virtual void commit(void) = 0;
+
+    /*!
+     * Send a peek without waiting for its value, so that several
+     * peeks in a row take one round trip. Every handle has to be
+     * collected with peek32_collect() or cancelled, they are sequence
+     * numbers and come back after 65536 commands. The umtrx_fifo_ctrl_peeks
+     * guard cancels the handles of its peeks that were not collected.
+     * \return the handle of the peek
+     */
+    virtual size_t peek32_async(const wb_addr_type addr) = 0;
+
+    //! Like peek32_async() for an SPI transaction with readback
+    virtual size_t read_spi_async(
+        int which_slave,
+        const uhd::spi_config_t &config,
+        boost::uint32_t data,
+        size_t num_bits
+    ) = 0;
+
+    /*!
+     * Wait for the value of a peek sent without waiting.
+     * Throws only for this peek: an unknown handle or a lost ack.
+     * The ack errors of other commands are left to the next
+     * readback or fence().
+     */
+    virtual boost::uint32_t peek32_collect(const size_t handle) = 0;
+
+    //! Forget a peek sent without waiting, its value is dropped if it comes
+    virtual void peek32_cancel(const size_t handle) = 0;
+};
+
+/*!
+ * A scoped batch of fifo control writes:
+ * begin_batch() on construction and commit() on destruction.
+ */
+class umtrx_fifo_ctrl_batch : boost::noncopyable
+{
+public:
+    umtrx_fifo_ctrl_batch(umtrx_fifo_ctrl::sptr ctrl): _ctrl(ctrl)
+    {
+        _ctrl->begin_batch();
+    }
+
+    ~umtrx_fifo_ctrl_batch(void)
+    {
+        UHD_SAFE_CALL(_ctrl->commit();)
+    }
+
+private:
+    umtrx_fifo_ctrl::sptr _ctrl;
+};
+
+/*!
+ * Scoped peeks sent without waiting: they are collected by index
+ * and the ones not collected are cancelled on destruction,
+ * ex: when an exception unwinds before the last collect().
+ */
+class umtrx_fifo_ctrl_peeks : boost::noncopyable
+{
+public:
+    umtrx_fifo_ctrl_peeks(umtrx_fifo_ctrl::sptr ctrl): _ctrl(ctrl)
+    {
+        //pass
+    }
+
+    ~umtrx_fifo_ctrl_peeks(void)
+    {
+        for (size_t i = 0; i < _handles.size(); i++)
+        {
+            if (not _collected[i]) UHD_SAFE_CALL(_ctrl->peek32_cancel(_handles[i]);)
+        }
+    }
+
+    //! Send a peek, returns the index to collect it
+    size_t peek32(const uhd::wb_iface::wb_addr_type addr)
+    {
+        return this->add(_ctrl->peek32_async(addr));
+    }
+
+    //! Send an SPI transaction with readback, returns the index to collect it
+    size_t read_spi(int which_slave, const uhd::spi_config_t &config, boost::uint32_t data, size_t num_bits)
+    {
+        return this->add(_ctrl->read_spi_async(which_slave, config, data, num_bits));
+    }
+
+    //! Wait for the value of a peek by index
+    boost::uint32_t collect(const size_t index)
+    {
+        _collected.at(index) = true; //the handle is gone once collected, even on a throw
+        return _ctrl->peek32_collect(_handles[index]);
+    }
+
+private:
+    size_t add(const size_t handle)
+    {
+        _handles.push_back(handle);
+        _collected.push_back(false);
+        return _handles.size() - 1;
+    }
+
+    umtrx_fifo_ctrl::sptr _ctrl;
+    std::vector<size_t> _handles;
+    std::vector<bool> _collected;
 };
 
 #endif /* INCLUDED_UMTRX_FIFO_CTRL_HPP */
@@ -0,0 +1,128 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_FLOW_CONTROL_HPP
+#define INCLUDED_UMTRX_FLOW_CONTROL_HPP
+
+#include <uhd/config.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/***********************************************************************
+ * TX flow control monitor
+ *
+ * The sequence out is only touched by the sending thread,
+ * the sequence ack is written by the async thread with an atomic.
+ * While the window is open the check costs two reads and no lock.
+ * When throttled the sender spins briefly, and then blocks on the
+ * condition variable; the ack side only takes the mutex to notify
+ * when it sees a registered waiter.
+ **********************************************************************/
+class flow_control_monitor{
+public:
+    typedef boost::uint32_t seq_type;
+    typedef boost::shared_ptr<flow_control_monitor> sptr;
+
+    /*!
+     * Make a new flow control monitor.
+     * \param max_seqs_out num seqs before throttling
+     */
+    flow_control_monitor(seq_type max_seqs_out):_max_seqs_out(max_seqs_out){
+        this->clear();
+        _ready_fcn = boost::bind(&flow_control_monitor::ready, this);
+    }
+
+    //! Clear the monitor, Ex: when a streamer is created
+    void clear(void){
+        _last_seq_out = 0;
+        _last_seq_ack.write(0);
+        _num_waiters.write(0);
+    }
+
+    /*!
+     * Gets the current sequence number to go out.
+     * Increments the sequence for the next call
+     * \return the sequence to be sent to the dsp
+     */
+    UHD_INLINE seq_type get_curr_seq_out(void){
+        return _last_seq_out++;
+    }
+
+    /*!
+     * Check the flow control condition.
+     * \param timeout the timeout in seconds
+     * \return false on timeout
+     */
+    UHD_INLINE bool check_fc_condition(double timeout){
+        //fast path: the window is open
+        if (this->ready()) return true;
+        if (timeout <= 0.0) return false;
+
+        //acks come in bursts, spin a little before going to sleep
+        for (size_t i = 0; i < SPIN_ITERATIONS; i++){
+            boost::this_thread::yield();
+            if (this->ready()) return true;
+        }
+
+        //slow path: register as a waiter, then re-check under the lock,
+        //the inc is a full barrier so a racing update either sees the
+        //waiter or its ack is seen by the predicate of the timed_wait
+        boost::mutex::scoped_lock lock(_fc_mutex);
+        _num_waiters.inc();
+        boost::this_thread::disable_interruption di; //disable because the wait can throw
+        const bool ok = _fc_cond.timed_wait(lock,
+            boost::posix_time::microseconds(long(timeout*1e6)), _ready_fcn);
+        _num_waiters.dec();
+        return ok;
+    }
+
+    /*!
+     * Update the flow control condition.
+     * \param seq the last sequence number to be ACK'd
+     */
+    UHD_INLINE void update_fc_condition(seq_type seq){
+        _last_seq_ack.write(seq);
+        //cas as a fenced read: the waiter count must be loaded after the ack is stored
+        if (_num_waiters.cas(0, 0) == 0) return;
+        boost::mutex::scoped_lock lock(_fc_mutex);
+        lock.unlock();
+        _fc_cond.notify_one();
+    }
+
+private:
+    static const size_t SPIN_ITERATIONS = 16;
+
+    bool ready(void){
+        return seq_type(_last_seq_out - _last_seq_ack.read()) < _max_seqs_out;
+    }
+
+    boost::mutex _fc_mutex;
+    boost::condition_variable _fc_cond;
+    seq_type _last_seq_out;
+    uhd::atomic_uint32_t _last_seq_ack;
+    uhd::atomic_uint32_t _num_waiters;
+    const seq_type _max_seqs_out;
+    boost::function<bool(void)> _ready_fcn;
+};
+
+#endif /* INCLUDED_UMTRX_FLOW_CONTROL_HPP */
@@ -209,6 +209,7 @@ umtrx_impl::umtrx_impl(const device_addr_t &device_addr)
 {
     _umtrx_vga2_def = device_addr.cast<int>("lmsvga2", UMTRX_VGA2_DEF);
     _device_ip_addr = device_addr["addr"];
+    _device_addr = device_addr;
     UHD_MSG(status) << "UmTRX driver version: " << UMTRX_VERSION << std::endl;
     UHD_MSG(status) << "Opening a UmTRX device... " << _device_ip_addr << std::endl;
 
@@ -262,12 +263,14 @@ umtrx_impl::umtrx_impl(const device_addr_t &device_addr)
     ////////////////////////////////////////////////////////////////
     _iface->poke32(U2_REG_MISC_CTRL_SFC_CLEAR, 1); //clear settings fifo control state machine
     const size_t fifo_ctrl_window(device_addr.cast<size_t>("fifo_ctrl_window", 1024)); //default gets clipped to hardware maximum
-    _ctrl = umtrx_fifo_ctrl::make(this->make_xport(UMTRX_CTRL_FRAMER, device_addr_t()), UMTRX_CTRL_SID, fifo_ctrl_window);
+    const bool fifo_ctrl_batch(fpga_minor >= UMTRX_FPGA_MINOR_CTRL_BATCH and device_addr.cast<int>("fifo_ctrl_batch", 1) != 0);
+    _ctrl = umtrx_fifo_ctrl::make(this->make_xport(UMTRX_CTRL_FRAMER, device_addr_t()), UMTRX_CTRL_SID, fifo_ctrl_window, fifo_ctrl_batch);
     _ctrl->peek32(0); //test readback
     _tree->create<time_spec_t>(mb_path / "time/cmd")
         .subscribe(boost::bind(&umtrx_fifo_ctrl::set_time, _ctrl, _1));
     _tree->create<double>(mb_path / "tick_rate")
         .subscribe(boost::bind(&umtrx_fifo_ctrl::set_tick_rate, _ctrl, _1));
+    _tree->create<umtrx_fifo_ctrl::sptr>(mb_path / "fifo_ctrl").set(_ctrl);
 
     ////////////////////////////////////////////////////////////////////
     // setup the mboard eeprom
@@ -488,7 +491,28 @@ umtrx_impl::umtrx_impl(const device_addr_t &device_addr)
             .publish(boost::bind(&rx_dsp_core_200::get_freq_range, _rx_dsps[dspno]));
         _tree->create<stream_cmd_t>(rx_dsp_path / "stream_cmd")
             .subscribe(boost::bind(&rx_dsp_core_200::issue_stream_command, _rx_dsps[dspno], _1));
+        _tree->create<size_t>(rx_dsp_path / "prefetch/capacity")
+            .publish(boost::bind(&umtrx_impl::get_rx_prefetch_stat, this, dspno, "capacity"));
+        _tree->create<size_t>(rx_dsp_path / "prefetch/occupancy")
+            .publish(boost::bind(&umtrx_impl::get_rx_prefetch_stat, this, dspno, "occupancy"));
+        _tree->create<size_t>(rx_dsp_path / "prefetch/high_water")
+            .publish(boost::bind(&umtrx_impl::get_rx_prefetch_stat, this, dspno, "high_water"));
+        _tree->create<size_t>(rx_dsp_path / "prefetch/seq_errors")
+            .publish(boost::bind(&umtrx_impl::get_rx_prefetch_stat, this, dspno, "seq_errors"));
+        _tree->create<size_t>(rx_dsp_path / "prefetch/bad_packets")
+            .publish(boost::bind(&umtrx_impl::get_rx_prefetch_stat, this, dspno, "bad_packets"));
+        _rx_stats.push_back(umtrx_stream_stats::sptr(new umtrx_stream_stats()));
+        const umtrx_stream_stats &rx_stats = *_rx_stats.back();
+        publish_stat(rx_dsp_path / "stats/packets", rx_stats.packets);
+        publish_stat(rx_dsp_path / "stats/bytes", rx_stats.bytes);
+        publish_stat(rx_dsp_path / "stats/overflows", rx_stats.overflows);
+        publish_stat(rx_dsp_path / "stats/seq_errors", rx_stats.seq_errors);
+        publish_stat(rx_dsp_path / "stats/align_retries", rx_stats.align_retries);
+        publish_stat(rx_dsp_path / "stats/gaps", rx_stats.gaps);
+        publish_stat(rx_dsp_path / "stats/gap_samps", rx_stats.gap_samps);
+        publish_stat(rx_dsp_path / "stats/convert_ns", rx_stats.convert_ns);
     }
+    _rx_prefetch.resize(_rx_dsps.size());
 
     ////////////////////////////////////////////////////////////////
     // create tx dsp control objects
@@ -514,7 +538,24 @@ umtrx_impl::umtrx_impl(const device_addr_t &device_addr)
             .coerce(boost::bind(&tx_dsp_core_200::set_freq, _tx_dsps[dspno], _1));
         _tree->create<meta_range_t>(tx_dsp_path / "freq/range")
             .publish(boost::bind(&tx_dsp_core_200::get_freq_range, _tx_dsps[dspno]));
+        _tree->create<size_t>(tx_dsp_path / "async_queue/dropped")
+            .publish(boost::bind(&umtrx_impl::get_tx_async_dropped, this, dspno));
+        _tx_stats.push_back(umtrx_stream_stats::sptr(new umtrx_stream_stats()));
+        const umtrx_stream_stats &tx_stats = *_tx_stats.back();
+        publish_stat(tx_dsp_path / "stats/packets", tx_stats.packets);
+        publish_stat(tx_dsp_path / "stats/bytes", tx_stats.bytes);
+        publish_stat(tx_dsp_path / "stats/underflows", tx_stats.underflows);
+        publish_stat(tx_dsp_path / "stats/seq_errors", tx_stats.seq_errors);
+        publish_stat(tx_dsp_path / "stats/late_packets", tx_stats.late_packets);
+        publish_stat(tx_dsp_path / "stats/fc_stalls", tx_stats.fc_stalls);
+        publish_stat(tx_dsp_path / "stats/convert_ns", tx_stats.convert_ns);
     }
+    _tx_async_queues.resize(_tx_dsps.size());
+
+    //the device wide async queue for recv_async_msg()
+    _old_async_queue.reset(new async_md_type(1000/*messages deep*/));
+    _tree->create<size_t>(mb_path / "async_queue/dropped")
+        .publish(boost::bind(&async_md_type::get_num_dropped, _old_async_queue));
 
     ////////////////////////////////////////////////////////////////
     // create time control objects
@@ -551,6 +592,13 @@ umtrx_impl::umtrx_impl(const device_addr_t &device_addr)
     ////////////////////////////////////////////////////////////////////
     _lms_ctrl["A"] = lms6002d_ctrl::make(_ctrl/*spi*/, SPI_SS_LMS1, this->get_master_clock_rate() / _pll_div);
     _lms_ctrl["B"] = lms6002d_ctrl::make(_ctrl/*spi*/, SPI_SS_LMS2, this->get_master_clock_rate() / _pll_div);
+    this->update_lms_temperature();
+    //the VCOCAP values of earlier runs, a file per LMS, ex: vcocap_cache=/var/lib/umtrx
+    _vcocap_cache_dir = device_addr.get("vcocap_cache", "");
+    BOOST_FOREACH(const std::string &fe_name, _lms_ctrl.keys())
+    {
+        if (not _vcocap_cache_dir.empty()) _lms_ctrl[fe_name]->load_vcocap_cache(this->vcocap_cache_path(fe_name));
+    }
 
     // LMS dboard do not have physical eeprom so we just hardcode values from host/lib/usrp/dboard/db_lms.cpp
     dboard_eeprom_t rx_db_eeprom, tx_db_eeprom, gdb_db_eeprom;
@@ -766,6 +814,29 @@ umtrx_impl::umtrx_impl(const device_addr_t &device_addr)
     _rx_streamers.resize(_rx_dsps.size());
     _tx_streamers.resize(_tx_dsps.size());
 
+    //one thread services the TX async messages of every channel, ex: async_epoll=1,async_cpu=2,async_prio=0.8
+    //the loop waits on the sockets of the batched transport, so the TX streams use udp_mmsg,
+    //their sends are still one packet per syscall unless mmsg_send_batch or udp_mmsg=1 is given
+    //the latency sensors are per packet, from the kernel receive time of the socket to handled
+    if (device_addr.cast<bool>("async_epoll", false))
+    {
+        if (umtrx_async_loop::is_supported())
+        {
+            _tx_async_loop = umtrx_async_loop::make(
+                device_addr.cast<int>("async_cpu", -1),
+                device_addr.cast<float>("async_prio", 0.5));
+            _tree->create<sensor_value_t>(mb_path / "sensors" / "tx_async_latency")
+                .publish(boost::bind(&umtrx_impl::read_tx_async_stat, this, "latency"));
+            _tree->create<sensor_value_t>(mb_path / "sensors" / "tx_async_latency_max")
+                .publish(boost::bind(&umtrx_impl::read_tx_async_stat, this, "latency_max"));
+            _tree->create<sensor_value_t>(mb_path / "sensors" / "tx_async_handler_time")
+                .publish(boost::bind(&umtrx_impl::read_tx_async_stat, this, "handler"));
+            _tree->create<sensor_value_t>(mb_path / "sensors" / "tx_async_handler_time_max")
+                .publish(boost::bind(&umtrx_impl::read_tx_async_stat, this, "handler_max"));
+        }
+        else UHD_MSG(warning) << "async_epoll is not supported on this platform, using a thread per channel" << std::endl;
+    }
+
     subdev_spec_t rx_spec("A:0 B:0 A:0 B:0");
     rx_spec.resize(_rx_dsps.size());
     _tree->access<subdev_spec_t>(mb_path / "rx_subdev_spec").set(rx_spec);
@@ -794,9 +865,33 @@ umtrx_impl::~umtrx_impl(void)
             ctrl->set_tx_enabled(false);
         }
         catch (...){}
+        if (_vcocap_cache_dir.empty()) continue;
+        try
+        {
+            ctrl->save_vcocap_cache(this->vcocap_cache_path(fe_name));
+        }
+        catch (const std::exception &ex)
+        {
+            UHD_MSG(warning) << ex.what() << std::endl;
+        }
     }
 }
 
+std::string umtrx_impl::vcocap_cache_path(const std::string &fe_name)
+{
+    return _vcocap_cache_dir + "/umtrx_vcocap_" + _iface->mb_eeprom["serial"] + "." + fe_name + ".txt";
+}
+
+void umtrx_impl::update_lms_temperature(void)
+{
+    //UmTRX v2.1 has a temp sensor only on A side, it stands for both
+    if (_hw_rev < UMTRX_VER_2_1) return;
+    const double temp_a = this->read_temp_c("A").to_real();
+    const double temp_b = (_hw_rev < UMTRX_VER_2_2)? temp_a : this->read_temp_c("B").to_real();
+    _lms_ctrl["A"]->set_temperature(temp_a);
+    _lms_ctrl["B"]->set_temperature(temp_b);
+}
+
 int umtrx_impl::volt_to_dcdc_r(double v)
 {
     if (v <= _dcdc_val_to_volt[_hw_dcdc_ver][0])
@@ -1002,6 +1097,41 @@ uhd::freq_range_t umtrx_impl::get_rx_freq_range(const std::string &which) const
     }
 }
 
+size_t umtrx_impl::get_tx_async_dropped(const size_t dsp)
+{
+    boost::shared_ptr<async_md_type> queue = _tx_async_queues[dsp].lock();
+    return queue? queue->get_num_dropped() : 0;
+}
+
+void umtrx_impl::publish_stat(const fs_path &path, const umtrx_stat_counter &counter)
+{
+    //the counters live in _rx_stats and _tx_stats as long as the tree
+    _tree->create<size_t>(path)
+        .publish(boost::bind(&umtrx_stat_counter::read, &counter));
+}
+
+size_t umtrx_impl::get_rx_prefetch_stat(const size_t dsp, const std::string &which)
+{
+    umtrx_rx_prefetch::sptr prefetch = _rx_prefetch[dsp].first.lock();
+    if (not prefetch) return 0;
+    const umtrx_rx_prefetch::stats_t stats = prefetch->get_stats(_rx_prefetch[dsp].second);
+    if (which == "capacity") return stats.capacity;
+    if (which == "occupancy") return stats.occupancy;
+    if (which == "high_water") return stats.high_water;
+    if (which == "seq_errors") return stats.num_seq_errors;
+    if (which == "bad_packets") return stats.num_bad_packets;
+    throw uhd::key_error("get_rx_prefetch_stat: unknown stat " + which);
+}
+
+uhd::sensor_value_t umtrx_impl::read_tx_async_stat(const std::string &which)
+{
+    const umtrx_async_loop::stats_t stats = _tx_async_loop->get_stats();
+    if (which == "latency") return uhd::sensor_value_t("TX async latency", stats.avg_latency_us, "us");
+    if (which == "latency_max") return uhd::sensor_value_t("TX async max latency", stats.max_latency_us, "us");
+    if (which == "handler_max") return uhd::sensor_value_t("TX async max handler time", stats.max_handler_us, "us");
+    return uhd::sensor_value_t("TX async handler time", stats.avg_handler_us, "us");
+}
+
 uhd::sensor_value_t umtrx_impl::read_temp_c(const std::string &which)
 {
     boost::recursive_mutex::scoped_lock l(_i2c_mutex);
@@ -22,6 +22,10 @@
 #include "usrp2/fw_common.h"
 #include "umtrx_iface.hpp"
 #include "umtrx_fifo_ctrl.hpp"
+#include "umtrx_async_loop.hpp"
+#include "umtrx_async_queue.hpp"
+#include "umtrx_rx_prefetch.hpp"
+#include "umtrx_stream_stats.hpp"
 #include "lms6002d_ctrl.hpp"
 #include "cores/rx_frontend_core_200.hpp"
 #include "cores/tx_frontend_core_200.hpp"
@@ -89,6 +93,9 @@ static const boost::uint32_t UMTRX_DSP_RX1_SID = 0x21;
 static const boost::uint32_t UMTRX_DSP_RX2_SID = 0x22;
 static const boost::uint32_t UMTRX_DSP_RX3_SID = 0x23;
 
+//FPGA compat minor numbers of the optional features
+static const boost::uint16_t UMTRX_FPGA_MINOR_CTRL_BATCH = 4; //several commands per fifo control packet
+
 //! load and store for umtrx mboard eeprom map
 void load_umtrx_eeprom(uhd::usrp::mboard_eeprom_t &mb_eeprom, uhd::i2c_iface &iface);
 void store_umtrx_eeprom(const uhd::usrp::mboard_eeprom_t &mb_eeprom, uhd::i2c_iface &iface);
@@ -104,7 +111,7 @@ public:
     ~umtrx_impl(void);
 
     //the io interface
-    typedef uhd::transport::bounded_buffer<uhd::async_metadata_t> async_md_type;
+    typedef umtrx_async_queue<uhd::async_metadata_t> async_md_type;
     uhd::rx_streamer::sptr get_rx_stream(const uhd::stream_args_t &args);
     uhd::tx_streamer::sptr get_tx_stream(const uhd::stream_args_t &args);
     bool recv_async_msg(uhd::async_metadata_t &, double);
@@ -160,12 +167,16 @@ private:
 
     //communication interfaces
     std::string _device_ip_addr;
+    uhd::device_addr_t _device_addr;
     umtrx_iface::sptr _iface;
     umtrx_fifo_ctrl::sptr _ctrl;
     umsel2_ctrl::sptr _umsel2;
 
     //controls for perifs
     uhd::dict<std::string, lms6002d_ctrl::sptr> _lms_ctrl;
+    std::string _vcocap_cache_dir; // where the VCOCAP values of the LMS tunings persist, empty for none
+    std::string vcocap_cache_path(const std::string &fe_name);
+    void update_lms_temperature(void);
     uhd::dict<std::string, uhd::power_amp::sptr> _pa;
     uhd::dict<std::string, uhd::gain_range_t> _tx_power_range; // Tx output power range
 
@@ -239,7 +250,17 @@ private:
     //streaming
     std::vector<boost::weak_ptr<uhd::rx_streamer> > _rx_streamers;
     std::vector<boost::weak_ptr<uhd::tx_streamer> > _tx_streamers;
+    std::vector<boost::weak_ptr<async_md_type> > _tx_async_queues;
+    size_t get_tx_async_dropped(const size_t dsp);
+    std::vector<std::pair<boost::weak_ptr<umtrx_rx_prefetch>, size_t> > _rx_prefetch; //prefetcher and its channel
+    size_t get_rx_prefetch_stat(const size_t dsp, const std::string &which);
+    std::vector<umtrx_stream_stats::sptr> _rx_stats, _tx_stats; //per dsp, shared by its streamers
+    void publish_stat(const uhd::fs_path &path, const umtrx_stat_counter &counter);
     boost::mutex _setupMutex;
+
+    //optional event loop for the TX async messages of all channels
+    umtrx_async_loop::sptr _tx_async_loop;
+    uhd::sensor_value_t read_tx_async_stat(const std::string &which);
 };
 
 #endif /* INCLUDED_UMTRX_IMPL_HPP */
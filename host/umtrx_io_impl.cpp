@@ -18,6 +18,9 @@
 
 #include "umtrx_impl.hpp"
 #include "umtrx_regs.hpp"
+#include "umtrx_udp_mmsg.hpp"
+#include "umtrx_fault_xport.hpp"
+#include "umtrx_flow_control.hpp"
 #include "usrp2/fw_common.h"
 #include "cores/validate_subdev_spec.hpp"
 #include "cores/async_packet_handler.hpp"
@@ -28,10 +31,15 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <uhd/utils/thread_priority.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 //A reasonable number of frames for send/recv and async/sync
 static const size_t DEFAULT_NUM_FRAMES = 32;
 
+//The RX prefetch ring holds transport frames, give it a deep default
+static const size_t DEFAULT_PREFETCH_FRAMES = 1024;
+
 using namespace uhd;
 using namespace uhd::usrp;
 using namespace uhd::transport;
@@ -49,6 +57,21 @@ static UHD_INLINE double from_time_dur(const pt::time_duration &time_dur){
     return 1e-6*time_dur.total_microseconds();
 }
 
+//! parse a cpu list such as "2,3" from the stream args, empty for no pinning
+static std::vector<int> get_cpu_list(const uhd::device_addr_t &args, const std::string &key)
+{
+    std::vector<int> cpus;
+    if (not args.has_key(key)) return cpus;
+    std::vector<std::string> tokens;
+    boost::split(tokens, args[key], boost::is_any_of(",:"), boost::token_compress_on);
+    BOOST_FOREACH(const std::string &token, tokens)
+    {
+        if (token.empty()) continue;
+        cpus.push_back(boost::lexical_cast<int>(token));
+    }
+    return cpus;
+}
+
 /***********************************************************************
  * constants
  **********************************************************************/
@@ -172,10 +195,43 @@ uhd::transport::zero_copy_if::sptr umtrx_impl::make_xport(const size_t which, co
     default_params.recv_frame_size = transport::udp_simple::mtu;
     default_params.num_send_frames = DEFAULT_NUM_FRAMES;
     default_params.num_recv_frames = DEFAULT_NUM_FRAMES;
-    udp_zero_copy::buff_params ignored_params;
-    zero_copy_if::sptr xport = udp_zero_copy::make(_device_ip_addr, BOOST_STRINGIZE(USRP2_UDP_SERVER_PORT), default_params, ignored_params, args);
+
+    //streaming transports may use the batched transport: udp_mmsg=1 in the device or stream args
+    zero_copy_if::sptr xport;
+    //the TX transports must be batched when the event loop is enabled, it waits on their sockets
+    const bool is_tx = which == UMTRX_DSP_TX0_FRAMER or which == UMTRX_DSP_TX1_FRAMER;
+    const bool use_mmsg = which != UMTRX_CTRL_FRAMER and (
+        args.cast<bool>("udp_mmsg", _device_addr.cast<bool>("udp_mmsg", false)) or
+        (is_tx and _tx_async_loop));
+    if (use_mmsg and umtrx_udp_mmsg::is_supported())
+    {
+        device_addr_t hints = args;
+        if (not hints.has_key("mmsg_batch") and _device_addr.has_key("mmsg_batch")) hints["mmsg_batch"] = _device_addr["mmsg_batch"];
+        xport = umtrx_udp_mmsg::make(_device_ip_addr, BOOST_STRINGIZE(USRP2_UDP_SERVER_PORT), default_params, hints);
+    }
+    else
+    {
+        if (use_mmsg) UHD_MSG(warning) << "udp_mmsg is not supported on this platform, using udp_zero_copy" << std::endl;
+        udp_zero_copy::buff_params ignored_params;
+        xport = udp_zero_copy::make(_device_ip_addr, BOOST_STRINGIZE(USRP2_UDP_SERVER_PORT), default_params, ignored_params, args);
+    }
     program_stream_dest(xport, which);
     _iface->peek32(0); //peek to ensure the zpu processed the program_stream_dest()
+
+    //optional fault injection for tests, ex: fault_drop=0.001,fault_reorder_rx1=0.01
+    std::string chan;
+    if (which == UMTRX_DSP_TX0_FRAMER) chan = "tx0";
+    if (which == UMTRX_DSP_TX1_FRAMER) chan = "tx1";
+    if (which == UMTRX_DSP_RX0_FRAMER) chan = "rx0";
+    if (which == UMTRX_DSP_RX1_FRAMER) chan = "rx1";
+    if (which == UMTRX_DSP_RX2_FRAMER) chan = "rx2";
+    if (which == UMTRX_DSP_RX3_FRAMER) chan = "rx3";
+    const umtrx_fault_xport::params_t fault = umtrx_fault_xport::get_params(args, _device_addr, chan);
+    if (not chan.empty() and fault.any())
+    {
+        UHD_MSG(warning) << "Injecting faults into the " << chan << " transport" << std::endl;
+        xport = umtrx_fault_xport::make(xport, fault);
+    }
     return xport;
 }
 
@@ -203,6 +259,13 @@ uhd::rx_streamer::sptr umtrx_impl::get_rx_stream(const uhd::stream_args_t &args_
         #endif
     }
 
+    //optional prefetch thread, ex: prefetch=1,prefetch_cpu=2,prefetch_prio=0.8
+    const bool use_prefetch = args.args.cast<bool>("prefetch", false);
+    if (use_prefetch and not args.args.has_key("num_recv_frames"))
+    {
+        args.args["num_recv_frames"] = boost::lexical_cast<std::string>(DEFAULT_PREFETCH_FRAMES);
+    }
+
     //create the transport
     std::vector<zero_copy_if::sptr> xports;
     for (size_t chan_i = 0; chan_i < args.channels.size(); chan_i++)
@@ -228,11 +291,17 @@ uhd::rx_streamer::sptr umtrx_impl::get_rx_stream(const uhd::stream_args_t &args_
     const size_t bpi = convert::get_bytes_per_item(args.otw_format);
     const size_t spp = unsigned(args.args.cast<double>("spp", bpp/bpi));
 
-    //make the new streamer given the samples per packet
-    boost::shared_ptr<sph::recv_packet_streamer> my_streamer = boost::make_shared<sph::recv_packet_streamer>(spp);
+    //the prefetch thread pulls from the transports, the streamer from its rings
+    umtrx_rx_prefetch::sptr prefetch;
+    if (use_prefetch) prefetch = umtrx_rx_prefetch::make(xports,
+        args.args.cast<int>("prefetch_cpu", -1),
+        args.args.cast<float>("prefetch_prio", 0.5));
+
+    //make the new streamer given the samples per packet,
+    //the alignment logic is specialized for the number of channels
+    sph::recv_packet_streamer::sptr my_streamer = sph::recv_packet_streamer::make(args.channels.size(), spp);
 
     //init some streamer stuff
-    my_streamer->resize(args.channels.size());
     my_streamer->set_vrt_unpacker(&vrt::if_hdr_unpack_be);
 
     //set the converter
@@ -243,17 +312,42 @@ uhd::rx_streamer::sptr umtrx_impl::get_rx_stream(const uhd::stream_args_t &args_
     id.num_outputs = 1;
     my_streamer->set_converter(id);
 
+    //optional filling of the samples lost to sequence errors, ex: gap_fill=zeros,gap_fill_max=0.1
+    const std::string gap_fill = args.args.get("gap_fill", "none");
+    if (gap_fill == "zeros") my_streamer->set_gap_fill(sph::recv_packet_streamer::GAP_FILL_ZEROS, args.args.cast<double>("gap_fill_max", 0.1));
+    else if (gap_fill == "flag") my_streamer->set_gap_fill(sph::recv_packet_streamer::GAP_FILL_FLAG, args.args.cast<double>("gap_fill_max", 0.1));
+    else if (gap_fill != "none") throw uhd::value_error("gap_fill must be none, zeros or flag, not " + gap_fill);
+
+    //optional multi-threaded conversion, ex: convert_threads=4,convert_cpus=1,2,3
+    my_streamer->set_converter_threads(
+        args.args.cast<size_t>("convert_threads", 1),
+        get_cpu_list(args.args, "convert_cpus"));
+
+    //the dsp setup of all channels goes out in one control packet
+    {
+        umtrx_fifo_ctrl_batch rx_setup_batch(_ctrl);
+        for (size_t chan_i = 0; chan_i < args.channels.size(); chan_i++)
+        {
+            const size_t dsp = args.channels[chan_i];
+            _rx_dsps[dsp]->set_nsamps_per_packet(spp); //seems to be a good place to set this
+            _rx_dsps[dsp]->setup(args);
+        }
+    }
+
     //bind callbacks for the handler
     for (size_t chan_i = 0; chan_i < args.channels.size(); chan_i++)
     {
         const size_t dsp = args.channels[chan_i];
-        _rx_dsps[dsp]->set_nsamps_per_packet(spp); //seems to be a good place to set this
-        _rx_dsps[dsp]->setup(args);
-        my_streamer->set_xport_chan_get_buff(chan_i, boost::bind(
+        if (prefetch) my_streamer->set_xport_chan_get_buff(chan_i, boost::bind(
+            &umtrx_rx_prefetch::get_recv_buff, prefetch, chan_i, _1
+        ), true /*flush*/);
+        else my_streamer->set_xport_chan_get_buff(chan_i, boost::bind(
             &zero_copy_if::get_recv_buff, xports[chan_i], _1
         ), true /*flush*/);
+        _rx_prefetch[dsp] = std::make_pair(boost::weak_ptr<umtrx_rx_prefetch>(prefetch), chan_i); //store weak pointer for the metrics
         my_streamer->set_issue_stream_cmd(chan_i, boost::bind(
             &rx_dsp_core_200::issue_stream_command, _rx_dsps[dsp], _1));
+        my_streamer->set_xport_chan_stats(chan_i, _rx_stats[dsp]);
         _rx_streamers[dsp] = my_streamer; //store weak pointer
     }
 
@@ -270,77 +364,23 @@ uhd::rx_streamer::sptr umtrx_impl::get_rx_stream(const uhd::stream_args_t &args_
 /***********************************************************************
  * TX flow control
  **********************************************************************/
-class flow_control_monitor{
-public:
-    typedef boost::uint32_t seq_type;
-    typedef boost::shared_ptr<flow_control_monitor> sptr;
-
-    /*!
-     * Make a new flow control monitor.
-     * \param max_seqs_out num seqs before throttling
-     */
-    flow_control_monitor(seq_type max_seqs_out):_max_seqs_out(max_seqs_out){
-        this->clear();
-        _ready_fcn = boost::bind(&flow_control_monitor::ready, this);
-    }
-
-    //! Clear the monitor, Ex: when a streamer is created
-    void clear(void){
-        _last_seq_out = 0;
-        _last_seq_ack = 0;
-    }
-
-    /*!
-     * Gets the current sequence number to go out.
-     * Increments the sequence for the next call
-     * \return the sequence to be sent to the dsp
-     */
-    UHD_INLINE seq_type get_curr_seq_out(void){
-        return _last_seq_out++;
-    }
-
-    /*!
-     * Check the flow control condition.
-     * \param timeout the timeout in seconds
-     * \return false on timeout
-     */
-    UHD_INLINE bool check_fc_condition(double timeout){
-        boost::mutex::scoped_lock lock(_fc_mutex);
-        if (this->ready()) return true;
-        boost::this_thread::disable_interruption di; //disable because the wait can throw
-        return _fc_cond.timed_wait(lock, to_time_dur(timeout), _ready_fcn);
-    }
-
-    /*!
-     * Update the flow control condition.
-     * \param seq the last sequence number to be ACK'd
-     */
-    UHD_INLINE void update_fc_condition(seq_type seq){
-        boost::mutex::scoped_lock lock(_fc_mutex);
-        _last_seq_ack = seq;
-        lock.unlock();
-        _fc_cond.notify_one();
-    }
-
-private:
-    bool ready(void){
-        return seq_type(_last_seq_out -_last_seq_ack) < _max_seqs_out;
-    }
-
-    boost::mutex _fc_mutex;
-    boost::condition_variable _fc_cond;
-    seq_type _last_seq_out, _last_seq_ack;
-    const seq_type _max_seqs_out;
-    boost::function<bool(void)> _ready_fcn;
-};
-
 static managed_send_buffer::sptr get_send_buff(
-    task::sptr /*holds ref*/,
+    boost::shared_ptr<void> /*holds ref to the async task or loop registration*/,
     flow_control_monitor::sptr fc_mon,
     zero_copy_if::sptr xport,
+    boost::function<void(void)> flush,
+    umtrx_stream_stats::sptr stats,
     double timeout
 )
 {
+    //frames queued by the transport count against the window but never get ack'd:
+    //send them out before blocking on flow control
+    if (not fc_mon->check_fc_condition(0.0))
+    {
+        stats->fc_stalls.add(1);
+        if (flush) flush();
+    }
+
     //wait on flow control w/ timeout
     if (not fc_mon->check_fc_condition(timeout)) return managed_send_buffer::sptr();
 
@@ -353,12 +393,78 @@ static managed_send_buffer::sptr get_send_buff(
     return buff;
 }
 
+static void handle_tx_async_msg(
+    const size_t chan,
+    const double tick_rate,
+    flow_control_monitor::sptr fc_mon,
+    managed_recv_buffer::sptr buff,
+    umtrx_stream_stats::sptr stats,
+    boost::shared_ptr<umtrx_impl::async_md_type> async_queue,
+    boost::shared_ptr<umtrx_impl::async_md_type> old_async_queue
+){
+    try{
+        //extract the vrt header packet info
+        vrt::if_packet_info_t if_packet_info;
+        if_packet_info.num_packet_words32 = buff->size()/sizeof(boost::uint32_t);
+        const boost::uint32_t *vrt_hdr = buff->cast<const boost::uint32_t *>();
+        vrt::if_hdr_unpack_be(vrt_hdr, if_packet_info);
+
+        //handle a tx async report message
+        if (if_packet_info.packet_type != vrt::if_packet_info_t::PACKET_TYPE_DATA)
+        {
+            //fill in the async metadata
+            async_metadata_t metadata;
+            load_metadata_from_buff(uhd::ntohx<boost::uint32_t>, metadata, if_packet_info, vrt_hdr, tick_rate, chan);
+
+            //catch the flow control packets and react
+            if (metadata.event_code == 0){
+                boost::uint32_t fc_word32 = (vrt_hdr + if_packet_info.num_header_words32)[1];
+                fc_mon->update_fc_condition(uhd::ntohx(fc_word32));
+                return;
+            }
+            //else UHD_MSG(often) << "metadata.event_code " << metadata.event_code << std::endl;
+
+            //count the errors like the prints below
+            if (metadata.event_code & (async_metadata_t::EVENT_CODE_UNDERFLOW | async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET))
+                stats->underflows.add(1);
+            if (metadata.event_code & (async_metadata_t::EVENT_CODE_SEQ_ERROR | async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST))
+                stats->seq_errors.add(1);
+            if (metadata.event_code & async_metadata_t::EVENT_CODE_TIME_ERROR)
+                stats->late_packets.add(1);
+
+            async_queue->push_with_pop_on_full(metadata);
+            old_async_queue->push_with_pop_on_full(metadata);
+
+            standard_async_msg_prints(metadata);
+        }
+        else{
+            //TODO unknown received packet, may want to print error...
+        }
+    }catch(const std::exception &e){
+        UHD_MSG(error) << "Error in handle_tx_async_msgs: " << e.what() << std::endl;
+    }
+}
+
+static void stop_tx_async_msgs(
+    zero_copy_if::sptr xport,
+    boost::function<void(void)> stop_flow_control
+){
+    stop_flow_control();
+    //flush after fc off, max time of 1s
+    size_t i = 0;
+    while (not xport->get_recv_buff(0.01))
+    {
+        if (i++ > 100) break;
+    }
+}
+
 static void handle_tx_async_msgs(
     const size_t chan,
     const double tick_rate,
     flow_control_monitor::sptr fc_mon,
     zero_copy_if::sptr xport,
     boost::function<void(void)> stop_flow_control,
+    umtrx_stream_stats::sptr stats,
     boost::shared_ptr<umtrx_impl::async_md_type> async_queue,
     boost::shared_ptr<umtrx_impl::async_md_type> old_async_queue
 ){
@@ -368,50 +474,64 @@ static void handle_tx_async_msgs(
     {
         managed_recv_buffer::sptr buff = xport->get_recv_buff();
         if (not buff) continue; //ignore timeout/error buffers
-
-        try{
-            //extract the vrt header packet info
-            vrt::if_packet_info_t if_packet_info;
-            if_packet_info.num_packet_words32 = buff->size()/sizeof(boost::uint32_t);
-            const boost::uint32_t *vrt_hdr = buff->cast<const boost::uint32_t *>();
-            vrt::if_hdr_unpack_be(vrt_hdr, if_packet_info);
-
-            //handle a tx async report message
-            if (if_packet_info.packet_type != vrt::if_packet_info_t::PACKET_TYPE_DATA)
-            {
-                //fill in the async metadata
-                async_metadata_t metadata;
-                load_metadata_from_buff(uhd::ntohx<boost::uint32_t>, metadata, if_packet_info, vrt_hdr, tick_rate, chan);
-
-                //catch the flow control packets and react
-                if (metadata.event_code == 0){
-                    boost::uint32_t fc_word32 = (vrt_hdr + if_packet_info.num_header_words32)[1];
-                    fc_mon->update_fc_condition(uhd::ntohx(fc_word32));
-                    continue;
-                }
-                //else UHD_MSG(often) << "metadata.event_code " << metadata.event_code << std::endl;
-                async_queue->push_with_pop_on_full(metadata);
-                old_async_queue->push_with_pop_on_full(metadata);
-
-                standard_async_msg_prints(metadata);
-            }
-            else{
-                //TODO unknown received packet, may want to print error...
-            }
-        }catch(const std::exception &e){
-            UHD_MSG(error) << "Error in handle_tx_async_msgs: " << e.what() << std::endl;
-        }
+        handle_tx_async_msg(chan, tick_rate, fc_mon, buff, stats, async_queue, old_async_queue);
     }
 
-    stop_flow_control();
-    //flush after fc off, max time of 1s
-    size_t i = 0;
-    while (not xport->get_recv_buff(0.01))
+    stop_tx_async_msgs(xport, stop_flow_control);
+}
+
+/***********************************************************************
+ * TX async messages on the device event loop:
+ * The loop calls the handler when the socket is readable,
+ * the handler drains the transport without blocking.
+ * The registration is held by the streamer like the task above,
+ * and removes the socket from the loop when the streamer goes away.
+ **********************************************************************/
+static void drain_tx_async_msgs(
+    const size_t chan,
+    const double tick_rate,
+    flow_control_monitor::sptr fc_mon,
+    umtrx_udp_mmsg::sptr xport,
+    umtrx_async_loop *loop,
+    umtrx_stream_stats::sptr stats,
+    boost::shared_ptr<umtrx_impl::async_md_type> async_queue,
+    boost::shared_ptr<umtrx_impl::async_md_type> old_async_queue
+){
+    managed_recv_buffer::sptr buff;
+    while ((buff = xport->get_recv_buff(0.0)))
     {
-        if (i++ > 100) break;
+        handle_tx_async_msg(chan, tick_rate, fc_mon, buff, stats, async_queue, old_async_queue);
+        loop->add_latency(xport->get_recv_time_ns()); //from the arrival in the socket to handled
     }
 }
 
+class tx_async_loop_registration : boost::noncopyable
+{
+public:
+    tx_async_loop_registration(
+        umtrx_async_loop::sptr loop,
+        umtrx_udp_mmsg::sptr xport,
+        const umtrx_async_loop::handler_type &handler,
+        boost::function<void(void)> stop_flow_control
+    ):
+        _loop(loop), _xport(xport), _stop_flow_control(stop_flow_control)
+    {
+        _xport->enable_recv_timestamps(); //for the latency of the packets
+        _loop->add_fd(_xport->get_socket_fd(), handler);
+    }
+
+    ~tx_async_loop_registration(void)
+    {
+        _loop->remove_fd(_xport->get_socket_fd());
+        UHD_SAFE_CALL(stop_tx_async_msgs(_xport, _stop_flow_control);)
+    }
+
+private:
+    umtrx_async_loop::sptr _loop;
+    umtrx_udp_mmsg::sptr _xport;
+    boost::function<void(void)> _stop_flow_control;
+};
+
 /***********************************************************************
  * Transmit streamer
  **********************************************************************/
@@ -469,16 +589,28 @@ uhd::tx_streamer::sptr umtrx_impl::get_tx_stream(const uhd::stream_args_t &args_
     id.num_outputs = 1;
     my_streamer->set_converter(id);
 
+    //optional multi-threaded conversion, ex: convert_threads=2,convert_cpus=1
+    my_streamer->set_converter_threads(
+        args.args.cast<size_t>("convert_threads", 1),
+        get_cpu_list(args.args, "convert_cpus"));
+
     //shared async queue for all channels in streamer
     boost::shared_ptr<async_md_type> async_md(new async_md_type(1000/*messages deep*/));
-    if (not _old_async_queue) _old_async_queue.reset(new async_md_type(1000/*messages deep*/));
     my_streamer->set_async_receiver(boost::bind(&async_md_type::pop_with_timed_wait, async_md, _1, _2));
 
+    //the dsp setup of all channels goes out in one control packet
+    {
+        umtrx_fifo_ctrl_batch tx_setup_batch(_ctrl);
+        for (size_t chan_i = 0; chan_i < args.channels.size(); chan_i++)
+        {
+            _tx_dsps[args.channels[chan_i]]->setup(args);
+        }
+    }
+
     //bind callbacks for the handler
     for (size_t chan_i = 0; chan_i < args.channels.size(); chan_i++)
     {
         const size_t dsp = args.channels[chan_i];
-        _tx_dsps[dsp]->setup(args);
 
         //set transmit sid -- needed by packet dispatcher to determine destination
         boost::uint32_t sid = ~0;
@@ -500,17 +632,42 @@ uhd::tx_streamer::sptr umtrx_impl::get_tx_stream(const uhd::stream_args_t &args_
         );
 
         //create async task for flow control and msgs
+        //serviced by the device event loop when enabled (async_epoll=1), else a task per channel
         boost::function<void(void)> stop_flow_control = boost::bind(&tx_dsp_core_200::set_updates, _tx_dsps[dsp], 0, 0);
-        task::sptr task = task::make(boost::bind(
-            &handle_tx_async_msgs, chan_i, this->get_master_clock_rate(),
-            fc_mon, xports[chan_i], stop_flow_control, async_md, _old_async_queue));
+        umtrx_udp_mmsg::sptr mmsg_xport = boost::dynamic_pointer_cast<umtrx_udp_mmsg>(xports[chan_i]);
+        boost::shared_ptr<void> async_handler;
+        if (_tx_async_loop and mmsg_xport)
+        {
+            async_handler.reset(new tx_async_loop_registration(_tx_async_loop, mmsg_xport, boost::bind(
+                &drain_tx_async_msgs, chan_i, this->get_master_clock_rate(),
+                fc_mon, mmsg_xport, _tx_async_loop.get(), _tx_stats[dsp], async_md, _old_async_queue), stop_flow_control));
+        }
+        else
+        {
+            async_handler = task::make(boost::bind(
+                &handle_tx_async_msgs, chan_i, this->get_master_clock_rate(),
+                fc_mon, xports[chan_i], stop_flow_control, _tx_stats[dsp], async_md, _old_async_queue));
+        }
+
+        //batched transport: queue commits and flush at the end of send(), ex: mmsg_send_batch=8
+        //the batching defaults on only when udp_mmsg was asked for, not when async_epoll forced it
+        boost::function<void(void)> flush;
+        if (mmsg_xport)
+        {
+            const bool mmsg_requested = args.args.cast<bool>("udp_mmsg", _device_addr.cast<bool>("udp_mmsg", false));
+            mmsg_xport->set_send_batch(args.args.cast<size_t>("mmsg_send_batch", mmsg_requested? 16 : 1));
+            flush = boost::bind(&umtrx_udp_mmsg::flush, mmsg_xport);
+            my_streamer->set_xport_chan_flush(chan_i, flush);
+        }
 
         //buffer get method handles flow control and hold task reference count
         my_streamer->set_xport_chan_get_buff(chan_i, boost::bind(
-            &get_send_buff, task, fc_mon, xports[chan_i], _1
+            &get_send_buff, async_handler, fc_mon, xports[chan_i], flush, _tx_stats[dsp], _1
         ));
+        my_streamer->set_xport_chan_stats(chan_i, _tx_stats[dsp]);
 
         _tx_streamers[dsp] = my_streamer; //store weak pointer
+        _tx_async_queues[dsp] = async_md; //store weak pointer for the drop counter
     }
 
     //sets all tick and samp rates on this streamer
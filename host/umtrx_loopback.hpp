@@ -0,0 +1,238 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_LOOPBACK_HPP
+#define INCLUDED_UMTRX_LOOPBACK_HPP
+
+#include "umtrx_stream_stats.hpp"
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <complex>
+#include <vector>
+#include <cmath>
+
+/***********************************************************************
+ * TX to RX round trip latency through the LMS6002D RF loopback.
+ *
+ * The RX channel has to be on the CAL antenna of the LMS the TX channel
+ * goes out of, and both streamers run fc32. A short tone burst is sent
+ * and the RX stream is searched for it, the device timestamp of the
+ * first sample above the threshold is when the burst came through.
+ *
+ * Timed bursts give the hardware pipeline: the DUC, the analog loopback
+ * and the DDC, from the scheduled time to the detected time.
+ * Bursts sent now give the round trip as the host sees it, split
+ * with the host to device clock offset into:
+ * - tx_host: from the send() call to the DAC, less the hardware
+ *   pipeline: conversion, the transport and the TX fifo in the FPGA,
+ *   which grows with num_send_frames and the flow control window
+ * - hw: the hardware pipeline of the timed bursts
+ * - rx_fill: the rest of the RX packet the burst starts in, spp/rate
+ *   at most, the cost of the packet size
+ * - rx_host: from the end of that packet to the return of recv():
+ *   the transport, the socket and the recv frames
+ * The total is measured on the host clock alone and does not depend
+ * on the offset, the split is as good as the sync_error.
+ **********************************************************************/
+struct umtrx_loopback_params
+{
+    umtrx_loopback_params(void):
+        num_trials(100), num_timed(10), pulse_len(256), ampl(0.7f),
+        threshold(4.0), lead(0.05), interval(0.02), timeout(1.0){}
+
+    size_t num_trials; //!< bursts sent now
+    size_t num_timed; //!< timed bursts for the hardware pipeline
+    size_t pulse_len; //!< samples in a burst
+    float ampl; //!< burst amplitude
+    double threshold; //!< detection level as a multiple of the peak RX level without a burst
+    double lead; //!< seconds from now to a timed burst
+    double interval; //!< seconds between the bursts
+    double timeout; //!< seconds to wait for a burst to come through
+};
+
+struct umtrx_loopback_result
+{
+    umtrx_loopback_result(void): misses(0), overflows(0), noise_peak(0.0), sync_error(0.0){}
+
+    //per burst seconds, the timed bursts only fill hw
+    std::vector<double> total, tx_host, rx_fill, rx_host;
+    std::vector<double> hw;
+    size_t misses; //!< bursts not seen before the timeout
+    size_t overflows; //!< RX overflows during the run
+    double noise_peak; //!< the peak RX level without a burst
+    double sync_error; //!< the worst half round trip of the host to device time sync
+};
+
+//! The middle element of a copy, 0 when empty
+static inline double umtrx_loopback_median(std::vector<double> v)
+{
+    if (v.empty()) return 0.0;
+    std::nth_element(v.begin(), v.begin() + v.size()/2, v.end());
+    return v[v.size()/2];
+}
+
+/*!
+ * The device time minus the host clock, in seconds.
+ * The read with the shortest round trip of a few wins,
+ * its half round trip is the error bound.
+ */
+static inline double umtrx_loopback_sync(uhd::usrp::multi_usrp::sptr usrp, double &error)
+{
+    double offset = 0.0;
+    error = 1e9;
+    for (size_t i = 0; i < 8; i++)
+    {
+        const boost::uint64_t before = umtrx_stats_now_ns();
+        const uhd::time_spec_t device = usrp->get_time_now();
+        const boost::uint64_t after = umtrx_stats_now_ns();
+        const double half_rtt = (after - before)/2e9;
+        if (half_rtt >= error) continue;
+        error = half_rtt;
+        offset = device.get_real_secs() - (before/1e9 + half_rtt);
+    }
+    return offset;
+}
+
+/*!
+ * Receive until a sample is above the threshold.
+ * \param when set to the device time of that sample
+ * \param packet_end set to the device time of the end of its packet
+ * \param host_ns set to the host time when recv() returned it
+ * \return false when nothing came before the deadline
+ */
+static inline bool umtrx_loopback_detect(
+    uhd::rx_streamer::sptr rx_stream, const double rate, const double threshold,
+    const boost::uint64_t deadline_ns, double &when, double &packet_end, boost::uint64_t &host_ns,
+    umtrx_loopback_result &result
+){
+    std::vector<std::complex<float> > buff(rx_stream->get_max_num_samps());
+    uhd::rx_metadata_t md;
+    while (umtrx_stats_now_ns() < deadline_ns)
+    {
+        const size_t n = rx_stream->recv(&buff.front(), buff.size(), md, 0.1, true/*one packet*/);
+        host_ns = umtrx_stats_now_ns();
+        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) result.overflows++;
+        if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE) continue;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (std::abs(buff[i]) < threshold) continue;
+            when = md.time_spec.get_real_secs() + i/rate;
+            packet_end = md.time_spec.get_real_secs() + n/rate;
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Keep receiving for a while so the RX stream does not overflow, returns the peak level
+static inline double umtrx_loopback_idle(uhd::rx_streamer::sptr rx_stream, const double secs, umtrx_loopback_result &result)
+{
+    std::vector<std::complex<float> > buff(rx_stream->get_max_num_samps());
+    uhd::rx_metadata_t md;
+    double peak = 0.0;
+    const boost::uint64_t end_ns = umtrx_stats_now_ns() + boost::uint64_t(secs*1e9);
+    while (umtrx_stats_now_ns() < end_ns)
+    {
+        const size_t n = rx_stream->recv(&buff.front(), buff.size(), md, 0.1, true/*one packet*/);
+        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) result.overflows++;
+        for (size_t i = 0; i < n; i++) peak = std::max<double>(peak, std::abs(buff[i]));
+    }
+    return peak;
+}
+
+/*!
+ * Measure the round trip latency through the RF loopback.
+ * \param usrp the device, the RX channel already on the CAL antenna
+ * \param rx_stream a single channel fc32 RX streamer
+ * \param tx_stream a single channel fc32 TX streamer
+ * \param rate the sample rate of both
+ * \param params the burst setup
+ * \return the latencies of every burst that came through
+ */
+static inline umtrx_loopback_result umtrx_measure_loopback(
+    uhd::usrp::multi_usrp::sptr usrp,
+    uhd::rx_streamer::sptr rx_stream, uhd::tx_streamer::sptr tx_stream,
+    const double rate, const umtrx_loopback_params &params
+){
+    umtrx_loopback_result result;
+
+    //a tone at an eighth of the rate, a DC burst would meet the DC offset correction
+    std::vector<std::complex<float> > pulse(params.pulse_len);
+    for (size_t i = 0; i < pulse.size(); i++)
+    {
+        pulse[i] = std::polar(params.ampl, float(2*M_PI*i/8));
+    }
+
+    rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+    umtrx_loopback_idle(rx_stream, 0.05, result); //settle
+    result.noise_peak = umtrx_loopback_idle(rx_stream, 0.1, result);
+    const double threshold = std::max(result.noise_peak*params.threshold, 1e-4);
+
+    uhd::tx_metadata_t md;
+    md.start_of_burst = true;
+    md.end_of_burst = true;
+    for (size_t trial = 0; trial < params.num_timed + params.num_trials; trial++)
+    {
+        const bool timed = trial < params.num_timed;
+        double error = 0.0;
+        const double offset = umtrx_loopback_sync(usrp, error);
+        result.sync_error = std::max(result.sync_error, error);
+
+        const boost::uint64_t send_ns = umtrx_stats_now_ns();
+        md.has_time_spec = timed;
+        md.time_spec = uhd::time_spec_t(send_ns/1e9 + offset + params.lead);
+        if (tx_stream->send(&pulse.front(), pulse.size(), md, params.timeout) != pulse.size())
+        {
+            throw std::runtime_error("umtrx_measure_loopback: send timeout");
+        }
+
+        double when = 0.0, packet_end = 0.0;
+        boost::uint64_t recv_ns = 0;
+        const boost::uint64_t deadline_ns = umtrx_stats_now_ns() + boost::uint64_t((params.timeout + (timed? params.lead : 0.0))*1e9);
+        if (not umtrx_loopback_detect(rx_stream, rate, threshold, deadline_ns, when, packet_end, recv_ns, result))
+        {
+            result.misses++;
+            continue;
+        }
+
+        if (timed) result.hw.push_back(when - md.time_spec.get_real_secs());
+        else
+        {
+            const double hw = umtrx_loopback_median(result.hw);
+            result.total.push_back((recv_ns - send_ns)/1e9);
+            result.tx_host.push_back(when - (send_ns/1e9 + offset) - hw);
+            result.rx_fill.push_back(packet_end - when);
+            result.rx_host.push_back((recv_ns/1e9 + offset) - packet_end);
+        }
+
+        //let the rest of the burst go by
+        umtrx_loopback_idle(rx_stream, params.interval + pulse.size()/rate, result);
+    }
+
+    rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+    umtrx_loopback_idle(rx_stream, 0.05, result); //drain
+
+    //the burst acks, so the async queue starts clean for the next user
+    uhd::async_metadata_t async_md;
+    while (tx_stream->recv_async_msg(async_md, 0.01)){}
+
+    return result;
+}
+
+#endif /* INCLUDED_UMTRX_LOOPBACK_HPP */
@@ -49,7 +49,7 @@ namespace asio = boost::asio;
  * print json.loads(f.readline())
  * {u'result': u'true'}
  *
- * #get the value of a tree entry, types can be BOOL, INT, DOUBLE, COMPLEX, SENSOR, RANGE
+ * #get the value of a tree entry, types can be BOOL, INT, SIZE_T, DOUBLE, COMPLEX, SENSOR, RANGE
  * s.send(json.dumps(dict(action='GET', path='/mboards/0/sensors/tempA', type='SENSOR'))+'\n')
  * print json.loads(f.readline())
  * {u'result': {u'unit': u'C', u'name': u'TempA', u'value': u'61.625000'}}
@@ -101,6 +101,16 @@ static bool wait_read_sockfd(const int sockfd, const size_t timeoutMs)
 
 void umtrx_impl::status_monitor_handler(void)
 {
+    //the temperature band of the LMS VCOCAP caches
+    try
+    {
+        this->update_lms_temperature();
+    }
+    catch (const std::exception &ex)
+    {
+        UHD_MSG(warning) << "status monitor: reading the temperature failed: " << ex.what() << std::endl;
+    }
+
     //TODO read the sensors and react...
     //read_dc_v, etc...
     //UHD_MSG(status) << this->read_temp_c("A").to_pp_string() << std::endl;
@@ -192,10 +202,11 @@ void umtrx_impl::client_query_handle1(const boost::property_tree::ptree &request
     else if (action == "GET")
     {
         const std::string type = request.get("type", "");
-        if (type.empty()) response.put("error", "type field not specified: STRING, BOOL, INT, DOUBLE, COMPLEX, SENSOR, RANGE");
+        if (type.empty()) response.put("error", "type field not specified: STRING, BOOL, INT, SIZE_T, DOUBLE, COMPLEX, SENSOR, RANGE");
         else if (type == "STRING") response.put("result", _tree->access<std::string>(path).get());
         else if (type == "BOOL") response.put("result", _tree->access<bool>(path).get());
         else if (type == "INT") response.put("result", _tree->access<int>(path).get());
+        else if (type == "SIZE_T") response.put("result", _tree->access<size_t>(path).get());
         else if (type == "DOUBLE") response.put("result", _tree->access<double>(path).get());
         else if (type == "COMPLEX")
         {
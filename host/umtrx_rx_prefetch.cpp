@@ -0,0 +1,267 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "umtrx_rx_prefetch.hpp"
+#include "missing/platform.hpp"
+#include <uhd/exception.hpp>
+#include <uhd/utils/msg.hpp>
+#include <uhd/utils/tasks.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/transport/vrt_if_packet.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/format.hpp>
+#include <boost/bind.hpp>
+
+using namespace uhd::transport;
+
+static const double BLOCK_TIMEOUT = 0.01; //so the thread notices interruption
+static const long FULL_SLEEP_US = 100; //poll interval while every ring is full
+
+/***********************************************************************
+ * Single producer single consumer ring:
+ * The producer only writes the tail and the consumer only writes the
+ * head, the buffer slot is handed over by the write of the index.
+ **********************************************************************/
+template <typename elem_type>
+class spsc_ring : boost::noncopyable
+{
+public:
+    spsc_ring(const size_t capacity):
+        _capacity(capacity), _elems(new elem_type[capacity])
+    {
+        _head.write(0);
+        _tail.write(0);
+    }
+
+    size_t capacity(void) const
+    {
+        return _capacity;
+    }
+
+    size_t size(void)
+    {
+        return boost::uint32_t(_tail.read() - _head.read());
+    }
+
+    //! Called by the producer only
+    UHD_INLINE bool push(const elem_type &elem)
+    {
+        const boost::uint32_t tail = _tail.read();
+        if (boost::uint32_t(tail - _head.read()) >= _capacity) return false;
+        _elems[tail % _capacity] = elem;
+        _tail.write(tail+1); //publish to the consumer
+        return true;
+    }
+
+    //! Called by the consumer only
+    UHD_INLINE bool pop(elem_type &elem)
+    {
+        const boost::uint32_t head = _head.read();
+        if (_tail.read() == head) return false;
+        elem_type &slot = _elems[head % _capacity];
+        elem = slot;
+        slot = elem_type(); //drop the ring reference before the slot is handed back
+        _head.write(head+1); //free for the producer
+        return true;
+    }
+
+private:
+    const size_t _capacity;
+    boost::scoped_array<elem_type> _elems;
+    uhd::atomic_uint32_t _head, _tail;
+};
+
+/***********************************************************************
+ * Prefetcher implementation
+ **********************************************************************/
+class umtrx_rx_prefetch_impl : public umtrx_rx_prefetch
+{
+public:
+    umtrx_rx_prefetch_impl(const std::vector<zero_copy_if::sptr> &xports, const int cpu, const float priority):
+        _cpu(cpu), _priority(priority)
+    {
+        for (size_t i = 0; i < xports.size(); i++)
+        {
+            _chans.push_back(boost::shared_ptr<chan_type>(new chan_type(xports[i])));
+        }
+        _task = uhd::task::make(boost::bind(&umtrx_rx_prefetch_impl::loop, this));
+    }
+
+    ~umtrx_rx_prefetch_impl(void)
+    {
+        _task.reset(); //interrupts and joins the thread before the rings go
+    }
+
+    managed_recv_buffer::sptr get_recv_buff(const size_t chan, const double timeout)
+    {
+        chan_type &c = *_chans.at(chan);
+        managed_recv_buffer::sptr buff;
+        if (c.ring.pop(buff)) return buff;
+        if (timeout <= 0.0) return buff;
+
+        //register as a waiter, then re-check after the registration,
+        //same as the async queue: the producer only notifies waiters
+        const boost::system_time deadline = boost::get_system_time() +
+            boost::posix_time::microseconds(long(timeout*1e6));
+        boost::mutex::scoped_lock lock(c.mutex);
+        c.num_waiters.inc();
+        bool ok = c.ring.pop(buff);
+        while (not ok)
+        {
+            const bool notified = c.cond.timed_wait(lock, deadline);
+            ok = c.ring.pop(buff);
+            if (not notified) break;
+        }
+        c.num_waiters.dec();
+        return buff;
+    }
+
+    stats_t get_stats(const size_t chan)
+    {
+        chan_type &c = *_chans.at(chan);
+        stats_t stats;
+        stats.capacity = c.ring.capacity();
+        stats.occupancy = c.ring.size();
+        stats.high_water = c.high_water.read();
+        stats.num_packets = c.num_packets.read();
+        stats.num_bad_packets = c.num_bad_packets.read();
+        stats.num_seq_errors = c.num_seq_errors.read();
+        return stats;
+    }
+
+private:
+    struct chan_type
+    {
+        chan_type(zero_copy_if::sptr xport):
+            xport(xport), ring(xport->get_num_recv_frames()), packet_count(0)
+        {
+            high_water.write(0);
+            num_packets.write(0);
+            num_bad_packets.write(0);
+            num_seq_errors.write(0);
+            num_waiters.write(0);
+        }
+        zero_copy_if::sptr xport;
+        spsc_ring<managed_recv_buffer::sptr> ring;
+        size_t packet_count; //the next expected sequence number
+        uhd::atomic_uint32_t high_water;
+        uhd::atomic_uint32_t num_packets;
+        uhd::atomic_uint32_t num_bad_packets;
+        uhd::atomic_uint32_t num_seq_errors;
+        uhd::atomic_uint32_t num_waiters;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+    };
+
+    void loop(void)
+    {
+        uhd::set_thread_priority_safe(_priority);
+        if (not uhd::set_thread_affinity(_cpu))
+        {
+            UHD_MSG(warning) << boost::format("Failed to pin the RX prefetch thread to cpu %d") % _cpu << std::endl;
+        }
+        while (not boost::this_thread::interruption_requested())
+        {
+            this->run_once();
+        }
+    }
+
+    void run_once(void)
+    {
+        //drain everything that is available on every channel with room
+        bool progress = false;
+        chan_type *first_with_room = NULL;
+        for (size_t i = 0; i < _chans.size(); i++)
+        {
+            chan_type &c = *_chans[i];
+            while (c.ring.size() < c.ring.capacity())
+            {
+                if (first_with_room == NULL) first_with_room = &c;
+                managed_recv_buffer::sptr buff = c.xport->get_recv_buff(0.0);
+                if (not buff) break;
+                this->handle_packet(c, buff);
+                progress = true;
+            }
+        }
+        if (progress) return;
+
+        //nothing arrived: block on a channel with room, or wait for the consumer
+        if (first_with_room == NULL)
+        {
+            boost::this_thread::sleep(boost::posix_time::microseconds(FULL_SLEEP_US));
+            return;
+        }
+        managed_recv_buffer::sptr buff = first_with_room->xport->get_recv_buff(BLOCK_TIMEOUT);
+        if (buff) this->handle_packet(*first_with_room, buff);
+    }
+
+    void handle_packet(chan_type &c, managed_recv_buffer::sptr buff)
+    {
+        //the streamer unpacks the header again, this only weeds out bad packets early
+        vrt::if_packet_info_t ifpi;
+        ifpi.num_packet_words32 = buff->size()/sizeof(boost::uint32_t);
+        try
+        {
+            vrt::if_hdr_unpack_be(buff->cast<const boost::uint32_t *>(), ifpi);
+        }
+        catch (const std::exception &)
+        {
+            c.num_bad_packets.inc();
+            return;
+        }
+
+        //same sequence check as the packet handler, it still reports the drop
+        if (ifpi.packet_type == vrt::if_packet_info_t::PACKET_TYPE_DATA)
+        {
+            const size_t seq_mask = (ifpi.link_type == vrt::if_packet_info_t::LINK_TYPE_NONE)? 0xf : 0xfff;
+            if (c.packet_count != ifpi.packet_count) c.num_seq_errors.inc();
+            c.packet_count = (ifpi.packet_count + 1) & seq_mask;
+        }
+
+        c.ring.push(buff); //only called with room in the ring
+        c.num_packets.inc();
+        const size_t occupancy = c.ring.size();
+        if (occupancy > c.high_water.read()) c.high_water.write(boost::uint32_t(occupancy));
+
+        //cas as a fenced read: the waiter count must be loaded after the buffer is published
+        if (c.num_waiters.cas(0, 0) != 0)
+        {
+            boost::mutex::scoped_lock lock(c.mutex);
+            lock.unlock();
+            c.cond.notify_one();
+        }
+    }
+
+    const int _cpu;
+    const float _priority;
+    std::vector<boost::shared_ptr<chan_type> > _chans;
+    uhd::task::sptr _task;
+};
+
+/***********************************************************************
+ * Factory
+ **********************************************************************/
+umtrx_rx_prefetch::sptr umtrx_rx_prefetch::make(const std::vector<zero_copy_if::sptr> &xports, const int cpu, const float priority)
+{
+    return sptr(new umtrx_rx_prefetch_impl(xports, cpu, priority));
+}
@@ -0,0 +1,77 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_RX_PREFETCH_HPP
+#define INCLUDED_UMTRX_RX_PREFETCH_HPP
+
+#include <uhd/transport/zero_copy.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <vector>
+
+/*!
+ * The umtrx RX prefetcher:
+ * One thread per RX streamer which pulls the packets of every channel
+ * out of the transports as soon as they arrive, checks the VRT header
+ * and the sequence number, and queues the buffers in a single producer
+ * single consumer ring per channel. The streamer gets its buffers from
+ * the rings, so an application stall is absorbed by the transport
+ * frames held in the rings instead of the socket buffer.
+ * The ring of a channel holds at most all of its transport frames,
+ * so the depth is set with the num_recv_frames transport hint.
+ */
+class umtrx_rx_prefetch : boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<umtrx_rx_prefetch> sptr;
+
+    //! Ring statistics of one channel
+    struct stats_t
+    {
+        stats_t(void): capacity(0), occupancy(0), high_water(0), num_packets(0), num_bad_packets(0), num_seq_errors(0){}
+        size_t capacity; //!< the ring size in packets
+        size_t occupancy; //!< the packets in the ring right now
+        size_t high_water; //!< the most packets ever in the ring
+        size_t num_packets; //!< the packets queued
+        size_t num_bad_packets; //!< the packets dropped for a bad VRT header
+        size_t num_seq_errors; //!< the data packets with an unexpected sequence number
+    };
+
+    /*!
+     * Make a new prefetcher and start its thread.
+     * \param xports the transport of every channel
+     * \param cpu the cpu to pin the thread to, negative for no pinning
+     * \param priority the thread priority, see uhd::set_thread_priority_safe()
+     */
+    static sptr make(const std::vector<uhd::transport::zero_copy_if::sptr> &xports, const int cpu, const float priority);
+
+    virtual ~umtrx_rx_prefetch(void){}
+
+    /*!
+     * Get the next packet of a channel, a drop-in for zero_copy_if::get_recv_buff().
+     * Only one thread may call this per channel.
+     * \param chan the channel index into the transports
+     * \param timeout the timeout in seconds
+     * \return the buffer or null on timeout
+     */
+    virtual uhd::transport::managed_recv_buffer::sptr get_recv_buff(const size_t chan, const double timeout) = 0;
+
+    //! Get the ring statistics of a channel
+    virtual stats_t get_stats(const size_t chan) = 0;
+};
+
+#endif /* INCLUDED_UMTRX_RX_PREFETCH_HPP */
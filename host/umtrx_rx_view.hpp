@@ -0,0 +1,107 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_RX_VIEW_HPP
+#define INCLUDED_UMTRX_RX_VIEW_HPP
+
+#include "umtrx_config.hpp"
+#include <uhd/types/metadata.hpp>
+#include <uhd/transport/zero_copy.hpp>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+/*!
+ * A view into the transport buffers of one aligned packet per channel.
+ * The payload is the raw wire format, big endian sc16_item32_be for
+ * the umtrx, it is not converted or copied. The view holds the
+ * transport buffers until release() or until it is filled again,
+ * the transport has a limited number of frames so do not hold on long.
+ */
+class UMTRX_API umtrx_rx_view
+{
+public:
+    umtrx_rx_view(void): _nsamps(0){}
+
+    //! The number of channels in the view
+    size_t get_num_channels(void) const
+    {
+        return _payloads.size();
+    }
+
+    //! The number of samples per channel
+    size_t get_nsamps(void) const
+    {
+        return _nsamps;
+    }
+
+    //! The payload of a channel, get_nsamps() wire items long
+    const boost::uint32_t *get_payload(const size_t chan) const
+    {
+        return _payloads.at(chan);
+    }
+
+    //! Give the transport buffers back
+    void release(void)
+    {
+        _buffs.clear();
+        _payloads.clear();
+        _nsamps = 0;
+    }
+
+    //! Called by the streamer to fill the view
+    void hold(const uhd::transport::managed_recv_buffer::sptr &buff, const void *payload, const size_t nsamps)
+    {
+        _buffs.push_back(buff);
+        _payloads.push_back(reinterpret_cast<const boost::uint32_t *>(payload));
+        _nsamps = nsamps;
+    }
+
+private:
+    std::vector<uhd::transport::managed_recv_buffer::sptr> _buffs;
+    std::vector<const boost::uint32_t *> _payloads;
+    size_t _nsamps;
+};
+
+/*!
+ * The umtrx RX streamer extension for the zero copy receive.
+ * Get it with a dynamic_cast of the uhd::rx_streamer:
+ *
+ *   umtrx_rx_view_streamer *ext = dynamic_cast<umtrx_rx_view_streamer *>(rx_stream.get());
+ *
+ * recv_view() and recv() share the alignment and fragment state,
+ * after a partial recv() the view returns the rest of the packet.
+ * There are no zeros to view for a gap, with gap_fill=zeros or flag
+ * a gap is reported like an unfilled one: 0 samples, an overflow with
+ * out_of_sequence set and the time spec of the first lost sample.
+ */
+class UMTRX_API umtrx_rx_view_streamer
+{
+public:
+    virtual ~umtrx_rx_view_streamer(void){}
+
+    /*!
+     * Receive one aligned packet per channel without conversion.
+     * The metadata has the same meaning as for recv() with one_packet.
+     * \param view filled with the payloads, the previous ones are released
+     * \param metadata the metadata of the packet
+     * \param timeout the timeout in seconds
+     * \return the number of samples per channel, 0 on error
+     */
+    virtual size_t recv_view(umtrx_rx_view &view, uhd::rx_metadata_t &metadata, const double timeout = 0.1) = 0;
+};
+
+#endif /* INCLUDED_UMTRX_RX_VIEW_HPP */
@@ -0,0 +1,117 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_SPIN_BARRIER_HPP
+#define INCLUDED_UMTRX_SPIN_BARRIER_HPP
+
+#include <uhd/config.hpp>
+#include <uhd/exception.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+/*!
+ * A reusable barrier for the converter threads which never blocks in
+ * the kernel while the stream is running. The uhd reusable_barrier
+ * takes a mutex and a condition variable on every wait.
+ *
+ * The waiters spin on the phase word, then yield, and only after a
+ * long idle time, ex: the stream stopped, they sleep between checks,
+ * so that parked workers do not hold a cpu forever.
+ *
+ * A worker that dies calls fail(), so that the others do not wait
+ * for it forever: every wait throws its error from then on.
+ */
+class umtrx_spin_barrier : boost::noncopyable
+{
+public:
+    umtrx_spin_barrier(const size_t size): _size(boost::uint32_t(size))
+    {
+        _count.write(0);
+        _phase.write(0);
+        _done.write(0);
+        _failed.write(0);
+    }
+
+    //! Make every waiter throw boost::thread_interrupted
+    void interrupt(void)
+    {
+        _done.write(1);
+    }
+
+    /*!
+     * Make every waiter throw a uhd::runtime_error with this message,
+     * now and in every later wait. The first error is the one kept.
+     */
+    void fail(const std::string &error)
+    {
+        if (_failed.cas(2, 0) != 0) return;
+        _error = error;
+        _failed.write(1);
+    }
+
+    //! Wait until all the threads of the barrier are waiting
+    UHD_INLINE void wait(void)
+    {
+        if (_size == 1) return;
+        this->throw_on_failure();
+        const boost::uint32_t phase = _phase.read();
+
+        //arrive, the last one resets the count and releases the others
+        boost::uint32_t count;
+        do count = _count.read(); while (_count.cas(count + 1, count) != count);
+        if (count + 1 == _size)
+        {
+            _count.write(0);
+            _phase.write(phase + 1);
+            return;
+        }
+
+        for (size_t spins = 0; _phase.read() == phase; spins++) this->backoff(spins);
+    }
+
+    //! Wait until the other threads are waiting, without arriving
+    UHD_INLINE void wait_others(void)
+    {
+        for (size_t spins = 0; _count.read() != _size - 1; spins++) this->backoff(spins);
+    }
+
+private:
+    UHD_INLINE void throw_on_failure(void)
+    {
+        //2 while the error is being stored
+        if (_failed.read() == 1) throw uhd::runtime_error(_error);
+    }
+
+    UHD_INLINE void backoff(const size_t spins)
+    {
+        if (_done.read() != 0) throw boost::thread_interrupted();
+        this->throw_on_failure();
+        if (spins < 4096) return;
+        boost::this_thread::interruption_point();
+        if (spins < 65536) boost::this_thread::yield();
+        else boost::this_thread::sleep(boost::posix_time::microseconds(50));
+    }
+
+    const boost::uint32_t _size;
+    uhd::atomic_uint32_t _count, _phase, _done, _failed;
+    std::string _error; //written once, before _failed is 1
+};
+
+#endif /* INCLUDED_UMTRX_SPIN_BARRIER_HPP */
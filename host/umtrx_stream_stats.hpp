@@ -0,0 +1,113 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_STREAM_STATS_HPP
+#define INCLUDED_UMTRX_STREAM_STATS_HPP
+
+#include <uhd/config.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstddef>
+
+#ifndef __GNUC__
+#include <boost/thread/mutex.hpp>
+#endif
+
+#ifdef UHD_PLATFORM_LINUX
+#include <time.h>
+#endif
+
+/*!
+ * A statistics counter for any writing and reading threads.
+ * The counters of a dsp are shared by its streamers and written from
+ * the streaming, converter and async threads, so the add is atomic.
+ * It is a word sized counter, the atomic add never takes a lock with gcc.
+ */
+class umtrx_stat_counter
+{
+public:
+    umtrx_stat_counter(void): _value(0){}
+
+    UHD_INLINE void add(const size_t n)
+    {
+#ifdef __GNUC__
+        __sync_fetch_and_add(&_value, n);
+#else
+        boost::mutex::scoped_lock lock(_mutex);
+        _value += n;
+#endif
+    }
+
+    size_t read(void) const
+    {
+#ifdef __GNUC__
+        return __sync_fetch_and_add(const_cast<size_t *>(&_value), 0);
+#else
+        boost::mutex::scoped_lock lock(_mutex);
+        return _value;
+#endif
+    }
+
+private:
+    size_t _value;
+#ifndef __GNUC__
+    mutable boost::mutex _mutex;
+#endif
+};
+
+//! Time one conversion in this many, convert_ns adds the estimate for all of them
+static const size_t UMTRX_STATS_CONVERT_PERIOD = 64;
+
+/*!
+ * The streaming counters of one dsp channel.
+ * They live as long as the device, so they add up over the streamers.
+ * RX: packets, bytes, overflows, seq_errors, align_retries, gaps, gap_samps, convert_ns.
+ * TX: packets, bytes, underflows, seq_errors, late_packets, fc_stalls, convert_ns.
+ */
+struct umtrx_stream_stats : boost::noncopyable
+{
+    typedef boost::shared_ptr<umtrx_stream_stats> sptr;
+
+    umtrx_stat_counter packets; //!< packets received or sent
+    umtrx_stat_counter bytes; //!< bytes of those packets
+    umtrx_stat_counter overflows; //!< RX overflow reports
+    umtrx_stat_counter underflows; //!< TX underflow reports
+    umtrx_stat_counter seq_errors; //!< RX sequence gaps or TX sequence error reports
+    umtrx_stat_counter late_packets; //!< TX time error reports
+    umtrx_stat_counter align_retries; //!< RX packets thrown out to time-align the channels
+    umtrx_stat_counter fc_stalls; //!< TX sends which had to wait on flow control
+    umtrx_stat_counter gaps; //!< RX sequence gaps filled to the end with gap_fill
+    umtrx_stat_counter gap_samps; //!< RX samples per channel inserted into the gaps
+    umtrx_stat_counter convert_ns; //!< time spent in the sample conversion, sampled
+};
+
+//! A monotonic clock in nanoseconds for the time counters
+static UHD_INLINE boost::uint64_t umtrx_stats_now_ns(void)
+{
+#ifdef UHD_PLATFORM_LINUX
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return boost::uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+#else
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return boost::uint64_t((boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds())*1000;
+#endif
+}
+
+#endif /* INCLUDED_UMTRX_STREAM_STATS_HPP */
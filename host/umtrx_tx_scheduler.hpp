@@ -0,0 +1,417 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_TX_SCHEDULER_HPP
+#define INCLUDED_UMTRX_TX_SCHEDULER_HPP
+
+#include "umtrx_async_queue.hpp"
+#include "umtrx_stream_stats.hpp"
+#include <uhd/stream.hpp>
+#include <uhd/convert.hpp>
+#include <uhd/exception.hpp>
+#include <uhd/utils/msg.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+ * Timed TX burst scheduler for TDMA transmission.
+ *
+ * Any number of threads submit bursts tagged with their air time, in
+ * any order. The scheduler keeps them in time order and a thread of
+ * its own sends them on the TX streamer as their time comes:
+ *
+ *   umtrx_tx_scheduler sched(tx_stream, "fc32", rate,
+ *       boost::bind(&uhd::usrp::multi_usrp::get_time_now, usrp, 0));
+ *   sched.submit(buffs, nsamps, time);
+ *
+ * A burst is committed lead seconds before its air time. When it
+ * starts within max_gap of the end of the previous one, the gap is
+ * filled with zeros and the stream continues without an end of burst,
+ * so the back to back timeslots of a TDMA frame go out as one burst.
+ * Longer gaps end the burst and the next one starts at its time.
+ * A burst that is already late, or starts before the end of the
+ * previous one, is dropped.
+ *
+ * Every burst gets a report with how far ahead of its air time the
+ * last sample was committed. The device time is read with the time
+ * function once in resync_secs and followed with the host clock.
+ * The scheduler owns the send() side of the streamer while it runs,
+ * the async messages are still for the application to take.
+ * When a send() fails the thread stops and every later submit()
+ * throws that error, the queued bursts are not sent.
+ */
+class umtrx_tx_scheduler : boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<umtrx_tx_scheduler> sptr;
+    typedef boost::function<uhd::time_spec_t(void)> time_fcn_type;
+
+    struct params_t
+    {
+        params_t(void): lead(0.02), max_gap(0.01), max_bursts(64), resync_secs(1.0), timeout(1.0){}
+        double lead; //!< seconds before the air time to commit a burst
+        double max_gap; //!< longest gap in seconds filled with zeros
+        size_t max_bursts; //!< queued bursts before submit() waits
+        double resync_secs; //!< seconds between reads of the device time
+        double timeout; //!< send() timeout, a flow control stall this long is an error
+    };
+
+    //! What happened to a burst
+    struct report_t
+    {
+        report_t(void): nsamps(0), lead(0.0), sent(false){}
+        uhd::time_spec_t time; //!< the air time of the burst
+        size_t nsamps; //!< samples per channel
+        double lead; //!< seconds from the commit of the last sample to its air time, < 0 when late
+        bool sent; //!< false when it was dropped as late or overlapping
+    };
+
+    struct stats_t
+    {
+        stats_t(void): bursts(0), dropped(0), gaps_filled(0), fill_samps(0), eobs(0), min_lead(1e9){}
+        size_t bursts; //!< bursts sent
+        size_t dropped; //!< bursts dropped as late or overlapping
+        size_t gaps_filled; //!< bursts sent as a continuation of the previous one
+        size_t fill_samps; //!< zero samples sent in the gaps
+        size_t eobs; //!< bursts of the streamer, ends of burst sent
+        double min_lead; //!< the smallest lead of a sent burst
+    };
+
+    /*!
+     * Make a scheduler and start its thread.
+     * \param tx_stream the streamer to send on
+     * \param cpu_format the host format of the submitted samples, ex: fc32
+     * \param rate the sample rate of the streamer
+     * \param time_fcn a function which reads the device time
+     * \param params the scheduling parameters
+     */
+    umtrx_tx_scheduler(
+        uhd::tx_streamer::sptr tx_stream, const std::string &cpu_format,
+        const double rate, const time_fcn_type &time_fcn,
+        const params_t &params = params_t()
+    ):
+        _stream(tx_stream), _item_size(uhd::convert::get_bytes_per_item(cpu_format)),
+        _rate(rate), _time_fcn(time_fcn), _params(params),
+        _zeros(tx_stream->get_max_num_samps()*_item_size, 0),
+        _reports(1024),
+        _stopping(false), _streaming(false), _cursor(0),
+        _synced(false), _sync_ns(0), _offset(0.0)
+    {
+        _thread = boost::thread(boost::bind(&umtrx_tx_scheduler::run, this));
+    }
+
+    //! Stop the thread, a running burst is ended and the queued ones are dropped
+    ~umtrx_tx_scheduler(void)
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _stopping = true;
+        }
+        _cond.notify_all();
+        _space_cond.notify_all();
+        _thread.join();
+    }
+
+    /*!
+     * Queue a burst, the samples are copied.
+     * \param buffs one buffer per channel of the streamer
+     * \param nsamps the samples per channel
+     * \param time the air time of the first sample
+     * \param timeout seconds to wait while the queue is full
+     * \return false when the queue stayed full
+     * \throws uhd::runtime_error when the thread stopped on an error
+     */
+    bool submit(const std::vector<const void *> &buffs, const size_t nsamps, const uhd::time_spec_t &time, const double timeout = 0.1)
+    {
+        UHD_ASSERT_THROW(buffs.size() == _stream->get_num_channels());
+        burst_sptr burst(new burst_type());
+        burst->time = time;
+        burst->nsamps = nsamps;
+        burst->mem.resize(buffs.size());
+        for (size_t i = 0; i < buffs.size(); i++)
+        {
+            burst->mem[i].resize(std::max<size_t>(nsamps*_item_size, 1));
+            std::memcpy(&burst->mem[i].front(), buffs[i], nsamps*_item_size);
+            burst->buffs.push_back(&burst->mem[i].front());
+        }
+
+        boost::mutex::scoped_lock lock(_mutex);
+        const boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(long(timeout*1e6));
+        while (_queue.size() >= _params.max_bursts and not _stopping and _error.empty())
+        {
+            if (not _space_cond.timed_wait(lock, deadline)) return false;
+        }
+        if (not _error.empty()) throw uhd::runtime_error("umtrx_tx_scheduler: " + _error);
+        _queue.insert(std::make_pair(time, burst));
+        lock.unlock();
+        _cond.notify_one();
+        return true;
+    }
+
+    //! Queue a burst of a single channel streamer
+    bool submit(const void *buff, const size_t nsamps, const uhd::time_spec_t &time, const double timeout = 0.1)
+    {
+        return this->submit(std::vector<const void *>(1, buff), nsamps, time, timeout);
+    }
+
+    //! Get the report of a sent or dropped burst, the oldest are dropped past 1024
+    bool get_report(report_t &report, const double timeout = 0.1)
+    {
+        return _reports.pop_with_timed_wait(report, timeout);
+    }
+
+    //! The bursts waiting to be sent
+    size_t get_num_queued(void)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _queue.size();
+    }
+
+    stats_t get_stats(void)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _stats;
+    }
+
+private:
+    struct burst_type
+    {
+        uhd::time_spec_t time;
+        size_t nsamps;
+        std::vector<std::vector<char> > mem;
+        std::vector<const void *> buffs;
+    };
+    typedef boost::shared_ptr<burst_type> burst_sptr;
+    typedef std::multimap<uhd::time_spec_t, burst_sptr> queue_type;
+
+    //! The device time, from the host clock and the offset of the last read
+    uhd::time_spec_t device_now(void)
+    {
+        boost::uint64_t now_ns = umtrx_stats_now_ns();
+        if (not _synced or now_ns - _sync_ns > boost::uint64_t(_params.resync_secs*1e9))
+        {
+            const boost::uint64_t before = umtrx_stats_now_ns();
+            const uhd::time_spec_t device = _time_fcn();
+            now_ns = umtrx_stats_now_ns();
+            _offset = device.get_real_secs() - (before + now_ns)/2e9;
+            _sync_ns = now_ns;
+            _synced = true;
+        }
+        return uhd::time_spec_t(now_ns/1e9 + _offset);
+    }
+
+    uhd::time_spec_t cursor_time(void) const
+    {
+        return uhd::time_spec_t::from_ticks(_cursor, _rate);
+    }
+
+    void run(void)
+    {
+        uhd::set_thread_priority_safe();
+        try
+        {
+            this->schedule();
+        }
+        catch (const std::exception &e)
+        {
+            UHD_MSG(error) << "umtrx_tx_scheduler: " << e.what() << std::endl;
+            this->fail(e.what());
+        }
+        catch (...)
+        {
+            UHD_MSG(error) << "umtrx_tx_scheduler: unknown error" << std::endl;
+            this->fail("unknown error");
+        }
+    }
+
+    //! Keep the error for submit() and wake the ones waiting for space
+    void fail(const std::string &what)
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _error = what.empty()? "unknown error" : what;
+        }
+        _space_cond.notify_all();
+    }
+
+    void schedule(void)
+    {
+        const long long max_gap = (long long)(_params.max_gap*_rate);
+        while (true)
+        {
+            const uhd::time_spec_t now = this->device_now();
+            boost::mutex::scoped_lock lock(_mutex);
+            if (_stopping) break;
+
+            //the next burst and whether it continues the running one
+            const bool have_next = not _queue.empty();
+            const burst_sptr next = have_next? _queue.begin()->second : burst_sptr();
+            const long long start = have_next? next->time.to_ticks(_rate) : 0;
+            bool drop = false;
+            if (have_next and _streaming and start < _cursor) drop = true; //overlaps
+            if (have_next and not _streaming and next->time < now) drop = true; //late
+            if (drop)
+            {
+                _queue.erase(_queue.begin());
+                _stats.dropped++;
+                lock.unlock();
+                _space_cond.notify_one();
+                this->report(next, false, now);
+                continue;
+            }
+            const bool contiguous = have_next and _streaming and start - _cursor <= max_gap;
+
+            //when to act: the continuation or the end of the running burst, or the start of the next
+            uhd::time_spec_t due = _streaming? this->cursor_time() : next? next->time : now;
+            due -= uhd::time_spec_t(_params.lead);
+            if (not _streaming and not have_next)
+            {
+                _cond.timed_wait(lock, boost::posix_time::milliseconds(100));
+                continue;
+            }
+            if (now < due)
+            {
+                const double wait = std::min((due - now).get_real_secs(), 0.1);
+                _cond.timed_wait(lock, boost::posix_time::microseconds(long(wait*1e6)));
+                continue;
+            }
+
+            if (_streaming and not contiguous)
+            {
+                _stats.eobs++;
+                lock.unlock();
+                this->end_burst();
+                continue;
+            }
+
+            _queue.erase(_queue.begin());
+            _stats.bursts++;
+            if (contiguous)
+            {
+                _stats.gaps_filled++;
+                _stats.fill_samps += size_t(start - _cursor);
+            }
+            lock.unlock();
+            _space_cond.notify_one();
+            this->send_burst(next, contiguous? size_t(start - _cursor) : 0, contiguous);
+            _cursor = start + next->nsamps;
+            _streaming = true;
+            this->report(next, true, this->device_now());
+        }
+
+        if (_streaming) this->end_burst();
+    }
+
+    void send_burst(const burst_sptr &burst, size_t fill, const bool contiguous)
+    {
+        uhd::tx_metadata_t md;
+        md.start_of_burst = not contiguous;
+        md.end_of_burst = false;
+        md.has_time_spec = false;
+
+        //zeros in the gap, the same buffer for every channel
+        const std::vector<const void *> zeros(burst->buffs.size(), &_zeros.front());
+        while (fill != 0)
+        {
+            const size_t n = std::min(fill, _zeros.size()/_item_size);
+            fill -= this->send_all(zeros, n, md);
+        }
+
+        if (not contiguous)
+        {
+            md.has_time_spec = true;
+            md.time_spec = burst->time;
+        }
+        this->send_all(burst->buffs, burst->nsamps, md);
+    }
+
+    size_t send_all(std::vector<const void *> buffs, const size_t nsamps, uhd::tx_metadata_t &md)
+    {
+        size_t sent = 0;
+        do
+        {
+            const size_t n = _stream->send(buffs, nsamps - sent, md, _params.timeout);
+            if (n == 0 and nsamps != 0) throw uhd::runtime_error("send timeout, the TX flow control stalled");
+            for (size_t i = 0; i < buffs.size(); i++) buffs[i] = static_cast<const char *>(buffs[i]) + n*_item_size;
+            sent += n;
+            md.start_of_burst = false;
+            md.has_time_spec = false;
+        } while (sent < nsamps);
+        return sent;
+    }
+
+    void end_burst(void)
+    {
+        uhd::tx_metadata_t md;
+        md.end_of_burst = true;
+        const std::vector<const void *> zeros(_stream->get_num_channels(), &_zeros.front());
+        _stream->send(zeros, 0, md, _params.timeout);
+        _streaming = false;
+    }
+
+    void report(const burst_sptr &burst, const bool sent, const uhd::time_spec_t &now)
+    {
+        report_t report;
+        report.time = burst->time;
+        report.nsamps = burst->nsamps;
+        //the last sample goes on the air nsamps - 1 ticks after the first
+        const size_t last = burst->nsamps? burst->nsamps - 1 : 0;
+        report.lead = (burst->time + uhd::time_spec_t::from_ticks(last, _rate) - now).get_real_secs();
+        report.sent = sent;
+        _reports.push_with_pop_on_full(report);
+        if (not sent) return;
+        boost::mutex::scoped_lock lock(_mutex);
+        _stats.min_lead = std::min(_stats.min_lead, report.lead);
+    }
+
+    uhd::tx_streamer::sptr _stream;
+    const size_t _item_size;
+    const double _rate;
+    const time_fcn_type _time_fcn;
+    const params_t _params;
+    std::vector<char> _zeros;
+    umtrx_async_queue<report_t> _reports;
+
+    boost::mutex _mutex;
+    boost::condition_variable _cond, _space_cond;
+    queue_type _queue;
+    stats_t _stats;
+    bool _stopping;
+    std::string _error; //!< why the thread stopped, thrown by submit()
+
+    //scheduler thread state
+    bool _streaming;
+    long long _cursor; //!< the sample index after the last one sent
+    bool _synced;
+    boost::uint64_t _sync_ns;
+    double _offset;
+
+    boost::thread _thread;
+};
+
+#endif /* INCLUDED_UMTRX_TX_SCHEDULER_HPP */
@@ -0,0 +1,67 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_TX_TEMPLATE_HPP
+#define INCLUDED_UMTRX_TX_TEMPLATE_HPP
+
+#include "umtrx_config.hpp"
+#include <uhd/stream.hpp>
+#include <uhd/types/metadata.hpp>
+
+/*!
+ * The umtrx TX streamer extension for repeated waveforms.
+ * Get it with a dynamic_cast of the uhd::tx_streamer:
+ *
+ *   umtrx_tx_template_streamer *ext = dynamic_cast<umtrx_tx_template_streamer *>(tx_stream.get());
+ *
+ * A template is converted to the wire format and split into packet
+ * payloads once, when it is registered. Sending it only packs the
+ * VRT headers and copies the payloads into the transport frames,
+ * there is no sample conversion, ex: dummy bursts, FCCH and SCH,
+ * calibration tones. A new scale factor, ex: after a sample rate
+ * change, makes the next send convert the template again from the
+ * host samples it keeps. The templates belong to the streamer and go
+ * with it. Register and release from the thread that sends,
+ * the conversion is shared with send().
+ */
+class UMTRX_API umtrx_tx_template_streamer
+{
+public:
+    virtual ~umtrx_tx_template_streamer(void){}
+
+    /*!
+     * Convert and split a waveform for sending by handle.
+     * \param buffs one buffer per channel in the host format of the streamer
+     * \param nsamps_per_buff the number of samples per channel
+     * \return the handle of the template
+     */
+    virtual size_t register_template(const uhd::tx_streamer::buffs_type &buffs, const size_t nsamps_per_buff) = 0;
+
+    //! Free a template, its handle may be given to a new one
+    virtual void release_template(const size_t handle) = 0;
+
+    /*!
+     * Send a template, the metadata has the same meaning as for send().
+     * \param handle the handle from register_template()
+     * \param metadata the burst flags and the time of the first sample
+     * \param timeout the timeout in seconds
+     * \return the number of samples sent per channel, less on a timeout
+     */
+    virtual size_t send_template(const size_t handle, const uhd::tx_metadata_t &metadata, const double timeout = 0.1) = 0;
+};
+
+#endif /* INCLUDED_UMTRX_TX_TEMPLATE_HPP */
@@ -0,0 +1,502 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "umtrx_udp_mmsg.hpp"
+#include <uhd/exception.hpp>
+#include <uhd/utils/msg.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <cstring>
+#include <vector>
+
+#ifdef UHD_PLATFORM_LINUX
+#include <sys/socket.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+using namespace uhd;
+using namespace uhd::transport;
+namespace asio = boost::asio;
+
+static const size_t DEFAULT_MMSG_BATCH = 16;
+
+#ifdef UHD_PLATFORM_LINUX
+
+static const size_t RECV_CMSG_SIZE = CMSG_SPACE(sizeof(timespec));
+
+/***********************************************************************
+ * Wait on a frame of the pool to be released by the user
+ **********************************************************************/
+template <typename frame_type>
+static bool wait_for_release(frame_type *frame, const double timeout)
+{
+    if (not frame->claimed()) return true;
+    const boost::system_time exit_time = boost::get_system_time() +
+        boost::posix_time::microseconds(long(timeout*1e6));
+    while (frame->claimed())
+    {
+        if (boost::get_system_time() > exit_time) return false;
+        boost::this_thread::yield();
+    }
+    return true;
+}
+
+/***********************************************************************
+ * Receive frame:
+ * Claimed from the moment recvmmsg() fills it,
+ * until the user releases the managed buffer.
+ **********************************************************************/
+class mmsg_recv_frame : public managed_recv_buffer
+{
+public:
+    mmsg_recv_frame(void *mem):
+        _mem(mem), _len(0)
+    {
+        _claimed.write(0);
+    }
+
+    void release(void)
+    {
+        _claimed.write(0);
+    }
+
+    UHD_INLINE bool claimed(void)
+    {
+        return _claimed.read() != 0;
+    }
+
+    UHD_INLINE void claim(const size_t len)
+    {
+        _len = len;
+        _claimed.write(1);
+    }
+
+    UHD_INLINE sptr get_new(void)
+    {
+        return make(this, _mem, _len);
+    }
+
+private:
+    void *_mem;
+    size_t _len;
+    atomic_uint32_t _claimed;
+};
+
+/***********************************************************************
+ * Send frame:
+ * Claimed from get_send_buff() until the commit sends it out,
+ * or until the queue flush when the send batching is enabled.
+ **********************************************************************/
+class umtrx_udp_mmsg_impl;
+
+class mmsg_send_frame : public managed_send_buffer
+{
+public:
+    mmsg_send_frame(umtrx_udp_mmsg_impl *xport, void *mem, const size_t frame_size):
+        _xport(xport), _mem(mem), _frame_size(frame_size)
+    {
+        _claimed.write(0);
+    }
+
+    void release(void); //commits to the transport
+
+    UHD_INLINE bool claimed(void)
+    {
+        return _claimed.read() != 0;
+    }
+
+    UHD_INLINE void unclaim(void)
+    {
+        _claimed.write(0);
+    }
+
+    UHD_INLINE void *mem(void)
+    {
+        return _mem;
+    }
+
+    UHD_INLINE sptr get_new(void)
+    {
+        _claimed.write(1);
+        return make(this, _mem, _frame_size);
+    }
+
+private:
+    umtrx_udp_mmsg_impl *_xport;
+    void *_mem;
+    const size_t _frame_size;
+    atomic_uint32_t _claimed;
+};
+
+/***********************************************************************
+ * Batched UDP transport implementation
+ **********************************************************************/
+class umtrx_udp_mmsg_impl : public umtrx_udp_mmsg
+{
+public:
+    umtrx_udp_mmsg_impl(
+        const std::string &addr,
+        const std::string &port,
+        const zero_copy_xport_params &default_params,
+        const device_addr_t &hints
+    ):
+        _recv_frame_size(size_t(hints.cast<double>("recv_frame_size", default_params.recv_frame_size))),
+        _num_recv_frames(size_t(hints.cast<double>("num_recv_frames", default_params.num_recv_frames))),
+        _send_frame_size(size_t(hints.cast<double>("send_frame_size", default_params.send_frame_size))),
+        _num_send_frames(size_t(hints.cast<double>("num_send_frames", default_params.num_send_frames))),
+        _batch(std::max<size_t>(1, hints.cast<size_t>("mmsg_batch", DEFAULT_MMSG_BATCH))),
+        _recv_head(0), _recv_tail(0), _num_ready(0), _num_truncated(0), _recv_time_ns(0),
+        _send_head(0), _send_batch(1)
+    {
+        //resolve the address
+        asio::ip::udp::resolver resolver(_io_service);
+        asio::ip::udp::resolver::query query(asio::ip::udp::v4(), addr, port);
+        asio::ip::udp::endpoint receiver_endpoint = *resolver.resolve(query);
+
+        //create, open, and connect the socket
+        _socket.reset(new asio::ip::udp::socket(_io_service));
+        _socket->open(asio::ip::udp::v4());
+        _socket->connect(receiver_endpoint);
+        _sock_fd = _socket->native_handle();
+
+        //resize the kernel buffers when requested
+        const size_t recv_buff_size = size_t(hints.cast<double>("recv_buff_size", 0.0));
+        const size_t send_buff_size = size_t(hints.cast<double>("send_buff_size", 0.0));
+        if (recv_buff_size != 0) this->resize_buff<asio::socket_base::receive_buffer_size>(recv_buff_size, "recv");
+        if (send_buff_size != 0) this->resize_buff<asio::socket_base::send_buffer_size>(send_buff_size, "send");
+
+        //allocate the receive frame pool and the message headers
+        _recv_mem.resize(_num_recv_frames*_recv_frame_size);
+        _recv_iovs.resize(_num_recv_frames);
+        _recv_msgs.resize(_num_recv_frames);
+        for (size_t i = 0; i < _num_recv_frames; i++)
+        {
+            char *mem = &_recv_mem[i*_recv_frame_size];
+            _recv_frames.push_back(boost::shared_ptr<mmsg_recv_frame>(new mmsg_recv_frame(mem)));
+            _recv_iovs[i].iov_base = mem;
+            _recv_iovs[i].iov_len = _recv_frame_size;
+            std::memset(&_recv_msgs[i], 0, sizeof(mmsghdr));
+            _recv_msgs[i].msg_hdr.msg_iov = &_recv_iovs[i];
+            _recv_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        //allocate the send frame pool and the message headers for the queue
+        _send_mem.resize(_num_send_frames*_send_frame_size);
+        _send_iovs.resize(_num_send_frames);
+        _send_msgs.resize(_num_send_frames);
+        for (size_t i = 0; i < _num_send_frames; i++)
+        {
+            char *mem = &_send_mem[i*_send_frame_size];
+            _send_frames.push_back(boost::shared_ptr<mmsg_send_frame>(new mmsg_send_frame(this, mem, _send_frame_size)));
+            std::memset(&_send_msgs[i], 0, sizeof(mmsghdr));
+            _send_msgs[i].msg_hdr.msg_iov = &_send_iovs[i];
+            _send_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        _send_queue.reserve(_num_send_frames);
+
+        UHD_MSG(status) << boost::format("umtrx_udp_mmsg: %u recv frames, batch of %u") % _num_recv_frames % _batch << std::endl;
+    }
+
+    /*******************************************************************
+     * Receive implementation:
+     * Hand out the frames filled by the last batch in order.
+     * When none are left, refill with a single recvmmsg() call.
+     ******************************************************************/
+    managed_recv_buffer::sptr get_recv_buff(double timeout)
+    {
+        while (true)
+        {
+            if (_num_ready == 0 and not this->fill(timeout)) return managed_recv_buffer::sptr();
+            const size_t index = _recv_head;
+            _recv_head = (_recv_head + 1) % _num_recv_frames;
+            _num_ready--;
+            //a truncated datagram was not claimed by fill(), skip it
+            if ((_recv_msgs[index].msg_hdr.msg_flags & MSG_TRUNC) != 0) continue;
+            if (not _recv_cmsgs.empty()) _recv_time_ns = this->read_recv_time(_recv_msgs[index].msg_hdr);
+            return _recv_frames[index]->get_new();
+        }
+    }
+
+    size_t get_num_recv_frames(void) const
+    {
+        return _num_recv_frames;
+    }
+
+    size_t get_recv_frame_size(void) const
+    {
+        return _recv_frame_size;
+    }
+
+    /*******************************************************************
+     * Send implementation:
+     * Without batching the frame is sent when the user commits it.
+     * With batching the committed frames are queued and sent with
+     * one sendmmsg() call upon flush() or when the batch is full.
+     ******************************************************************/
+    managed_send_buffer::sptr get_send_buff(double timeout)
+    {
+        mmsg_send_frame *frame = _send_frames[_send_head].get();
+        if (frame->claimed() and not _send_queue.empty()) this->flush(); //its probably queued
+        if (not wait_for_release(frame, timeout)) return managed_send_buffer::sptr();
+        _send_head = (_send_head + 1) % _num_send_frames;
+        return frame->get_new();
+    }
+
+    size_t get_num_send_frames(void) const
+    {
+        return _num_send_frames;
+    }
+
+    size_t get_send_frame_size(void) const
+    {
+        return _send_frame_size;
+    }
+
+    void set_send_batch(const size_t num_frames)
+    {
+        this->flush();
+        _send_batch = std::max<size_t>(1, std::min(num_frames, _num_send_frames));
+    }
+
+    void flush(void)
+    {
+        size_t num_sent = 0;
+        while (num_sent < _send_queue.size())
+        {
+            const int ret = ::sendmmsg(_sock_fd, &_send_msgs[num_sent], _send_queue.size() - num_sent, 0);
+            if (ret > 0) num_sent += ret;
+            else if (ret == -1 and errno == ENOBUFS) continue; //kernel queue full, try again
+            else
+            {
+                const std::string err = strerror(errno);
+                BOOST_FOREACH(mmsg_send_frame *frame, _send_queue) frame->unclaim();
+                _send_queue.clear();
+                throw uhd::io_error("umtrx_udp_mmsg: sendmmsg failed: " + err);
+            }
+        }
+        BOOST_FOREACH(mmsg_send_frame *frame, _send_queue) frame->unclaim();
+        _send_queue.clear();
+    }
+
+    int get_socket_fd(void) const
+    {
+        return _sock_fd;
+    }
+
+    void enable_recv_timestamps(void)
+    {
+        if (not _recv_cmsgs.empty()) return;
+        const int on = 1;
+        if (::setsockopt(_sock_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0)
+        {
+            UHD_MSG(warning) << "umtrx_udp_mmsg: no receive timestamps: " << strerror(errno) << std::endl;
+            return;
+        }
+        //a control buffer per frame, the length is set again before every recvmmsg()
+        _recv_cmsgs.resize(_num_recv_frames*RECV_CMSG_SIZE);
+        for (size_t i = 0; i < _num_recv_frames; i++)
+        {
+            _recv_msgs[i].msg_hdr.msg_control = &_recv_cmsgs[i*RECV_CMSG_SIZE];
+        }
+    }
+
+    boost::uint64_t get_recv_time_ns(void) const
+    {
+        return _recv_time_ns;
+    }
+
+    //! Called by the frame upon commit
+    UHD_INLINE void commit_frame(mmsg_send_frame *frame)
+    {
+        if (_send_batch == 1)
+        {
+            while (true)
+            {
+                const ssize_t ret = ::send(_sock_fd, frame->mem(), frame->size(), 0);
+                if (ret == ssize_t(frame->size())) break;
+                if (ret == -1 and errno == ENOBUFS) continue; //kernel queue full, try again
+                frame->unclaim();
+                throw uhd::io_error(str(boost::format("umtrx_udp_mmsg: send failed: %s") % strerror(errno)));
+            }
+            frame->unclaim();
+            return;
+        }
+
+        const size_t i = _send_queue.size();
+        _send_iovs[i].iov_base = frame->mem();
+        _send_iovs[i].iov_len = frame->size();
+        _send_queue.push_back(frame);
+        if (_send_queue.size() >= _send_batch) this->flush();
+    }
+
+private:
+
+    UHD_INLINE bool fill(const double timeout)
+    {
+        //the frames at the tail may still be held by the user
+        if (not wait_for_release(_recv_frames[_recv_tail].get(), timeout)) return false;
+
+        //batch over the consecutive free frames, recvmmsg needs a contiguous array
+        const size_t max_frames = std::min(_batch, _num_recv_frames - _recv_tail);
+        size_t num_frames = 1;
+        while (num_frames < max_frames and not _recv_frames[_recv_tail+num_frames]->claimed()) num_frames++;
+
+        //the kernel shrinks the control length to what it wrote
+        for (size_t i = 0; i < num_frames and not _recv_cmsgs.empty(); i++)
+        {
+            _recv_msgs[_recv_tail+i].msg_hdr.msg_controllen = RECV_CMSG_SIZE;
+        }
+
+        //try to receive right away, only poll when the socket was empty
+        int ret = ::recvmmsg(_sock_fd, &_recv_msgs[_recv_tail], num_frames, MSG_DONTWAIT, NULL);
+        if (ret < 0 and (errno == EAGAIN or errno == EWOULDBLOCK))
+        {
+            pollfd pfd;
+            pfd.fd = _sock_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (::poll(&pfd, 1, int(timeout*1e3)) <= 0) return false;
+            ret = ::recvmmsg(_sock_fd, &_recv_msgs[_recv_tail], num_frames, MSG_DONTWAIT, NULL);
+        }
+        if (ret < 0)
+        {
+            //interrupted, or the ICMP report of an earlier send: no data this time
+            if (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR or errno == ECONNREFUSED) return false;
+            throw uhd::io_error(str(boost::format("umtrx_udp_mmsg: recv failed: %s") % strerror(errno)));
+        }
+        if (ret == 0) return false;
+
+        for (int i = 0; i < ret; i++)
+        {
+            const mmsghdr &msg = _recv_msgs[_recv_tail+i];
+            if ((msg.msg_hdr.msg_flags & MSG_TRUNC) == 0)
+            {
+                _recv_frames[_recv_tail+i]->claim(msg.msg_len);
+                continue;
+            }
+            //larger than the frame, the packet is useless so drop it
+            if (_num_truncated++ == 0) UHD_MSG(warning) << boost::format(
+                "umtrx_udp_mmsg: dropped a datagram larger than the recv_frame_size of %u bytes") % _recv_frame_size << std::endl;
+        }
+        _recv_tail = (_recv_tail + ret) % _num_recv_frames;
+        _num_ready = ret;
+        return true;
+    }
+
+    //! The SO_TIMESTAMPNS time of a received message in ns, 0 when there is none
+    static boost::uint64_t read_recv_time(msghdr &hdr)
+    {
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET or cmsg->cmsg_type != SCM_TIMESTAMPNS) continue;
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return boost::uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+        }
+        return 0;
+    }
+
+    template <typename Opt> void resize_buff(const size_t num_bytes, const std::string &which)
+    {
+        try
+        {
+            _socket->set_option(Opt(int(num_bytes)));
+        }
+        catch (const std::exception &ex)
+        {
+            UHD_MSG(warning) << boost::format("umtrx_udp_mmsg: failed to set the %s buffer size: %s") % which % ex.what() << std::endl;
+        }
+        Opt option;
+        _socket->get_option(option);
+        if (size_t(option.value()) < num_bytes)
+        {
+            UHD_MSG(warning) << boost::format(
+                "The %s buffer could not be resized sufficiently.\n"
+                "Target sock buff size: %d bytes.\n"
+                "Actual sock buff size: %d bytes.\n"
+                "See the transport application notes on buffer resizing.\n"
+            ) % which % num_bytes % option.value() << std::endl;
+        }
+    }
+
+    //socket guts
+    asio::io_service _io_service;
+    boost::shared_ptr<asio::ip::udp::socket> _socket;
+    int _sock_fd;
+
+    //parameters
+    const size_t _recv_frame_size, _num_recv_frames;
+    const size_t _send_frame_size, _num_send_frames;
+    const size_t _batch;
+
+    //receive state, frames in [head, tail) are filled and not handed out
+    std::vector<char> _recv_mem;
+    std::vector<iovec> _recv_iovs;
+    std::vector<mmsghdr> _recv_msgs;
+    std::vector<boost::shared_ptr<mmsg_recv_frame> > _recv_frames;
+    size_t _recv_head, _recv_tail, _num_ready;
+    size_t _num_truncated; //!< datagrams dropped for not fitting a frame
+    std::vector<char> _recv_cmsgs; //!< the timestamp control buffers, empty when off
+    boost::uint64_t _recv_time_ns; //!< of the frame last handed out
+
+    //send state, the queue holds committed frames waiting for flush()
+    std::vector<char> _send_mem;
+    std::vector<iovec> _send_iovs;
+    std::vector<mmsghdr> _send_msgs;
+    std::vector<boost::shared_ptr<mmsg_send_frame> > _send_frames;
+    std::vector<mmsg_send_frame *> _send_queue;
+    size_t _send_head;
+    size_t _send_batch;
+};
+
+void mmsg_send_frame::release(void)
+{
+    _xport->commit_frame(this);
+}
+
+#endif /* UHD_PLATFORM_LINUX */
+
+/***********************************************************************
+ * Factory
+ **********************************************************************/
+umtrx_udp_mmsg::sptr umtrx_udp_mmsg::make(
+    const std::string &addr,
+    const std::string &port,
+    const zero_copy_xport_params &default_params,
+    const device_addr_t &hints
+){
+#ifdef UHD_PLATFORM_LINUX
+    return sptr(new umtrx_udp_mmsg_impl(addr, port, default_params, hints));
+#else
+    throw uhd::not_implemented_error("umtrx_udp_mmsg requires recvmmsg() which is only available on Linux");
+#endif
+}
+
+bool umtrx_udp_mmsg::is_supported(void)
+{
+#ifdef UHD_PLATFORM_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
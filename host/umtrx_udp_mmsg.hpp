@@ -0,0 +1,85 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INCLUDED_UMTRX_UDP_MMSG_HPP
+#define INCLUDED_UMTRX_UDP_MMSG_HPP
+
+#include <uhd/transport/zero_copy.hpp>
+#include <uhd/types/device_addr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+/*!
+ * The umtrx batched UDP transport:
+ * A zero copy interface over a connected UDP socket which uses
+ * recvmmsg() to pull a batch of frames into the frame pool per syscall.
+ * The frames are then handed out one at a time by get_recv_buff().
+ * Committed send frames can be batched in the same way with sendmmsg().
+ * This is only available on Linux, see is_supported().
+ */
+class umtrx_udp_mmsg : public uhd::transport::zero_copy_if
+{
+public:
+    typedef boost::shared_ptr<umtrx_udp_mmsg> sptr;
+
+    /*!
+     * Make a new batched UDP transport.
+     * The hints may override recv/send_frame_size, num_recv/send_frames,
+     * recv/send_buff_size (socket buffers) and mmsg_batch (frames per syscall).
+     * \param addr the resolvable address of the device
+     * \param port the destination port on the device
+     * \param default_params frame sizes and counts when not in the hints
+     * \param hints optional overrides for the transport parameters
+     */
+    static sptr make(
+        const std::string &addr,
+        const std::string &port,
+        const uhd::transport::zero_copy_xport_params &default_params,
+        const uhd::device_addr_t &hints
+    );
+
+    //! True when the platform provides recvmmsg()
+    static bool is_supported(void);
+
+    /*!
+     * Queue committed frames and send them in batches with sendmmsg().
+     * The queue is sent when it holds num_frames or on flush().
+     * \param num_frames the batch size, 1 sends upon commit (default)
+     */
+    virtual void set_send_batch(const size_t num_frames) = 0;
+
+    //! Send all committed frames which are still queued
+    virtual void flush(void) = 0;
+
+    //! The socket descriptor, Ex: to wait for readability in an event loop
+    virtual int get_socket_fd(void) const = 0;
+
+    /*!
+     * Ask the kernel for the receive time of every datagram (SO_TIMESTAMPNS),
+     * ex: to measure how long a packet waited in the socket.
+     */
+    virtual void enable_recv_timestamps(void) = 0;
+
+    /*!
+     * The kernel receive time of the frame last returned by get_recv_buff().
+     * eturn nanoseconds of CLOCK_REALTIME, 0 when not known
+     */
+    virtual boost::uint64_t get_recv_time_ns(void) const = 0;
+};
+
+#endif /* INCLUDED_UMTRX_UDP_MMSG_HPP */
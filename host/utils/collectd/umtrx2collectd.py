@@ -20,6 +20,15 @@ umtrx.connect()
 # typically this yields: ['tempA', 'tempB', 'voltagePR1', 'voltagePF1', 'voltagePR2', 'voltagePF2', 'voltagezero', 'voltageVin', 'voltageVinPA', 'voltageDCOUT']
 sensors_list = umtrx.list_path_raw(SENSORS_PATH).get("result", [])
 
+# streaming counters of every dsp, ex: rx_dsps/0/stats/overflows
+DSPS_PATHS = ["/mboards/{id}/rx_dsps".format(id=BOARD_ID), "/mboards/{id}/tx_dsps".format(id=BOARD_ID)]
+stats_list = []
+for dsps_path in DSPS_PATHS:
+    for dsp in umtrx.list_path_raw(dsps_path).get("result", []):
+        stats_path = dsps_path + "/" + dsp + "/stats"
+        for stat in umtrx.list_path_raw(stats_path).get("result", []):
+            stats_list.append((os.path.basename(dsps_path)[:2] + dsp + "_" + stat, stats_path + "/" + stat))
+
 
 def publish():
     now = time.time()
@@ -39,6 +48,10 @@ def publish():
         print "PUTVAL {host}/umtrx-{id}/sensor-{name} interval={interval} {now}:{value}".format(
             host=HOSTNAME, id=BOARD_ID, name=name.lower(), interval=INTERVAL, now=now, value=value)
 
+    for name, path in stats_list:
+        print "PUTVAL {host}/umtrx-{id}/stream-{name} interval={interval} {now}:{value}".format(
+            host=HOSTNAME, id=BOARD_ID, name=name, interval=INTERVAL, now=now, value=umtrx.query_size_t_value(path))
+
 
 s = sched.scheduler(time.time, time.sleep)
 
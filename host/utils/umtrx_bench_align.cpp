@@ -0,0 +1,202 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Offline benchmark of the receive alignment logic.
+ * Compares the packet handler for any channel count against the ones
+ * specialized for 1 to 4 channels. The packets are tiny so that the
+ * time goes into the per packet work and not into the conversion.
+ **********************************************************************/
+
+#include "../cores/super_recv_packet_handler.hpp"
+#include <uhd/transport/udp_simple.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <complex>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace pt = boost::posix_time;
+using namespace uhd::transport;
+
+/***********************************************************************
+ * Fake receive transport:
+ * Hands out a ring of packets with valid sequence and timestamps.
+ * Every skew_period packets one packet is dropped, so that the
+ * handler has to throw out the older packets of the other channels.
+ **********************************************************************/
+class bench_recv_buffer : public managed_recv_buffer
+{
+public:
+    bench_recv_buffer(void):_mem(uhd::transport::udp_simple::mtu/sizeof(boost::uint32_t)){}
+
+    void release(void){}
+
+    sptr get_new(const size_t num_words32)
+    {
+        return make(this, &_mem.front(), num_words32*sizeof(boost::uint32_t));
+    }
+
+    std::vector<boost::uint32_t> _mem;
+};
+
+class bench_recv_xport
+{
+public:
+    bench_recv_xport(const size_t spp, const size_t skew_period):
+        _spp(spp), _skew_period(skew_period), _index(0), _seq(0), _ticks(0)
+    {
+        for (size_t i = 0; i < 16; i++)
+        {
+            _buffs.push_back(boost::shared_ptr<bench_recv_buffer>(new bench_recv_buffer()));
+        }
+    }
+
+    managed_recv_buffer::sptr get_buff(double)
+    {
+        bench_recv_buffer &buff = *_buffs[_index++ % _buffs.size()];
+
+        //skip a timestamp, the sequence stays valid like a dsp side drop
+        if (_skew_period != 0 and (_index % _skew_period) == 0) _ticks += _spp;
+
+        vrt::if_packet_info_t ifpi;
+        ifpi.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
+        ifpi.num_payload_words32 = _spp;
+        ifpi.num_payload_bytes = _spp*sizeof(boost::uint32_t);
+        ifpi.packet_count = _seq++;
+        ifpi.has_sid = true;
+        ifpi.sid = 0;
+        ifpi.has_cid = false;
+        ifpi.has_tsi = false;
+        ifpi.has_tsf = true;
+        ifpi.tsf = _ticks;
+        ifpi.has_tlr = true;
+        _ticks += _spp;
+        vrt::if_hdr_pack_be(&buff._mem.front(), ifpi);
+        return buff.get_new(ifpi.num_packet_words32);
+    }
+
+private:
+    const size_t _spp;
+    const size_t _skew_period;
+    size_t _index;
+    size_t _seq;
+    boost::uint64_t _ticks;
+    std::vector<boost::shared_ptr<bench_recv_buffer> > _buffs;
+};
+
+/***********************************************************************
+ * Run one handler for the duration, return nanoseconds per packet
+ **********************************************************************/
+template <typename handler_type>
+static double bench_align(
+    const size_t num_chans, const size_t spp,
+    const size_t skew_period, const double duration
+){
+    handler_type handler(num_chans);
+    handler.set_vrt_unpacker(&vrt::if_hdr_unpack_be);
+    handler.set_tick_rate(1e6);
+    handler.set_samp_rate(1e6);
+
+    uhd::convert::id_type id;
+    id.input_format = "sc16_item32_be";
+    id.num_inputs = 1;
+    id.output_format = "sc16";
+    id.num_outputs = 1;
+    handler.set_converter(id);
+
+    //only the first channel skips, the others must be realigned to it
+    std::vector<boost::shared_ptr<bench_recv_xport> > xports;
+    for (size_t i = 0; i < num_chans; i++)
+    {
+        xports.push_back(boost::shared_ptr<bench_recv_xport>(new bench_recv_xport(spp, (i == 0)? skew_period : 0)));
+        handler.set_xport_chan_get_buff(i, boost::bind(&bench_recv_xport::get_buff, xports.back(), _1));
+    }
+
+    std::vector<std::vector<std::complex<boost::int16_t> > > mem(num_chans, std::vector<std::complex<boost::int16_t> >(spp));
+    std::vector<void *> buffs;
+    for (size_t i = 0; i < num_chans; i++) buffs.push_back(&mem[i].front());
+
+    uhd::rx_metadata_t md;
+    size_t num_packets = 0;
+    const pt::ptime start = pt::microsec_clock::universal_time();
+    const pt::ptime stop = start + pt::microseconds(long(duration*1e6));
+    pt::ptime now = start;
+    while (now < stop)
+    {
+        //check the clock every so often, its not free either
+        for (size_t n = 0; n < 1000; n++)
+        {
+            handler.recv(buffs, spp, md, 0.1, true);
+            if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
+            {
+                throw std::runtime_error(str(boost::format("bench_align: error code 0x%x") % int(md.error_code)));
+            }
+        }
+        num_packets += 1000*num_chans;
+        now = pt::microsec_clock::universal_time();
+    }
+    return 1e3*(now - start).total_microseconds()/double(num_packets);
+}
+
+template <size_t NUM_CHANS>
+static void bench_chans(const size_t spp, const size_t skew_period, const double duration)
+{
+    const double generic = bench_align<sph::recv_packet_handler_impl<0> >(NUM_CHANS, spp, skew_period, duration);
+    const double fixed = bench_align<sph::recv_packet_handler_impl<NUM_CHANS> >(NUM_CHANS, spp, skew_period, duration);
+    std::cout << boost::format("%-8u %14.1f %14.1f %9.2fx") % NUM_CHANS % generic % fixed % (generic/fixed) << std::endl;
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    double duration;
+    size_t spp;
+    size_t skew_period;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("duration", po::value<double>(&duration)->default_value(1.0), "seconds to run each handler")
+        ("spp", po::value<size_t>(&spp)->default_value(4), "samples per packet, small to keep conversion out")
+        ("skew", po::value<size_t>(&skew_period)->default_value(0), "drop a timestamp on channel 0 every this many packets (0 = never)")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX receive alignment benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    std::cout << boost::format("%-8s %14s %14s %10s") % "chans" % "any (ns/pkt)" % "fixed (ns/pkt)" % "speedup" << std::endl;
+    bench_chans<1>(spp, skew_period, duration);
+    bench_chans<2>(spp, skew_period, duration);
+    bench_chans<3>(spp, skew_period, duration);
+    bench_chans<4>(spp, skew_period, duration);
+
+    return EXIT_SUCCESS;
+}
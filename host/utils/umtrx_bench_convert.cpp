@@ -0,0 +1,306 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Offline benchmark of the streamer conversion paths.
+ * The packet handlers are fed from synthetic in-memory VRT packets,
+ * so no device is needed and only the host side work gets measured.
+ **********************************************************************/
+
+#include "../cores/super_recv_packet_handler.hpp"
+#include "../cores/super_send_packet_handler.hpp"
+#include <uhd/transport/udp_simple.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <complex>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace pt = boost::posix_time;
+using namespace uhd::transport;
+
+/***********************************************************************
+ * Fake receive transport:
+ * Hands out a ring of pre-built packets, the header is re-packed
+ * on every call so that the sequence and timestamps stay valid.
+ **********************************************************************/
+class bench_recv_buffer : public managed_recv_buffer
+{
+public:
+    bench_recv_buffer(void):_mem(uhd::transport::udp_simple::mtu/sizeof(boost::uint32_t)){}
+
+    void release(void){}
+
+    sptr get_new(const size_t num_words32)
+    {
+        return make(this, &_mem.front(), num_words32*sizeof(boost::uint32_t));
+    }
+
+    std::vector<boost::uint32_t> _mem;
+};
+
+class bench_recv_xport
+{
+public:
+    bench_recv_xport(const size_t spp):
+        _spp(spp), _index(0), _seq(0), _ticks(0)
+    {
+        //fill the payloads once with a ramp
+        for (size_t i = 0; i < 16; i++)
+        {
+            _buffs.push_back(boost::shared_ptr<bench_recv_buffer>(new bench_recv_buffer()));
+            std::vector<boost::uint32_t> &mem = _buffs.back()->_mem;
+            for (size_t j = 0; j < mem.size(); j++) mem[j] = uhd::htonx(boost::uint32_t(j*0x00010001));
+        }
+    }
+
+    managed_recv_buffer::sptr get_buff(double)
+    {
+        bench_recv_buffer &buff = *_buffs[_index++ % _buffs.size()];
+
+        vrt::if_packet_info_t ifpi;
+        ifpi.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
+        ifpi.num_payload_words32 = _spp;
+        ifpi.num_payload_bytes = _spp*sizeof(boost::uint32_t);
+        ifpi.packet_count = _seq++;
+        ifpi.has_sid = true;
+        ifpi.sid = 0;
+        ifpi.has_cid = false;
+        ifpi.has_tsi = false;
+        ifpi.has_tsf = true;
+        ifpi.tsf = _ticks;
+        ifpi.has_tlr = true;
+        _ticks += _spp;
+        vrt::if_hdr_pack_be(&buff._mem.front(), ifpi);
+        return buff.get_new(ifpi.num_packet_words32);
+    }
+
+private:
+    const size_t _spp;
+    size_t _index;
+    size_t _seq;
+    boost::uint64_t _ticks;
+    std::vector<boost::shared_ptr<bench_recv_buffer> > _buffs;
+};
+
+/***********************************************************************
+ * Fake send transport:
+ * Hands out the same buffer over and over, the commit is discarded.
+ **********************************************************************/
+class bench_send_buffer : public managed_send_buffer
+{
+public:
+    bench_send_buffer(void):_mem(uhd::transport::udp_simple::mtu/sizeof(boost::uint32_t)){}
+
+    void release(void){}
+
+    sptr get_new(void)
+    {
+        return make(this, &_mem.front(), _mem.size()*sizeof(boost::uint32_t));
+    }
+
+    managed_send_buffer::sptr get_buff(double)
+    {
+        return get_new();
+    }
+
+private:
+    std::vector<boost::uint32_t> _mem;
+};
+
+/***********************************************************************
+ * Receive conversion benchmark
+ **********************************************************************/
+static double bench_recv(
+    const size_t num_chans, const size_t num_threads,
+    const std::vector<int> &cpus, const size_t spp,
+    const std::string &cpu_format, const double duration
+){
+    sph::recv_packet_handler handler(num_chans);
+    handler.set_vrt_unpacker(&vrt::if_hdr_unpack_be);
+    handler.set_tick_rate(1e6);
+    handler.set_samp_rate(1e6);
+
+    uhd::convert::id_type id;
+    id.input_format = "sc16_item32_be";
+    id.num_inputs = 1;
+    id.output_format = cpu_format;
+    id.num_outputs = 1;
+    handler.set_converter(id);
+    handler.set_converter_threads(num_threads, cpus);
+
+    std::vector<boost::shared_ptr<bench_recv_xport> > xports;
+    for (size_t i = 0; i < num_chans; i++)
+    {
+        xports.push_back(boost::shared_ptr<bench_recv_xport>(new bench_recv_xport(spp)));
+        handler.set_xport_chan_get_buff(i, boost::bind(&bench_recv_xport::get_buff, xports.back(), _1));
+    }
+
+    std::vector<std::vector<std::complex<float> > > mem(num_chans, std::vector<std::complex<float> >(spp));
+    std::vector<void *> buffs;
+    for (size_t i = 0; i < num_chans; i++) buffs.push_back(&mem[i].front());
+
+    uhd::rx_metadata_t md;
+    size_t total = 0;
+    const pt::ptime start = pt::microsec_clock::universal_time();
+    const pt::ptime stop = start + pt::microseconds(long(duration*1e6));
+    pt::ptime now = start;
+    while (now < stop)
+    {
+        //check the clock every so often, its not free either
+        for (size_t n = 0; n < 1000; n++)
+        {
+            total += handler.recv(buffs, spp, md, 0.1, true);
+            if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
+            {
+                throw std::runtime_error(str(boost::format("bench_recv: error code 0x%x") % int(md.error_code)));
+            }
+        }
+        now = pt::microsec_clock::universal_time();
+    }
+    return (total*num_chans)/(1e-6*(now - start).total_microseconds());
+}
+
+/***********************************************************************
+ * Transmit packing and conversion benchmark
+ **********************************************************************/
+static double bench_send(
+    const size_t num_chans, const size_t num_threads,
+    const std::vector<int> &cpus, const size_t spp,
+    const std::string &cpu_format, const double duration
+){
+    sph::send_packet_handler handler(num_chans);
+    handler.set_vrt_packer(&vrt::if_hdr_pack_be, 1/*same offset as umtrx*/);
+    handler.set_tick_rate(1e6);
+    handler.set_samp_rate(1e6);
+    handler.set_max_samples_per_packet(spp);
+
+    uhd::convert::id_type id;
+    id.input_format = cpu_format;
+    id.num_inputs = 1;
+    id.output_format = "sc16_item32_be";
+    id.num_outputs = 1;
+    handler.set_converter(id);
+    handler.set_converter_threads(num_threads, cpus);
+
+    std::vector<boost::shared_ptr<bench_send_buffer> > xports;
+    for (size_t i = 0; i < num_chans; i++)
+    {
+        xports.push_back(boost::shared_ptr<bench_send_buffer>(new bench_send_buffer()));
+        handler.set_xport_chan_sid(i, true, i);
+        handler.set_xport_chan_get_buff(i, boost::bind(&bench_send_buffer::get_buff, xports.back(), _1));
+    }
+
+    std::vector<std::vector<std::complex<float> > > mem(num_chans, std::vector<std::complex<float> >(spp));
+    std::vector<const void *> buffs;
+    for (size_t i = 0; i < num_chans; i++) buffs.push_back(&mem[i].front());
+
+    uhd::tx_metadata_t md;
+    md.start_of_burst = false;
+    md.end_of_burst = false;
+    md.has_time_spec = false;
+    size_t total = 0;
+    const pt::ptime start = pt::microsec_clock::universal_time();
+    const pt::ptime stop = start + pt::microseconds(long(duration*1e6));
+    pt::ptime now = start;
+    while (now < stop)
+    {
+        for (size_t n = 0; n < 1000; n++)
+        {
+            total += handler.send(buffs, spp, md, 0.1);
+        }
+        now = pt::microsec_clock::universal_time();
+    }
+    return (total*num_chans)/(1e-6*(now - start).total_microseconds());
+}
+
+/***********************************************************************
+ * Main
+ **********************************************************************/
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    double duration;
+    size_t spp;
+    size_t max_chans;
+    std::string cpus_str;
+    std::string cpu_format;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("duration", po::value<double>(&duration)->default_value(2.0), "seconds to run each configuration")
+        ("spp", po::value<size_t>(&spp)->default_value(363), "samples per packet (363 fits the umtrx mtu)")
+        ("chans", po::value<size_t>(&max_chans)->default_value(4), "benchmark from 1 up to this many channels")
+        ("cpus", po::value<std::string>(&cpus_str)->default_value(""), "comma separated cpus to pin the workers to")
+        ("cpu", po::value<std::string>(&cpu_format)->default_value("fc32"), "host sample format: fc32 or sc16")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX streamer conversion benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    std::vector<int> cpus;
+    std::vector<std::string> tokens;
+    boost::split(tokens, cpus_str, boost::is_any_of(","), boost::token_compress_on);
+    BOOST_FOREACH(const std::string &token, tokens)
+    {
+        if (not token.empty()) cpus.push_back(boost::lexical_cast<int>(token));
+    }
+
+    std::cout << std::endl << "==== RX sc16_item32_be -> " << cpu_format << std::endl;
+    std::cout << boost::format("%-8s %-8s %14s %10s") % "chans" % "threads" % "Msps (total)" % "speedup" << std::endl;
+    for (size_t chans = 1; chans <= max_chans; chans++)
+    {
+        double serial = 0.0;
+        for (size_t threads = 1; threads <= chans; threads++)
+        {
+            const double rate = bench_recv(chans, threads, cpus, spp, cpu_format, duration);
+            if (threads == 1) serial = rate;
+            std::cout << boost::format("%-8u %-8u %14.2f %9.2fx") % chans % threads % (rate/1e6) % (rate/serial) << std::endl;
+        }
+    }
+
+    std::cout << std::endl << "==== TX " << cpu_format << " -> sc16_item32_be" << std::endl;
+    std::cout << boost::format("%-8s %-8s %14s %10s") % "chans" % "threads" % "Msps (total)" % "speedup" << std::endl;
+    for (size_t chans = 1; chans <= max_chans; chans++)
+    {
+        double serial = 0.0;
+        for (size_t threads = 1; threads <= chans; threads++)
+        {
+            const double rate = bench_send(chans, threads, cpus, spp, cpu_format, duration);
+            if (threads == 1) serial = rate;
+            std::cout << boost::format("%-8u %-8u %14.2f %9.2fx") % chans % threads % (rate/1e6) % (rate/serial) << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Microbenchmark of the TX flow control monitor.
+ * Compares the atomic monitor with the former mutex based one:
+ * - the per packet cost while the window is open
+ * - the wakeup latency of a throttled sender when the ack arrives
+ **********************************************************************/
+
+#include "../umtrx_flow_control.hpp"
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace pt = boost::posix_time;
+
+/***********************************************************************
+ * The former monitor: a mutex on every check and every update
+ **********************************************************************/
+class mutex_fc_monitor{
+public:
+    typedef boost::uint32_t seq_type;
+
+    mutex_fc_monitor(seq_type max_seqs_out):
+        _last_seq_out(0), _last_seq_ack(0), _max_seqs_out(max_seqs_out)
+    {
+        _ready_fcn = boost::bind(&mutex_fc_monitor::ready, this);
+    }
+
+    seq_type get_curr_seq_out(void){
+        return _last_seq_out++;
+    }
+
+    bool check_fc_condition(double timeout){
+        boost::mutex::scoped_lock lock(_fc_mutex);
+        if (this->ready()) return true;
+        boost::this_thread::disable_interruption di;
+        return _fc_cond.timed_wait(lock, pt::microseconds(long(timeout*1e6)), _ready_fcn);
+    }
+
+    void update_fc_condition(seq_type seq){
+        boost::mutex::scoped_lock lock(_fc_mutex);
+        _last_seq_ack = seq;
+        lock.unlock();
+        _fc_cond.notify_one();
+    }
+
+private:
+    bool ready(void){
+        return seq_type(_last_seq_out -_last_seq_ack) < _max_seqs_out;
+    }
+
+    boost::mutex _fc_mutex;
+    boost::condition_variable _fc_cond;
+    seq_type _last_seq_out, _last_seq_ack;
+    const seq_type _max_seqs_out;
+    boost::function<bool(void)> _ready_fcn;
+};
+
+static double now_us(void)
+{
+    static const pt::ptime epoch = pt::microsec_clock::universal_time();
+    return double((pt::microsec_clock::universal_time() - epoch).total_microseconds());
+}
+
+/***********************************************************************
+ * Open window: cost of the check plus the sequence increment,
+ * while another thread acks at a high rate to contend the state
+ **********************************************************************/
+template <typename monitor_type>
+static void acker_loop(monitor_type *mon, uhd::atomic_uint32_t *seq, uhd::atomic_uint32_t *running)
+{
+    while (running->read() != 0) mon->update_fc_condition(seq->read());
+}
+
+template <typename monitor_type>
+static double bench_open_window(const size_t num_iters, const bool contended)
+{
+    monitor_type mon(~0u >> 1);
+    uhd::atomic_uint32_t seq, running;
+    running.write(1);
+    boost::thread_group threads;
+    if (contended) threads.create_thread(boost::bind(&acker_loop<monitor_type>, &mon, &seq, &running));
+
+    const double start = now_us();
+    for (size_t i = 0; i < num_iters; i++)
+    {
+        if (not mon.check_fc_condition(0.1)) throw std::runtime_error("unexpected flow control timeout");
+        seq.write(mon.get_curr_seq_out());
+    }
+    const double stop = now_us();
+
+    running.write(0);
+    threads.join_all();
+    return 1e3*(stop - start)/num_iters; //ns per packet
+}
+
+/***********************************************************************
+ * Wakeup latency: a window of one packet, the acker releases the
+ * sender after a short delay and the sender timestamps its wakeup
+ **********************************************************************/
+template <typename monitor_type>
+static void delayed_acker(monitor_type *mon, uhd::atomic_uint32_t *sent, double *ack_time, const size_t num_iters, const long delay_us)
+{
+    for (size_t i = 1; i <= num_iters; i++)
+    {
+        while (sent->read() < i) boost::this_thread::yield();
+        boost::this_thread::sleep(pt::microseconds(delay_us));
+        ack_time[i-1] = now_us();
+        mon->update_fc_condition(i);
+    }
+}
+
+template <typename monitor_type>
+static void bench_wakeup(const size_t num_iters, const long delay_us, double &avg, double &p99)
+{
+    monitor_type mon(1);
+    uhd::atomic_uint32_t sent;
+    std::vector<double> ack_time(num_iters), latency(num_iters);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&delayed_acker<monitor_type>, &mon, &sent, &ack_time.front(), num_iters, delay_us));
+
+    mon.get_curr_seq_out(); //the first packet fills the window
+    for (size_t i = 0; i < num_iters; i++)
+    {
+        sent.inc();
+        if (not mon.check_fc_condition(1.0)) throw std::runtime_error("unexpected flow control timeout");
+        latency[i] = now_us() - ack_time[i];
+        mon.get_curr_seq_out();
+    }
+    threads.join_all();
+
+    avg = 0.0;
+    for (size_t i = 0; i < num_iters; i++) avg += latency[i];
+    avg /= num_iters;
+    std::sort(latency.begin(), latency.end());
+    p99 = latency[size_t(0.99*(num_iters-1))];
+}
+
+/***********************************************************************
+ * Main
+ **********************************************************************/
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    size_t num_iters;
+    size_t num_wakeups;
+    long delay_us;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("iters", po::value<size_t>(&num_iters)->default_value(10000000), "packets for the open window test")
+        ("wakeups", po::value<size_t>(&num_wakeups)->default_value(2000), "acks for the wakeup latency test")
+        ("delay", po::value<long>(&delay_us)->default_value(50), "microseconds before each ack in the wakeup test")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX flow control monitor benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    std::cout << std::endl << "==== Open window, cost per packet" << std::endl;
+    std::cout << boost::format("%-10s %12s %12s") % "monitor" % "idle ns" % "contended ns" << std::endl;
+    std::cout << boost::format("%-10s %12.1f %12.1f") % "mutex"
+        % bench_open_window<mutex_fc_monitor>(num_iters, false)
+        % bench_open_window<mutex_fc_monitor>(num_iters, true) << std::endl;
+    std::cout << boost::format("%-10s %12.1f %12.1f") % "atomic"
+        % bench_open_window<flow_control_monitor>(num_iters, false)
+        % bench_open_window<flow_control_monitor>(num_iters, true) << std::endl;
+
+    std::cout << std::endl << "==== Throttled, ack to wakeup latency" << std::endl;
+    std::cout << boost::format("%-10s %12s %12s") % "monitor" % "avg us" % "p99 us" << std::endl;
+    double avg, p99;
+    bench_wakeup<mutex_fc_monitor>(num_wakeups, delay_us, avg, p99);
+    std::cout << boost::format("%-10s %12.1f %12.1f") % "mutex" % avg % p99 << std::endl;
+    bench_wakeup<flow_control_monitor>(num_wakeups, delay_us, avg, p99);
+    std::cout << boost::format("%-10s %12.1f %12.1f") % "atomic" % avg % p99 << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,252 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Offline measurement of the receive realignment after packet drops.
+ * Fake transports inject drops into one channel at a time, and the
+ * time from the recv() that reports the drop to the next aligned
+ * packet is the recovery time. The packets thrown out on the way
+ * are counted from what the transports handed out.
+ * With --offset the dropping channel also shifts its packet boundaries,
+ * like a dsp restarted after an overflow, which can never be aligned.
+ * The handler then reports an alignment error and the benchmark
+ * restarts the streams at a common time like an application would,
+ * so the recovery time includes the time to give up.
+ **********************************************************************/
+
+#include "../cores/super_recv_packet_handler.hpp"
+#include <uhd/transport/udp_simple.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/program_options.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <complex>
+#include <vector>
+
+namespace po = boost::program_options;
+using namespace uhd::transport;
+
+/***********************************************************************
+ * Fake receive transport with drop injection
+ **********************************************************************/
+class realign_recv_buffer : public managed_recv_buffer
+{
+public:
+    realign_recv_buffer(void):_mem(uhd::transport::udp_simple::mtu/sizeof(boost::uint32_t)){}
+
+    void release(void){}
+
+    sptr get_new(const size_t num_words32)
+    {
+        return make(this, &_mem.front(), num_words32*sizeof(boost::uint32_t));
+    }
+
+    std::vector<boost::uint32_t> _mem;
+};
+
+class realign_recv_xport
+{
+public:
+    realign_recv_xport(const size_t spp, const size_t drop_period, const size_t drop_phase, const size_t drop_len, const size_t offset):
+        _spp(spp), _drop_period(drop_period), _drop_phase(drop_phase), _drop_len(drop_len), _offset(offset),
+        _index(0), _seq(0), _ticks(0), num_packets(0)
+    {
+        for (size_t i = 0; i < 16; i++)
+        {
+            _buffs.push_back(boost::shared_ptr<realign_recv_buffer>(new realign_recv_buffer()));
+        }
+    }
+
+    managed_recv_buffer::sptr get_buff(double)
+    {
+        realign_recv_buffer &buff = *_buffs[_index++ % _buffs.size()];
+
+        //lose drop_len packets on the wire, the sequence and time jump
+        if (_drop_period != 0 and (_index % _drop_period) == _drop_phase)
+        {
+            _seq += _drop_len;
+            _ticks += _drop_len*_spp + _offset;
+        }
+
+        vrt::if_packet_info_t ifpi;
+        ifpi.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
+        ifpi.num_payload_words32 = _spp;
+        ifpi.num_payload_bytes = _spp*sizeof(boost::uint32_t);
+        ifpi.packet_count = _seq++;
+        ifpi.has_sid = true;
+        ifpi.sid = 0;
+        ifpi.has_cid = false;
+        ifpi.has_tsi = false;
+        ifpi.has_tsf = true;
+        ifpi.tsf = _ticks;
+        ifpi.has_tlr = true;
+        _ticks += _spp;
+        vrt::if_hdr_pack_be(&buff._mem.front(), ifpi);
+        num_packets++;
+        return buff.get_new(ifpi.num_packet_words32);
+    }
+
+    boost::uint64_t get_ticks(void) const
+    {
+        return _ticks;
+    }
+
+    //! Continue at the given time, like a timed stream command
+    void restart(const boost::uint64_t ticks)
+    {
+        _ticks = ticks;
+    }
+
+private:
+    const size_t _spp;
+    const size_t _drop_period, _drop_phase, _drop_len;
+    const size_t _offset;
+    size_t _index;
+    size_t _seq;
+    boost::uint64_t _ticks;
+    std::vector<boost::shared_ptr<realign_recv_buffer> > _buffs;
+
+public:
+    size_t num_packets; //handed out to the handler
+};
+
+/***********************************************************************
+ * Run the handler for a number of drops and print the recovery
+ **********************************************************************/
+template <size_t NUM_CHANS>
+static void bench_realign(
+    const size_t spp, const size_t drop_period, const size_t drop_len,
+    const size_t offset, const size_t num_drops
+){
+    sph::recv_packet_handler_impl<NUM_CHANS> handler(NUM_CHANS);
+    handler.set_vrt_unpacker(&vrt::if_hdr_unpack_be);
+    handler.set_tick_rate(1e6);
+    handler.set_samp_rate(1e6);
+    handler.set_alignment_failure_threshold(50e6/(spp*sizeof(boost::uint32_t)));
+
+    uhd::convert::id_type id;
+    id.input_format = "sc16_item32_be";
+    id.num_inputs = 1;
+    id.output_format = "sc16";
+    id.num_outputs = 1;
+    handler.set_converter(id);
+
+    //the channels take turns to drop, one every period
+    std::vector<boost::shared_ptr<realign_recv_xport> > xports;
+    for (size_t i = 0; i < NUM_CHANS; i++)
+    {
+        xports.push_back(boost::shared_ptr<realign_recv_xport>(new realign_recv_xport(
+            spp, drop_period*NUM_CHANS, i*drop_period + drop_period/2, drop_len, offset)));
+        handler.set_xport_chan_get_buff(i, boost::bind(&realign_recv_xport::get_buff, xports.back(), _1));
+    }
+
+    std::vector<std::vector<std::complex<boost::int16_t> > > mem(NUM_CHANS, std::vector<std::complex<boost::int16_t> >(spp));
+    std::vector<void *> buffs;
+    for (size_t i = 0; i < NUM_CHANS; i++) buffs.push_back(&mem[i].front());
+
+    uhd::rx_metadata_t md;
+    size_t drops = 0, alignment_errors = 0;
+    size_t recovering = 0; //packets handed out since the drop was reported
+    boost::uint64_t start_ns = 0, total_ns = 0, max_ns = 0;
+    size_t total_discards = 0, max_discards = 0;
+    while (drops < num_drops)
+    {
+        const boost::uint64_t call_ns = umtrx_stats_now_ns();
+        size_t pulled = 0;
+        for (size_t i = 0; i < NUM_CHANS; i++) pulled -= xports[i]->num_packets;
+        handler.recv(buffs, spp, md, 0.1, true);
+        for (size_t i = 0; i < NUM_CHANS; i++) pulled += xports[i]->num_packets;
+
+        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
+        {
+            throw std::runtime_error("bench_realign: unexpected timeout");
+        }
+        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_ALIGNMENT)
+        {
+            //restart every stream a packet after the newest one
+            boost::uint64_t ticks = 0;
+            for (size_t i = 0; i < NUM_CHANS; i++) ticks = std::max(ticks, xports[i]->get_ticks() + spp);
+            for (size_t i = 0; i < NUM_CHANS; i++) xports[i]->restart(ticks);
+            alignment_errors++;
+        }
+        if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
+        {
+            if (start_ns == 0) start_ns = call_ns;
+            recovering += pulled;
+            continue;
+        }
+        if (start_ns == 0) continue;
+
+        //aligned again: everything pulled but the delivered packets was thrown out
+        const boost::uint64_t ns = umtrx_stats_now_ns() - start_ns;
+        const size_t discards = recovering + pulled - NUM_CHANS;
+        total_ns += ns;
+        max_ns = std::max(max_ns, ns);
+        total_discards += discards;
+        max_discards = std::max(max_discards, discards);
+        drops++;
+        start_ns = 0;
+        recovering = 0;
+    }
+
+    std::cout << boost::format("%-6u %8u %12.1f %12.1f %12.1f %10u %8u")
+        % NUM_CHANS % drops
+        % (total_ns/1e3/drops) % (max_ns/1e3)
+        % (double(total_discards)/drops) % max_discards
+        % alignment_errors << std::endl;
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    size_t spp;
+    size_t drop_period;
+    size_t drop_len;
+    size_t offset;
+    size_t num_drops;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("spp", po::value<size_t>(&spp)->default_value(364), "samples per packet")
+        ("period", po::value<size_t>(&drop_period)->default_value(100), "packets between the drops of consecutive channels")
+        ("len", po::value<size_t>(&drop_len)->default_value(8), "packets lost per drop")
+        ("offset", po::value<size_t>(&offset)->default_value(0), "samples the packet boundaries shift per drop (0 = aligned)")
+        ("drops", po::value<size_t>(&num_drops)->default_value(1000), "number of drops to measure per channel count")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help") or drop_period == 0){
+        std::cout << boost::format("UmTRX receive realignment benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    std::cout << boost::format("%-6s %8s %12s %12s %12s %10s %8s")
+        % "chans" % "drops" % "mean (us)" % "max (us)" % "mean discard" % "max disc" % "align" << std::endl;
+    bench_realign<2>(spp, drop_period, drop_len, offset, num_drops);
+    bench_realign<3>(spp, drop_period, drop_len, offset, num_drops);
+    bench_realign<4>(spp, drop_period, drop_len, offset, num_drops);
+
+    return EXIT_SUCCESS;
+}
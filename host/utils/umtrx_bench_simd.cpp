@@ -0,0 +1,244 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Benchmark of the sc16_item32_be converters.
+ * Runs every UmTRX kernel set supported by this cpu and the converters
+ * registered by UHD at the lower priorities over the same buffers,
+ * and checks each output against the UHD general converter.
+ **********************************************************************/
+
+#include "../umtrx_convert.hpp"
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <uhd/utils/byteswap.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+
+namespace po = boost::program_options;
+namespace pt = boost::posix_time;
+
+struct bench_buffers
+{
+    bench_buffers(const size_t nsamps): item32(nsamps), fc32(nsamps), sc16(nsamps), out(nsamps*sizeof(std::complex<float>))
+    {
+        for (size_t i = 0; i < nsamps; i++)
+        {
+            const boost::int16_t re = boost::int16_t(std::rand()), im = boost::int16_t(std::rand());
+            item32[i] = uhd::htonx(boost::uint32_t((boost::uint16_t(re) << 16) | boost::uint16_t(im)));
+            sc16[i] = std::complex<boost::int16_t>(re, im);
+            fc32[i] = std::complex<float>(float(std::rand())/RAND_MAX*2-1, float(std::rand())/RAND_MAX*2-1);
+        }
+    }
+    std::vector<boost::uint32_t> item32;
+    std::vector<std::complex<float> > fc32;
+    std::vector<std::complex<boost::int16_t> > sc16;
+    std::vector<char> out;
+};
+
+//! Converter around one kernel set, to run kernels other than the registered one
+class kernel_converter : public uhd::convert::converter
+{
+public:
+    kernel_converter(const umtrx_convert_kernels *kernels, const uhd::convert::id_type &id):
+        _kernels(kernels), _id(id), _scalar(1.0f){}
+
+    void set_scalar(const double scalar)
+    {
+        _scalar = float(scalar);
+    }
+
+private:
+    void operator()(const input_type &in, const output_type &out, const size_t nsamps)
+    {
+        if (_id.output_format == "fc32") _kernels->item32_to_fc32(
+            reinterpret_cast<const boost::uint32_t *>(in[0]), reinterpret_cast<std::complex<float> *>(out[0]), nsamps, _scalar);
+        else if (_id.output_format == "sc16") _kernels->item32_to_sc16(
+            reinterpret_cast<const boost::uint32_t *>(in[0]), reinterpret_cast<std::complex<boost::int16_t> *>(out[0]), nsamps);
+        else if (_id.input_format == "fc32") _kernels->fc32_to_item32(
+            reinterpret_cast<const std::complex<float> *>(in[0]), reinterpret_cast<boost::uint32_t *>(out[0]), nsamps, _scalar);
+        else _kernels->sc16_to_item32(
+            reinterpret_cast<const std::complex<boost::int16_t> *>(in[0]), reinterpret_cast<boost::uint32_t *>(out[0]), nsamps);
+    }
+
+    const umtrx_convert_kernels *_kernels;
+    const uhd::convert::id_type _id;
+    float _scalar;
+};
+
+//! The scalar the streamers would set for this conversion
+static double get_scalar(const std::string &input_format, const std::string &output_format)
+{
+    if (output_format == "fc32") return 1.0/32767;
+    if (input_format == "fc32") return 32767;
+    return 1.0;
+}
+
+static uhd::convert::id_type make_id(const std::string &input_format, const std::string &output_format)
+{
+    uhd::convert::id_type id;
+    id.input_format = input_format;
+    id.num_inputs = 1;
+    id.output_format = output_format;
+    id.num_outputs = 1;
+    return id;
+}
+
+static const void *get_input(bench_buffers &buffs, const std::string &input_format)
+{
+    if (input_format == "fc32") return &buffs.fc32.front();
+    if (input_format == "sc16") return &buffs.sc16.front();
+    return &buffs.item32.front();
+}
+
+static size_t get_output_bytes(const std::string &output_format, const size_t nsamps)
+{
+    if (output_format == "fc32") return nsamps*sizeof(std::complex<float>);
+    return nsamps*sizeof(boost::uint32_t); //sc16 and item32 are both 4 bytes
+}
+
+//! Run the converter for the duration, return samples per second
+static double bench_converter(uhd::convert::converter::sptr conv, bench_buffers &buffs, const std::string &input_format, const double duration)
+{
+    const size_t nsamps = buffs.item32.size();
+    const uhd::convert::converter::input_type in(get_input(buffs, input_format));
+    const uhd::convert::converter::output_type out(static_cast<void *>(&buffs.out.front()));
+    size_t total = 0;
+    const pt::ptime start = pt::microsec_clock::universal_time();
+    const pt::ptime stop = start + pt::microseconds(long(duration*1e6));
+    while (pt::microsec_clock::universal_time() < stop)
+    {
+        for (size_t i = 0; i < 100; i++) conv->conv(in, out, nsamps);
+        total += 100*nsamps;
+    }
+    return double(total)/(pt::microsec_clock::universal_time() - start).total_microseconds()*1e6;
+}
+
+//! Convert the input buffer once into the output buffer
+static void run_converter(uhd::convert::converter::sptr conv, bench_buffers &buffs, const std::string &input_format)
+{
+    std::memset(&buffs.out.front(), 0, buffs.out.size());
+    conv->conv(get_input(buffs, input_format), static_cast<void *>(&buffs.out.front()), buffs.item32.size());
+}
+
+//! Max difference of the converter output against the reference output
+static double check_converter(uhd::convert::converter::sptr conv, bench_buffers &buffs,
+    const std::string &input_format, const std::string &output_format, const std::vector<char> &ref)
+{
+    const size_t nsamps = buffs.item32.size();
+    run_converter(conv, buffs, input_format);
+    double max_diff = 0;
+    for (size_t i = 0; i < 2*nsamps; i++)
+    {
+        double diff = 0;
+        if (output_format == "fc32") diff = std::abs(reinterpret_cast<const float *>(&buffs.out.front())[i] - reinterpret_cast<const float *>(&ref.front())[i]);
+        else if (output_format == "sc16") diff = std::abs(reinterpret_cast<const boost::int16_t *>(&buffs.out.front())[i] - reinterpret_cast<const boost::int16_t *>(&ref.front())[i]);
+        else
+        {
+            //item32 is big endian, compare as host words
+            const boost::uint16_t a = reinterpret_cast<const boost::uint16_t *>(&buffs.out.front())[i];
+            const boost::uint16_t b = reinterpret_cast<const boost::uint16_t *>(&ref.front())[i];
+            diff = std::abs(boost::int16_t((a >> 8) | (a << 8)) - boost::int16_t((b >> 8) | (b << 8)));
+        }
+        max_diff = std::max(max_diff, diff);
+    }
+    return max_diff;
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    double duration;
+    size_t nsamps;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("duration", po::value<double>(&duration)->default_value(1.0), "seconds to run each converter")
+        ("nsamps", po::value<size_t>(&nsamps)->default_value(363), "samples per conversion (363 fits the umtrx mtu)")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX SIMD converter benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    const char *formats[][2] = {
+        {"sc16_item32_be", "fc32"},
+        {"sc16_item32_be", "sc16"},
+        {"fc32", "sc16_item32_be"},
+        {"sc16", "sc16_item32_be"},
+    };
+
+    bench_buffers buffs(nsamps);
+    const std::vector<const umtrx_convert_kernels *> kernels = umtrx_convert_get_kernels();
+
+    for (size_t f = 0; f < sizeof(formats)/sizeof(formats[0]); f++)
+    {
+        const std::string input_format = formats[f][0], output_format = formats[f][1];
+        const uhd::convert::id_type id = make_id(input_format, output_format);
+        const double scalar = get_scalar(input_format, output_format);
+
+        std::cout << std::endl << boost::format("==== %s -> %s") % input_format % output_format << std::endl;
+        std::cout << boost::format("%-16s %12s %12s %10s") % "converter" % "Msps" % "max diff" % "speedup" << std::endl;
+
+        //the uhd general converter is the reference for both speed and output
+        uhd::convert::converter::sptr ref_conv = uhd::convert::get_converter(id, 0)();
+        ref_conv->set_scalar(scalar);
+        run_converter(ref_conv, buffs, input_format);
+        const std::vector<char> ref(buffs.out.begin(), buffs.out.begin() + get_output_bytes(output_format, nsamps));
+        double base_rate = 0;
+
+        //the converters registered by uhd below our priority
+        for (uhd::convert::priority_type prio = 0; prio < UMTRX_CONVERT_PRIORITY; prio++)
+        {
+            uhd::convert::converter::sptr conv;
+            try{conv = uhd::convert::get_converter(id, prio)();}
+            catch(const std::exception &){continue;} //nothing at this priority
+            conv->set_scalar(scalar);
+            const double diff = check_converter(conv, buffs, input_format, output_format, ref);
+            const double rate = bench_converter(conv, buffs, input_format, duration);
+            if (base_rate == 0) base_rate = rate;
+            std::cout << boost::format("%-16s %12.1f %12g %9.2fx") % str(boost::format("uhd prio %d") % prio) % (rate/1e6) % diff % (rate/base_rate) << std::endl;
+        }
+
+        //the umtrx kernels, the last one is the registered converter
+        for (size_t k = 0; k < kernels.size(); k++)
+        {
+            uhd::convert::converter::sptr conv(new kernel_converter(kernels[k], id));
+            conv->set_scalar(scalar);
+            const double diff = check_converter(conv, buffs, input_format, output_format, ref);
+            const double rate = bench_converter(conv, buffs, input_format, duration);
+            std::cout << boost::format("%-16s %12.1f %12g %9.2fx") % str(boost::format("umtrx %s") % kernels[k]->name) % (rate/1e6) % diff % (rate/base_rate) << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
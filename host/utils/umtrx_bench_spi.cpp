@@ -0,0 +1,124 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * SPI write rate to the LMS6002D, the way the driver retunes it.
+ * Writes the read only chip version register, so the radio is left
+ * as it was, through:
+ * - sync: the fifo control, each write followed by a readback,
+ *   a round trip per write
+ * - pipelined: the fifo control, the writes fill the window and
+ *   one fence waits for the last ack
+ * - firmware: the firmware control port, a round trip per write
+ * The window is the fifo_ctrl_window device arg, clipped to the
+ * hardware maximum of 15, ex: --args="fifo_ctrl_window=1" for the
+ * writes one at a time.
+ **********************************************************************/
+
+#include "../umtrx_fifo_ctrl.hpp"
+#include "../umtrx_regs.hpp"
+#include "../umtrx_stream_stats.hpp"
+#include <uhd/property_tree.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/program_options.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+
+namespace po = boost::program_options;
+
+static const boost::uint32_t LMS_VERSION_REG = 0x04;
+
+static void print_rate(const std::string &name, const size_t num_writes, const boost::uint64_t ns)
+{
+    std::cout << boost::format("%-10s %10.0f writes/s %8.2f us/write")
+        % name % (num_writes/(ns/1e9)) % (ns/1e3/num_writes) << std::endl;
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    std::string args;
+    std::string which;
+    size_t num_writes;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "help message")
+        ("args", po::value<std::string>(&args)->default_value(""), "single uhd device address args, ex: fifo_ctrl_window=1")
+        ("which", po::value<std::string>(&which)->default_value("A"), "which LMS to write: A or B")
+        ("writes", po::value<size_t>(&num_writes)->default_value(10000), "SPI writes per test")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help") or num_writes == 0){
+        std::cout << boost::format("UmTRX SPI write benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    //create a usrp device
+    std::cout << boost::format("Creating the usrp device with: %s...") % args << std::endl;
+    uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(args);
+    uhd::property_tree::sptr tree = usrp->get_device()->get_tree();
+    if (not tree->exists("/mboards/0/fifo_ctrl"))
+    {
+        throw std::runtime_error("This device does not have the UmTRX fifo control.");
+    }
+    umtrx_fifo_ctrl::sptr ctrl = tree->access<umtrx_fifo_ctrl::sptr>("/mboards/0/fifo_ctrl").get();
+    uhd::spi_iface::sptr fw_spi = tree->access<uhd::spi_iface::sptr>("/mboards/0/spi_iface").get();
+
+    const int slave = (which == "B")? SPI_SS_LMS2 : SPI_SS_LMS1;
+    const uhd::spi_config_t config(uhd::spi_config_t::EDGE_RISE);
+    const boost::uint32_t read_cmd = LMS_VERSION_REG << 8;
+    const boost::uint32_t version = ctrl->read_spi(slave, config, read_cmd, 16) & 0xff;
+    const boost::uint32_t write_cmd = ((0x80 | LMS_VERSION_REG) << 8) | version;
+    std::cout << boost::format("LMS %s version register 0x%02x, %u writes per test") % which % version % num_writes << std::endl;
+
+    boost::uint64_t start_ns = umtrx_stats_now_ns();
+    for (size_t i = 0; i < num_writes; i++)
+    {
+        ctrl->write_spi(slave, config, write_cmd, 16);
+        ctrl->read_spi(slave, config, read_cmd, 16);
+    }
+    print_rate("sync", num_writes, umtrx_stats_now_ns() - start_ns);
+
+    start_ns = umtrx_stats_now_ns();
+    for (size_t i = 0; i < num_writes; i++)
+    {
+        ctrl->write_spi(slave, config, write_cmd, 16);
+    }
+    ctrl->fence();
+    print_rate("pipelined", num_writes, umtrx_stats_now_ns() - start_ns);
+
+    //the firmware is a lot slower, a tenth of the writes is enough
+    const size_t num_fw_writes = std::max<size_t>(1, num_writes/10);
+    start_ns = umtrx_stats_now_ns();
+    for (size_t i = 0; i < num_fw_writes; i++)
+    {
+        fw_spi->write_spi(slave, config, write_cmd, 16);
+    }
+    print_rate("firmware", num_fw_writes, umtrx_stats_now_ns() - start_ns);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Loopback benchmark of the UDP zero copy transports.
+ * A local blaster thread plays the role of the UmTRX streaming port,
+ * the transport under test announces itself with one packet
+ * (like program_stream_dest does) and then receives the flood.
+ **********************************************************************/
+
+#include "../umtrx_udp_mmsg.hpp"
+#include <uhd/transport/udp_zero_copy.hpp>
+#include <uhd/transport/udp_simple.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <uhd/utils/atomic.hpp>
+#include <boost/program_options.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace pt = boost::posix_time;
+namespace asio = boost::asio;
+using namespace uhd::transport;
+
+/***********************************************************************
+ * Blaster: wait for the hello packet, then flood its source
+ **********************************************************************/
+static void blaster(asio::ip::udp::socket *sock, const size_t frame_size, uhd::atomic_uint32_t *running)
+{
+    std::vector<boost::uint32_t> buff(frame_size/sizeof(boost::uint32_t));
+    asio::ip::udp::endpoint ep;
+    sock->receive_from(asio::buffer(buff), ep);
+    boost::uint32_t seq = 0;
+    while (running->read() != 0)
+    {
+        buff[0] = seq++;
+        sock->send_to(asio::buffer(buff), ep);
+    }
+}
+
+/***********************************************************************
+ * Receive benchmark for one transport
+ **********************************************************************/
+static void bench_xport(const std::string &name, const size_t frame_size, const double duration, const uhd::device_addr_t &hints, const bool mmsg)
+{
+    asio::io_service io_service;
+    asio::ip::udp::socket sock(io_service, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+    const std::string port = boost::lexical_cast<std::string>(sock.local_endpoint().port());
+
+    zero_copy_xport_params params;
+    params.send_frame_size = frame_size;
+    params.recv_frame_size = frame_size;
+    params.num_send_frames = 32;
+    params.num_recv_frames = 32;
+    zero_copy_if::sptr xport;
+    if (mmsg) xport = umtrx_udp_mmsg::make("127.0.0.1", port, params, hints);
+    else
+    {
+        udp_zero_copy::buff_params ignored_params;
+        xport = udp_zero_copy::make("127.0.0.1", port, params, ignored_params, hints);
+    }
+
+    uhd::atomic_uint32_t running;
+    running.write(1);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&blaster, &sock, frame_size, &running));
+
+    //announce ourself to the blaster
+    {
+        managed_send_buffer::sptr buff = xport->get_send_buff();
+        buff->commit(sizeof(boost::uint32_t));
+    }
+
+    size_t num_pkts = 0, num_drops = 0, num_timeouts = 0;
+    boost::uint32_t next_seq = 0;
+    bool first = true;
+    const pt::ptime start = pt::microsec_clock::universal_time();
+    const pt::ptime stop = start + pt::microseconds(long(duration*1e6));
+    pt::ptime now = start;
+    while (now < stop)
+    {
+        for (size_t n = 0; n < 1000; n++)
+        {
+            managed_recv_buffer::sptr buff = xport->get_recv_buff(0.1);
+            if (not buff)
+            {
+                num_timeouts++;
+                continue;
+            }
+            const boost::uint32_t seq = buff->cast<const boost::uint32_t *>()[0];
+            if (not first) num_drops += seq - next_seq;
+            first = false;
+            next_seq = seq + 1;
+            num_pkts++;
+        }
+        now = pt::microsec_clock::universal_time();
+    }
+    const double secs = 1e-6*(now - start).total_microseconds();
+
+    running.write(0);
+    threads.join_all();
+
+    std::cout << boost::format("%-16s %12.0f pkts/s %10.1f MB/s %10u drops %6u timeouts")
+        % name % (num_pkts/secs) % (num_pkts*frame_size/secs/1e6) % num_drops % num_timeouts << std::endl;
+}
+
+/***********************************************************************
+ * Main
+ **********************************************************************/
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    double duration;
+    size_t frame_size;
+    std::string args;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("duration", po::value<double>(&duration)->default_value(3.0), "seconds to run each transport")
+        ("frame_size", po::value<size_t>(&frame_size)->default_value(uhd::transport::udp_simple::mtu), "bytes per packet")
+        ("args", po::value<std::string>(&args)->default_value("recv_buff_size=50e6"), "transport hints, ex: mmsg_batch=32")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX UDP transport loopback benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    const uhd::device_addr_t hints(args);
+    bench_xport("udp_zero_copy", frame_size, duration, hints, false);
+    if (umtrx_udp_mmsg::is_supported()) bench_xport("umtrx_udp_mmsg", frame_size, duration, hints, true);
+
+    return EXIT_SUCCESS;
+}
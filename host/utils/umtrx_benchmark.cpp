@@ -0,0 +1,566 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Sustained streaming benchmark.
+ * Runs RX and TX streamers on the chosen channels for a while and
+ * measures every recv() and send() call into a latency histogram,
+ * along with the samples moved, the errors reported and the CPU time
+ * of each streaming thread. With --split every channel gets its own
+ * streamer and thread, otherwise there is one streamer per direction.
+ * The results are printed as a table and with --json written as JSON,
+ * which includes the driver version and the per-dsp counters of the
+ * driver, so that runs of different driver versions can be compared.
+ **********************************************************************/
+
+#include "umtrx_version.hpp"
+#include "../umtrx_stream_stats.hpp"
+#include <uhd/version.hpp>
+#include <uhd/convert.hpp>
+#include <uhd/property_tree.hpp>
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/format.hpp>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace po = boost::program_options;
+
+static volatile bool stop_signal_called = false;
+
+static void sig_int_handler(int)
+{
+    stop_signal_called = true;
+}
+
+//! The CPU time of the calling thread in nanoseconds, 0 when unknown
+static boost::uint64_t thread_cpu_ns(void)
+{
+#ifdef UHD_PLATFORM_LINUX
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return boost::uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+/***********************************************************************
+ * Latency histogram:
+ * HDR style log-linear buckets, every power of two is split into
+ * 16 linear sub-buckets, so a recorded value is off by at most 1/16.
+ * Values up to 2^40 ns are kept apart, the rest go to the last bucket.
+ **********************************************************************/
+class latency_histogram
+{
+public:
+    latency_histogram(void):
+        _counts(NUM_BUCKETS, 0), _count(0), _sum(0), _min(~boost::uint64_t(0)), _max(0){}
+
+    void record(const boost::uint64_t ns)
+    {
+        _counts[bucket_of(ns)]++;
+        _count++;
+        _sum += ns;
+        _min = std::min(_min, ns);
+        _max = std::max(_max, ns);
+    }
+
+    boost::uint64_t count(void) const
+    {
+        return _count;
+    }
+
+    double mean(void) const
+    {
+        return _count? double(_sum)/_count : 0.0;
+    }
+
+    boost::uint64_t min(void) const
+    {
+        return _count? _min : 0;
+    }
+
+    boost::uint64_t max(void) const
+    {
+        return _max;
+    }
+
+    //! The value below which the given percent of the calls are, as a bucket top
+    boost::uint64_t percentile(const double percent) const
+    {
+        const boost::uint64_t target = boost::uint64_t(percent/100.0*_count + 0.5);
+        boost::uint64_t seen = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; i++)
+        {
+            seen += _counts[i];
+            if (seen >= target and seen != 0) return std::min(bucket_top(i), _max);
+        }
+        return _max;
+    }
+
+    //! The non-empty buckets as [top ns, count] pairs
+    std::string to_json(void) const
+    {
+        std::ostringstream os;
+        os << "[";
+        bool first = true;
+        for (size_t i = 0; i < NUM_BUCKETS; i++)
+        {
+            if (_counts[i] == 0) continue;
+            if (not first) os << ", ";
+            os << "[" << bucket_top(i) << ", " << _counts[i] << "]";
+            first = false;
+        }
+        os << "]";
+        return os.str();
+    }
+
+private:
+    static const size_t SUB_BITS = 4;
+    static const size_t SUB_COUNT = 1 << SUB_BITS;
+    static const size_t MAX_EXP = 40;
+    static const size_t NUM_BUCKETS = (MAX_EXP - SUB_BITS + 2)*SUB_COUNT;
+
+    static size_t bucket_of(const boost::uint64_t ns)
+    {
+        if (ns < SUB_COUNT) return size_t(ns);
+        size_t exp = SUB_BITS;
+        while ((ns >> (exp + 1)) != 0) exp++;
+        if (exp > MAX_EXP) return NUM_BUCKETS - 1;
+        const size_t sub = size_t(ns >> (exp - SUB_BITS)) & (SUB_COUNT - 1);
+        return (exp - SUB_BITS + 1)*SUB_COUNT + sub;
+    }
+
+    static boost::uint64_t bucket_top(const size_t index)
+    {
+        if (index < SUB_COUNT) return index;
+        const size_t exp = index/SUB_COUNT + SUB_BITS - 1;
+        const boost::uint64_t sub = index % SUB_COUNT;
+        return ((SUB_COUNT + sub + 1) << (exp - SUB_BITS)) - 1;
+    }
+
+    std::vector<boost::uint64_t> _counts;
+    boost::uint64_t _count, _sum, _min, _max;
+};
+
+/***********************************************************************
+ * The results of one streaming thread
+ **********************************************************************/
+struct bench_thread_stats
+{
+    bench_thread_stats(const std::string &name, const std::vector<size_t> &channels):
+        name(name), channels(channels),
+        samples(0), calls(0), short_calls(0),
+        timeouts(0), overflows(0), seq_errors(0), late_commands(0), other_errors(0),
+        underflows(0), tx_seq_errors(0), time_errors(0), burst_acks(0),
+        cpu_ns(0), wall_ns(0){}
+
+    std::string name;
+    std::vector<size_t> channels;
+    latency_histogram latency;
+    boost::uint64_t samples; //!< per channel
+    boost::uint64_t calls, short_calls;
+    //rx metadata errors
+    boost::uint64_t timeouts, overflows, seq_errors, late_commands, other_errors;
+    //tx async events
+    boost::uint64_t underflows, tx_seq_errors, time_errors, burst_acks;
+    boost::uint64_t cpu_ns, wall_ns;
+};
+
+/***********************************************************************
+ * Streaming threads
+ **********************************************************************/
+static void rx_bench(uhd::rx_streamer::sptr rx_stream, const std::string &cpu, const uhd::time_spec_t &start_time, bench_thread_stats *stats)
+{
+    uhd::set_thread_priority_safe();
+
+    const size_t num_samps = rx_stream->get_max_num_samps();
+    const size_t item_size = uhd::convert::get_bytes_per_item(cpu);
+    std::vector<std::vector<char> > mem(rx_stream->get_num_channels(), std::vector<char>(num_samps*item_size));
+    std::vector<void *> buffs;
+    for (size_t i = 0; i < mem.size(); i++) buffs.push_back(&mem[i].front());
+
+    uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+    stream_cmd.stream_now = false;
+    stream_cmd.time_spec = start_time;
+    rx_stream->issue_stream_cmd(stream_cmd);
+
+    uhd::rx_metadata_t md;
+    bool first = true; //the first call waits for the start time
+    const boost::uint64_t cpu_start = thread_cpu_ns();
+    const boost::uint64_t wall_start = umtrx_stats_now_ns();
+    while (not stop_signal_called)
+    {
+        const boost::uint64_t call_ns = umtrx_stats_now_ns();
+        const size_t n = rx_stream->recv(buffs, num_samps, md, first? 1.0 : 0.1);
+        if (not first) stats->latency.record(umtrx_stats_now_ns() - call_ns);
+        first = false;
+        stats->calls++;
+        stats->samples += n;
+        if (n < num_samps) stats->short_calls++;
+
+        switch (md.error_code)
+        {
+        case uhd::rx_metadata_t::ERROR_CODE_NONE: break;
+        case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT: stats->timeouts++; break;
+        case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND: stats->late_commands++; break;
+        case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+            if (md.out_of_sequence) stats->seq_errors++;
+            else stats->overflows++;
+            break;
+        default: stats->other_errors++; break;
+        }
+    }
+    stats->cpu_ns = thread_cpu_ns() - cpu_start;
+    stats->wall_ns = umtrx_stats_now_ns() - wall_start;
+
+    rx_stream->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
+    while (rx_stream->recv(buffs, num_samps, md, 0.1) != 0){} //drain the packets in flight
+}
+
+static void tx_bench(uhd::tx_streamer::sptr tx_stream, const std::string &cpu, const uhd::time_spec_t &start_time, bench_thread_stats *stats)
+{
+    uhd::set_thread_priority_safe();
+
+    const size_t num_samps = tx_stream->get_max_num_samps();
+    const size_t item_size = uhd::convert::get_bytes_per_item(cpu);
+    std::vector<char> mem(num_samps*item_size, 0);
+    std::vector<const void *> buffs(tx_stream->get_num_channels(), &mem.front()); //zeros on every channel
+
+    uhd::tx_metadata_t md;
+    md.start_of_burst = true;
+    md.has_time_spec = true;
+    md.time_spec = start_time;
+    const boost::uint64_t cpu_start = thread_cpu_ns();
+    const boost::uint64_t wall_start = umtrx_stats_now_ns();
+    while (not stop_signal_called)
+    {
+        const boost::uint64_t call_ns = umtrx_stats_now_ns();
+        const size_t n = tx_stream->send(buffs, num_samps, md, 1.0);
+        stats->latency.record(umtrx_stats_now_ns() - call_ns);
+        stats->calls++;
+        stats->samples += n;
+        if (n < num_samps) stats->short_calls++;
+        md.start_of_burst = false;
+        md.has_time_spec = false;
+    }
+    stats->cpu_ns = thread_cpu_ns() - cpu_start;
+    stats->wall_ns = umtrx_stats_now_ns() - wall_start;
+
+    md.end_of_burst = true;
+    tx_stream->send(buffs, 0, md);
+}
+
+static void tx_async_bench(uhd::tx_streamer::sptr tx_stream, bench_thread_stats *stats)
+{
+    const boost::uint64_t cpu_start = thread_cpu_ns();
+    const boost::uint64_t wall_start = umtrx_stats_now_ns();
+    uhd::async_metadata_t md;
+    size_t idle = 0;
+    while (true)
+    {
+        //after the stop, the ack of the final burst or half a second of silence ends it
+        if (not tx_stream->recv_async_msg(md, 0.1))
+        {
+            if (stop_signal_called and ++idle == 5) break;
+            continue;
+        }
+        if (md.event_code & (uhd::async_metadata_t::EVENT_CODE_UNDERFLOW | uhd::async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET)) stats->underflows++;
+        if (md.event_code & (uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR | uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST)) stats->tx_seq_errors++;
+        if (md.event_code & uhd::async_metadata_t::EVENT_CODE_TIME_ERROR) stats->time_errors++;
+        if (md.event_code & uhd::async_metadata_t::EVENT_CODE_BURST_ACK)
+        {
+            stats->burst_acks++;
+            if (stop_signal_called) break;
+        }
+    }
+    stats->cpu_ns = thread_cpu_ns() - cpu_start;
+    stats->wall_ns = umtrx_stats_now_ns() - wall_start;
+}
+
+/***********************************************************************
+ * Reports
+ **********************************************************************/
+static std::vector<size_t> parse_channels(const std::string &list)
+{
+    std::vector<size_t> channels;
+    std::vector<std::string> strings;
+    boost::split(strings, list, boost::is_any_of("\"',"));
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        if (strings[i].empty()) continue;
+        channels.push_back(boost::lexical_cast<size_t>(strings[i]));
+    }
+    return channels;
+}
+
+static double cpu_percent(const bench_thread_stats &stats)
+{
+    return stats.wall_ns? 100.0*stats.cpu_ns/stats.wall_ns : 0.0;
+}
+
+//! Samples per second over all channels of the thread
+static double msps(const bench_thread_stats &stats)
+{
+    return stats.wall_ns? 1e3*stats.samples*stats.channels.size()/stats.wall_ns : 0.0;
+}
+
+static void print_table(const std::vector<bench_thread_stats *> &threads)
+{
+    std::cout << boost::format("%-14s %8s %8s %7s %9s %9s %9s %9s %9s %7s %7s")
+        % "thread" % "Msps" % "calls" % "cpu %" % "%/Msps" % "mean us" % "p50 us" % "p99 us" % "p99.9 us" % "max ms" % "errors" << std::endl;
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        const bench_thread_stats &s = *threads[i];
+        const boost::uint64_t errors = s.timeouts + s.overflows + s.seq_errors + s.late_commands + s.other_errors
+            + s.underflows + s.tx_seq_errors + s.time_errors;
+        const double rate = msps(s);
+        std::cout << boost::format("%-14s %8.3f %8u %7.1f %9.2f %9.1f %9.1f %9.1f %9.1f %7.2f %7u")
+            % s.name % rate % s.calls % cpu_percent(s) % (rate > 0? cpu_percent(s)/rate : 0.0)
+            % (s.latency.mean()/1e3) % (s.latency.percentile(50)/1e3)
+            % (s.latency.percentile(99)/1e3) % (s.latency.percentile(99.9)/1e3)
+            % (s.latency.max()/1e6) % errors << std::endl;
+    }
+}
+
+static std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '"' or s[i] == '\\') out += '\\';
+        if (s[i] == '\n') out += "\\n";
+        else if (s[i] == '\t' or s[i] == '\r') out += ' ';
+        else out += s[i];
+    }
+    return out + "\"";
+}
+
+//! The driver counters of a dsp, see umtrx_stream_stats
+static std::string driver_stats_json(uhd::property_tree::sptr tree, const std::string &path)
+{
+    std::ostringstream os;
+    os << "{";
+    if (tree->exists(path))
+    {
+        const std::vector<std::string> names = tree->list(path);
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (i) os << ", ";
+            os << json_string(names[i]) << ": " << tree->access<size_t>(path + "/" + names[i]).get();
+        }
+    }
+    os << "}";
+    return os.str();
+}
+
+static void write_json(
+    std::ostream &os, uhd::usrp::multi_usrp::sptr usrp,
+    const std::vector<bench_thread_stats *> &threads,
+    const std::vector<size_t> &rx_channels, const std::vector<size_t> &tx_channels,
+    const std::string &args, const std::string &otw, const std::string &cpu,
+    const size_t spp, const double duration
+){
+    uhd::property_tree::sptr tree = usrp->get_device()->get_tree();
+    os << "{" << std::endl;
+    os << "  \"umtrx_version\": " << json_string(UMTRX_VERSION) << "," << std::endl;
+    os << "  \"uhd_version\": " << json_string(uhd::get_version_string()) << "," << std::endl;
+    os << "  \"args\": " << json_string(args) << "," << std::endl;
+    os << "  \"otw\": " << json_string(otw) << ", \"cpu\": " << json_string(cpu) << ", \"spp\": " << spp << "," << std::endl;
+    os << "  \"duration\": " << duration << "," << std::endl;
+    os << boost::format("  \"rx_rate\": %f, \"tx_rate\": %f,") % (rx_channels.empty()? 0.0 : usrp->get_rx_rate(rx_channels[0])) % (tx_channels.empty()? 0.0 : usrp->get_tx_rate(tx_channels[0])) << std::endl;
+    os << "  \"threads\": [" << std::endl;
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        const bench_thread_stats &s = *threads[i];
+        os << "    {\"name\": " << json_string(s.name) << ", \"channels\": [";
+        for (size_t j = 0; j < s.channels.size(); j++) os << (j? ", " : "") << s.channels[j];
+        os << "]," << std::endl;
+        os << boost::format("      \"samples\": %u, \"calls\": %u, \"short_calls\": %u, \"msps\": %f,")
+            % s.samples % s.calls % s.short_calls % msps(s) << std::endl;
+        os << boost::format("      \"cpu_ns\": %u, \"wall_ns\": %u, \"cpu_percent\": %f,")
+            % s.cpu_ns % s.wall_ns % cpu_percent(s) << std::endl;
+        os << boost::format("      \"errors\": {\"timeouts\": %u, \"overflows\": %u, \"seq_errors\": %u, \"late_commands\": %u, \"other\": %u, "
+            "\"underflows\": %u, \"tx_seq_errors\": %u, \"time_errors\": %u, \"burst_acks\": %u},")
+            % s.timeouts % s.overflows % s.seq_errors % s.late_commands % s.other_errors
+            % s.underflows % s.tx_seq_errors % s.time_errors % s.burst_acks << std::endl;
+        os << boost::format("      \"latency_ns\": {\"count\": %u, \"min\": %u, \"mean\": %f, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p99.9\": %u, \"max\": %u,")
+            % s.latency.count() % s.latency.min() % s.latency.mean()
+            % s.latency.percentile(50) % s.latency.percentile(90) % s.latency.percentile(99) % s.latency.percentile(99.9)
+            % s.latency.max() << std::endl;
+        os << "        \"histogram\": " << s.latency.to_json() << "}}" << ((i + 1 < threads.size())? "," : "") << std::endl;
+    }
+    os << "  ]," << std::endl;
+
+    //the driver counters add up over the device lifetime, which is this run
+    os << "  \"driver_stats\": {";
+    for (size_t i = 0; i < rx_channels.size(); i++)
+    {
+        os << (i? ", " : "") << "\"rx" << rx_channels[i] << "\": "
+           << driver_stats_json(tree, str(boost::format("/mboards/0/rx_dsps/%u/stats") % rx_channels[i]));
+    }
+    for (size_t i = 0; i < tx_channels.size(); i++)
+    {
+        os << ((i or not rx_channels.empty())? ", " : "") << "\"tx" << tx_channels[i] << "\": "
+           << driver_stats_json(tree, str(boost::format("/mboards/0/tx_dsps/%u/stats") % tx_channels[i]));
+    }
+    os << "}" << std::endl;
+    os << "}" << std::endl;
+}
+
+/***********************************************************************
+ * Main
+ **********************************************************************/
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    std::string args;
+    double duration;
+    std::string rx_list, tx_list;
+    double rx_rate, tx_rate;
+    std::string otw, cpu;
+    size_t spp;
+    double delay;
+    std::string json_file;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "help message")
+        ("args", po::value<std::string>(&args)->default_value(""), "single uhd device address args")
+        ("duration", po::value<double>(&duration)->default_value(10.0), "seconds to stream for")
+        ("rx_channels", po::value<std::string>(&rx_list)->default_value("0"), "RX channels to stream, ex: 0,1 (empty for none)")
+        ("tx_channels", po::value<std::string>(&tx_list)->default_value("0"), "TX channels to stream, ex: 0,1 (empty for none)")
+        ("rx_rate", po::value<double>(&rx_rate)->default_value(1e6), "RX sample rate")
+        ("tx_rate", po::value<double>(&tx_rate)->default_value(1e6), "TX sample rate")
+        ("otw", po::value<std::string>(&otw)->default_value("sc16"), "over the wire format: sc16 or sc8")
+        ("cpu", po::value<std::string>(&cpu)->default_value("fc32"), "host sample format: fc32, sc16...")
+        ("spp", po::value<size_t>(&spp)->default_value(0), "samples per packet (0 = the largest)")
+        ("split", "one streamer and thread per channel")
+        ("delay", po::value<double>(&delay)->default_value(0.25), "seconds to the timed start of the streams")
+        ("json", po::value<std::string>(&json_file)->default_value(""), "write the results as JSON to this file (- for stdout)")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX streaming benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    const std::vector<size_t> rx_channels = parse_channels(rx_list);
+    const std::vector<size_t> tx_channels = parse_channels(tx_list);
+    if (rx_channels.empty() and tx_channels.empty()) throw std::runtime_error("no channels to stream");
+
+    //create a usrp device
+    std::cout << boost::format("Creating the usrp device with: %s...") % args << std::endl;
+    uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(args);
+    std::cout << boost::format("Using Device: %s") % usrp->get_pp_string() << std::endl;
+
+    for (size_t i = 0; i < rx_channels.size(); i++) usrp->set_rx_rate(rx_rate, rx_channels[i]);
+    for (size_t i = 0; i < tx_channels.size(); i++) usrp->set_tx_rate(tx_rate, tx_channels[i]);
+    if (not rx_channels.empty()) std::cout << boost::format("Actual RX Rate: %f Msps") % (usrp->get_rx_rate(rx_channels[0])/1e6) << std::endl;
+    if (not tx_channels.empty()) std::cout << boost::format("Actual TX Rate: %f Msps") % (usrp->get_tx_rate(tx_channels[0])/1e6) << std::endl;
+
+    //group the channels into streamers
+    std::vector<std::vector<size_t> > rx_groups, tx_groups;
+    for (size_t i = 0; i < rx_channels.size(); i++)
+    {
+        if (vm.count("split") or rx_groups.empty()) rx_groups.push_back(std::vector<size_t>());
+        rx_groups.back().push_back(rx_channels[i]);
+    }
+    for (size_t i = 0; i < tx_channels.size(); i++)
+    {
+        if (vm.count("split") or tx_groups.empty()) tx_groups.push_back(std::vector<size_t>());
+        tx_groups.back().push_back(tx_channels[i]);
+    }
+
+    std::vector<bench_thread_stats *> stats;
+    std::vector<uhd::rx_streamer::sptr> rx_streams;
+    std::vector<uhd::tx_streamer::sptr> tx_streams;
+    for (size_t i = 0; i < rx_groups.size(); i++)
+    {
+        uhd::stream_args_t stream_args(cpu, otw);
+        stream_args.channels = rx_groups[i];
+        if (spp != 0) stream_args.args["spp"] = boost::lexical_cast<std::string>(spp);
+        rx_streams.push_back(usrp->get_rx_stream(stream_args));
+        stats.push_back(new bench_thread_stats(str(boost::format("rx%u") % i), rx_groups[i]));
+    }
+    for (size_t i = 0; i < tx_groups.size(); i++)
+    {
+        uhd::stream_args_t stream_args(cpu, otw);
+        stream_args.channels = tx_groups[i];
+        if (spp != 0) stream_args.args["spp"] = boost::lexical_cast<std::string>(spp);
+        tx_streams.push_back(usrp->get_tx_stream(stream_args));
+        stats.push_back(new bench_thread_stats(str(boost::format("tx%u") % i), tx_groups[i]));
+        stats.push_back(new bench_thread_stats(str(boost::format("tx%u_async") % i), tx_groups[i]));
+    }
+
+    //run every stream from a common time
+    std::signal(SIGINT, &sig_int_handler);
+    const uhd::time_spec_t start_time = usrp->get_time_now() + uhd::time_spec_t(delay);
+    boost::thread_group threads;
+    size_t index = 0;
+    for (size_t i = 0; i < rx_streams.size(); i++)
+    {
+        threads.create_thread(boost::bind(&rx_bench, rx_streams[i], cpu, start_time, stats[index++]));
+    }
+    for (size_t i = 0; i < tx_streams.size(); i++)
+    {
+        threads.create_thread(boost::bind(&tx_bench, tx_streams[i], cpu, start_time, stats[index++]));
+        threads.create_thread(boost::bind(&tx_async_bench, tx_streams[i], stats[index++]));
+    }
+
+    std::cout << boost::format("Streaming for %f seconds, Ctrl-C to stop...") % duration << std::endl;
+    const boost::uint64_t end_ns = umtrx_stats_now_ns() + boost::uint64_t((delay + duration)*1e9);
+    while (not stop_signal_called and umtrx_stats_now_ns() < end_ns)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    stop_signal_called = true;
+    threads.join_all();
+
+    std::cout << std::endl;
+    print_table(stats);
+
+    if (not json_file.empty())
+    {
+        if (json_file == "-") write_json(std::cout, usrp, stats, rx_channels, tx_channels, args, otw, cpu, spp, duration);
+        else
+        {
+            std::ofstream os(json_file.c_str());
+            write_json(os, usrp, stats, rx_channels, tx_channels, args, otw, cpu, spp, duration);
+            std::cout << boost::format("Wrote %s") % json_file << std::endl;
+        }
+    }
+
+    for (size_t i = 0; i < stats.size(); i++) delete stats[i];
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,981 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Software UmTRX emulator.
+ * Serves the firmware control port and the FPGA server port on a local
+ * address, so the host driver runs without a board:
+ *
+ *   umtrx_emulator --addr 127.0.0.1 &
+ *   uhd_usrp_probe --args="type=umtrx,addr=127.0.0.1"
+ *
+ * Control port: discovery, MTU holler, register peeks and pokes,
+ * SPI to the two LMS6002D, I2C to the EEPROM, ZPU actions.
+ * Server port: stream destination programming, the fifo control
+ * packets with one or a batch of commands and their acks, the RX
+ * streams paced by the time registers and the TX streams with flow
+ * control, burst acks, underflow, late packet and sequence error
+ * reports.
+ *
+ * It is a model for benchmarks, not a simulation of the FPGA:
+ * - there are no I2C sensors, the host detects an UmTRX 2.0
+ * - the LMS is a register file, its VCO comparators report a fixed
+ *   window of VCOCAP and the DC calibrations lock at once
+ * - timed fifo control commands execute on arrival
+ * - a new RX stream command replaces the current one, no chaining
+ * - RX samples are a tone, TX samples are consumed and dropped,
+ *   unless the RF loopback of the LMS is on (the CAL antenna):
+ *   then its RX chains get the TX samples back after a fixed
+ *   pipeline delay, without gain, noise or frequency offset
+ **********************************************************************/
+
+#include "../umtrx_impl.hpp"
+#include "../umtrx_regs.hpp"
+#include "../umtrx_stream_stats.hpp"
+#include "../usrp2/fw_common.h"
+#include <uhd/transport/vrt_if_packet.hpp>
+#include <uhd/types/metadata.hpp>
+#include <uhd/utils/byteswap.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/program_options.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace asio = boost::asio;
+using namespace uhd::transport;
+
+typedef asio::ip::udp::endpoint endpoint_type;
+
+static const double EMU_TICK_RATE = 26e6; //umtrx_impl::get_master_clock_rate()
+static const size_t EMU_TICKS_PER_DSP_CYCLE = 2; //the dsp rate is half the tick rate
+static const boost::uint64_t EMU_SLACK_TICKS = boost::uint64_t(EMU_TICK_RATE*0.002); //timer jitter before an underflow or late packet
+static const boost::uint64_t EMU_OVERFLOW_TICKS = boost::uint64_t(EMU_TICK_RATE*0.1); //RX stream this far behind overflows
+static const size_t EMU_NUM_FRAMERS = 8;
+static const size_t EMU_MAX_PACKET = 9000;
+static const size_t EMU_SERVICE_US = 500;
+static const size_t EMU_MAX_RX_BURST = 256; //packets per channel and service call
+static const boost::uint64_t EMU_LOOPBACK_TICKS = 260; //DUC, RF loopback and DDC pipeline, 10us
+
+static const boost::uint32_t FIFO_POKE32_CMD = (1 << 8);
+static const size_t NUM_SETTING_REGS = 256;
+
+/***********************************************************************
+ * LMS6002D model:
+ * A register file with just enough behaviour for the tuning
+ * and the DC calibration loops of lms6002d_dev to finish.
+ **********************************************************************/
+class emu_lms
+{
+public:
+    emu_lms(void)
+    {
+        this->reset();
+    }
+
+    void reset(void)
+    {
+        std::fill(_regs, _regs + sizeof(_regs), 0);
+    }
+
+    //! A 16 bit SPI transaction: write bit, 7 bit address, 8 bit data
+    boost::uint32_t transact(const boost::uint32_t data)
+    {
+        const size_t addr = (data >> 8) & 0x7f;
+        if ((data & 0x8000) != 0)
+        {
+            _regs[addr] = boost::uint8_t(data);
+            return 0;
+        }
+        return this->read(addr);
+    }
+
+    //! LBRFEN: the TX output loops into an RX mixer
+    bool rf_loopback(void) const
+    {
+        return (_regs[0x08] & 0x0f) != 0;
+    }
+
+private:
+    boost::uint8_t read(const size_t addr)
+    {
+        switch (addr)
+        {
+        case 0x1a: //TX PLL VOVCO comparators
+        case 0x2a: //RX PLL VOVCO comparators
+        {
+            const size_t vcocap = _regs[addr - 1] & 0x3f;
+            if (vcocap < 16) return 0x80; //high
+            if (vcocap > 47) return 0x40; //low
+            return 0x00; //normal
+        }
+        case 0x01: //DC calibration status: not busy, locked
+        case 0x31:
+        case 0x51:
+        case 0x61:
+            return (_regs[addr] & 0xe1) | (3 << 2);
+        }
+        return _regs[addr];
+    }
+
+    boost::uint8_t _regs[128];
+};
+
+/***********************************************************************
+ * Stream state of the dsp chains
+ **********************************************************************/
+struct emu_rx_chain
+{
+    emu_rx_chain(void): active(false), eob_at_end(false), samps_left(0), next_ticks(0), seq(0){}
+    bool active;
+    bool eob_at_end;
+    boost::uint64_t samps_left;
+    boost::uint64_t next_ticks;
+    size_t seq;
+};
+
+struct emu_tx_packet
+{
+    boost::uint32_t fc_seq;
+    size_t nsamps;
+    bool has_tsf;
+    boost::uint64_t tsf;
+    bool eob;
+    std::vector<boost::uint32_t> samples; //kept for the RF loopback
+};
+
+//! Samples played out from a time, for the RF loopback
+struct emu_tx_segment
+{
+    boost::uint64_t start_ticks;
+    size_t ticks_per_sample;
+    std::vector<boost::uint32_t> samples;
+};
+
+struct emu_tx_chain
+{
+    emu_tx_chain(void){ this->clear(); }
+
+    void clear(void)
+    {
+        queue.clear();
+        played.clear();
+        playing = false;
+        dropping = false;
+        play_ticks = 0;
+        seq_valid = false;
+        last_vrt_seq = 0;
+        last_fc_seq = 0;
+        packets_since_up = 0;
+        last_up_ticks = 0;
+    }
+
+    std::deque<emu_tx_packet> queue;
+    std::deque<emu_tx_segment> played;
+    bool playing;
+    bool dropping; //the rest of a burst after a late packet
+    boost::uint64_t play_ticks;
+    bool seq_valid;
+    size_t last_vrt_seq;
+    boost::uint32_t last_fc_seq;
+    size_t packets_since_up;
+    boost::uint64_t last_up_ticks;
+};
+
+/***********************************************************************
+ * The emulator
+ **********************************************************************/
+class umtrx_emulator
+{
+public:
+    umtrx_emulator(
+        asio::io_service &io_service, const std::string &addr,
+        const size_t num_ddc, const size_t num_duc,
+        const std::string &serial, const bool verbose
+    ):
+        _ctrl_sock(io_service, endpoint_type(asio::ip::address::from_string(addr), USRP2_UDP_CTRL_PORT)),
+        _data_sock(io_service, endpoint_type(asio::ip::address::from_string(addr), USRP2_UDP_SERVER_PORT)),
+        _timer(io_service),
+        _ip_addr(asio::ip::address_v4::from_string(addr).to_ulong()),
+        _num_ddc(num_ddc), _num_duc(num_duc),
+        _verbose(verbose),
+        _dest(EMU_NUM_FRAMERS), _dest_valid(EMU_NUM_FRAMERS, false),
+        _sr(NUM_SETTING_REGS, 0),
+        _fw_regs(8, 0),
+        _eeprom(256, 0xff), _eeprom_ptr(0),
+        _lms(2), _spi_rb(0),
+        _tcxo_dac(2048),
+        _start_ns(umtrx_stats_now_ns()), _time_offset(0),
+        _pps_pending(false), _pps_ticks(0), _pps_at_ns(0),
+        _rx(num_ddc), _tx(num_duc), _context_seq(0),
+        _ctrl_buff(EMU_MAX_PACKET), _data_buff(EMU_MAX_PACKET/sizeof(boost::uint32_t)),
+        _send_buff(EMU_MAX_PACKET/sizeof(boost::uint32_t))
+    {
+        _data_sock.set_option(asio::socket_base::send_buffer_size(4*1024*1024));
+        _data_sock.set_option(asio::socket_base::receive_buffer_size(4*1024*1024));
+
+        _fw_regs[U2_FW_REG_VER_MINOR] = USRP2_FW_VER_MINOR;
+
+        //the N100 part of the EEPROM, the UmTRX extensions stay erased
+        _eeprom[0x00] = 0x00; _eeprom[0x01] = 0xfa; //hardware: 0xFA00 = UmTRX
+        const boost::uint8_t mac[6] = {0x00, 0x50, 0xc2, 0x85, 0x3f, 0xfe};
+        std::copy(mac, mac + 6, _eeprom.begin() + 0x02);
+        for (size_t i = 0; i < 4; i++) _eeprom[0x0c + i] = boost::uint8_t(_ip_addr >> (24 - 8*i));
+        _eeprom[0x12] = 0x01; _eeprom[0x13] = 0x00; //revision
+        std::copy(serial.begin(), serial.begin() + std::min<size_t>(serial.size(), 9), _eeprom.begin() + 0x18);
+        if (serial.size() < 9) _eeprom[0x18 + serial.size()] = 0;
+
+        //a quarter of the full scale tone at a sixteenth of the rate
+        for (size_t i = 0; i < TONE_LEN; i++)
+        {
+            const double phase = 2*M_PI*i/TONE_LEN;
+            const boost::int16_t re = boost::int16_t(8192*std::cos(phase));
+            const boost::int16_t im = boost::int16_t(8192*std::sin(phase));
+            _tone[i] = uhd::htonx(boost::uint32_t((boost::uint16_t(re) << 16) | boost::uint16_t(im)));
+        }
+
+        this->start_ctrl_recv();
+        this->start_data_recv();
+        this->start_timer();
+
+        std::cout << boost::format("UmTRX emulator on %s, ports %d and %d, %u DDC and %u DUC")
+            % addr % USRP2_UDP_CTRL_PORT % USRP2_UDP_SERVER_PORT % _num_ddc % _num_duc << std::endl;
+    }
+
+private:
+    /*******************************************************************
+     * Time:
+     * The tick counter runs from the host clock at the tick rate,
+     * setting the time moves the offset. A PPS edge is every second.
+     ******************************************************************/
+    boost::uint64_t raw_ticks(const boost::uint64_t ns)
+    {
+        return boost::uint64_t((ns - _start_ns)*(EMU_TICK_RATE/1e9));
+    }
+
+    boost::uint64_t ticks_now(void)
+    {
+        const boost::uint64_t ns = umtrx_stats_now_ns();
+        if (_pps_pending and ns >= _pps_at_ns)
+        {
+            _time_offset = boost::int64_t(_pps_ticks - this->raw_ticks(_pps_at_ns));
+            _pps_pending = false;
+        }
+        return this->raw_ticks(ns) + _time_offset;
+    }
+
+    boost::uint64_t next_pps_ns(void)
+    {
+        const boost::uint64_t secs = (umtrx_stats_now_ns() - _start_ns)/1000000000 + 1;
+        return _start_ns + secs*1000000000;
+    }
+
+    boost::uint64_t ticks_last_pps(void)
+    {
+        this->ticks_now(); //applies a pending latch
+        return this->raw_ticks(this->next_pps_ns() - 1000000000) + _time_offset;
+    }
+
+    /*******************************************************************
+     * Wishbone registers shared by the control port and the fifo control
+     ******************************************************************/
+    boost::uint32_t peek_readback(const size_t index)
+    {
+        switch (index)
+        {
+        case 0: return _spi_rb;
+        case 1: return boost::uint32_t(_num_ddc);
+        case 2: return boost::uint32_t(_num_duc);
+        case 10: return boost::uint32_t(this->ticks_now() >> 32);
+        case 11: return boost::uint32_t(this->ticks_now() >> 0);
+        case 12: return (USRP2_FPGA_COMPAT_NUM << 16) | UMTRX_FPGA_MINOR_CTRL_BATCH;
+        case 14: return boost::uint32_t(this->ticks_last_pps() >> 32);
+        case 15: return boost::uint32_t(this->ticks_last_pps() >> 0);
+        }
+        return 0;
+    }
+
+    void poke_setting(const size_t sr, const boost::uint32_t data)
+    {
+        if (sr >= NUM_SETTING_REGS) return;
+        const boost::uint32_t old = _sr[sr];
+        _sr[sr] = data;
+
+        //the LMS reset lines are active low
+        if (sr == SR_MISC + 0)
+        {
+            if ((old & LMS1_RESET) != 0 and (data & LMS1_RESET) == 0) _lms[0].reset();
+            if ((old & LMS2_RESET) != 0 and (data & LMS2_RESET) == 0) _lms[1].reset();
+        }
+
+        //the high word latches the time, now or at the next PPS
+        if (sr == size_t(SR_TIME64) + 0)
+        {
+            const boost::uint64_t ticks = (boost::uint64_t(data) << 32) | _sr[SR_TIME64 + 1];
+            if (_sr[SR_TIME64 + 3] != 0)
+            {
+                _time_offset = boost::int64_t(ticks - this->raw_ticks(umtrx_stats_now_ns()));
+                _pps_pending = false;
+            }
+            else
+            {
+                _pps_ticks = ticks;
+                _pps_at_ns = this->next_pps_ns();
+                _pps_pending = true;
+            }
+        }
+
+        //the data word starts a transaction with the slaves in the control word
+        if (sr == size_t(SR_SPI_CORE) + 2)
+        {
+            const boost::uint32_t ctrl = _sr[SR_SPI_CORE + 1];
+            const size_t num_bits = (ctrl >> 24) & 0x3ff;
+            this->transact_spi(ctrl & 0xffffff, (num_bits == 0)? 0 : (data >> (32 - num_bits)));
+        }
+
+        for (size_t i = 0; i < _rx.size(); i++)
+        {
+            const size_t base = SR_RX_CTRL0 + i*(SR_RX_CTRL1 - SR_RX_CTRL0);
+            if (sr == base + 2) this->issue_stream_cmd(i, _sr[base + 0], (boost::uint64_t(_sr[base + 1]) << 32) | data);
+            if (sr == base + 8 and data == 0) _rx[i].active = false; //reset
+        }
+
+        for (size_t i = 0; i < _tx.size(); i++)
+        {
+            const size_t base = SR_TX_CTRL0 + i*(SR_TX_CTRL1 - SR_TX_CTRL0);
+            if (sr == base + 0 and data != 0) _tx[i].clear();
+        }
+    }
+
+    boost::uint32_t transact_spi(const size_t slaves, const boost::uint32_t data)
+    {
+        _spi_rb = 0;
+        if ((slaves & SPI_SS_LMS1) != 0) _spi_rb = _lms[0].transact(data);
+        if ((slaves & SPI_SS_LMS2) != 0) _spi_rb = _lms[1].transact(data);
+        return _spi_rb;
+    }
+
+    /*******************************************************************
+     * Firmware control port
+     ******************************************************************/
+    void start_ctrl_recv(void)
+    {
+        _ctrl_sock.async_receive_from(asio::buffer(_ctrl_buff), _ctrl_from, boost::bind(
+            &umtrx_emulator::handle_ctrl, this, asio::placeholders::error, asio::placeholders::bytes_transferred));
+    }
+
+    void handle_ctrl(const boost::system::error_code &error, const size_t len)
+    {
+        if (not error and len >= offsetof(usrp2_ctrl_data_t, data))
+        {
+            usrp2_ctrl_data_t in;
+            std::memset(&in, 0, sizeof(in));
+            std::memcpy(&in, &_ctrl_buff.front(), std::min(len, sizeof(in)));
+            this->handle_ctrl_request(in, len);
+        }
+        this->start_ctrl_recv();
+    }
+
+    void handle_ctrl_request(const usrp2_ctrl_data_t &in, const size_t len)
+    {
+        usrp2_ctrl_data_t out = in;
+        size_t out_len = sizeof(out);
+        out.proto_ver = htonl(USRP2_FW_COMPAT_NUM);
+
+        switch (ntohl(in.id))
+        {
+        case UMTRX_CTRL_ID_REQUEST:
+            out.id = htonl(UMTRX_CTRL_ID_RESPONSE);
+            out.data.ip_addr = htonl(_ip_addr);
+            break;
+
+        //the reply is as long as asked for and says how much came in
+        case USRP2_CTRL_ID_HOLLER_AT_ME_BRO:
+            out.id = htonl(USRP2_CTRL_ID_HOLLER_BACK_DUDE);
+            out_len = std::min<size_t>(std::max<size_t>(ntohl(in.data.echo_args.len), sizeof(out)), EMU_MAX_PACKET);
+            out.data.echo_args.len = htonl(boost::uint32_t(len));
+            break;
+
+        case USRP2_CTRL_ID_GET_THIS_REGISTER_FOR_ME_BRO:
+        {
+            out.id = htonl(USRP2_CTRL_ID_OMG_GOT_REGISTER_SO_BAD_DUDE);
+            const boost::uint32_t addr = ntohl(in.data.reg_args.addr);
+            const boost::uint32_t data = ntohl(in.data.reg_args.data);
+            boost::uint32_t result = 0;
+            switch (in.data.reg_args.action)
+            {
+            case USRP2_REG_ACTION_FPGA_PEEK32:
+            case USRP2_REG_ACTION_FPGA_PEEK16:
+                if (addr >= SETTING_REGS_BASE and addr < SETTING_REGS_BASE + 4*NUM_SETTING_REGS) result = _sr[(addr - SETTING_REGS_BASE)/4];
+                else if (addr >= READBACK_BASE and addr < READBACK_BASE + 0x400) result = this->peek_readback((addr - READBACK_BASE)/4);
+                if (in.data.reg_args.action == USRP2_REG_ACTION_FPGA_PEEK16) result &= 0xffff;
+                break;
+            case USRP2_REG_ACTION_FPGA_POKE32:
+            case USRP2_REG_ACTION_FPGA_POKE16:
+                if (addr >= SETTING_REGS_BASE) this->poke_setting((addr - SETTING_REGS_BASE)/4, data);
+                break;
+            case USRP2_REG_ACTION_FW_PEEK32:
+                if (addr < _fw_regs.size()) result = _fw_regs[addr];
+                break;
+            case USRP2_REG_ACTION_FW_POKE32:
+                if (addr < _fw_regs.size()) _fw_regs[addr] = data;
+                break;
+            }
+            out.data.reg_args.data = htonl(result);
+            break;
+        }
+
+        case USRP2_CTRL_ID_TRANSACT_ME_SOME_SPI_BRO:
+        {
+            out.id = htonl(USRP2_CTRL_ID_OMG_TRANSACTED_SPI_DUDE);
+            const boost::uint32_t result = this->transact_spi(ntohl(in.data.spi_args.dev), ntohl(in.data.spi_args.data));
+            out.data.spi_args.data = htonl(in.data.spi_args.readback? result : 0);
+            break;
+        }
+
+        //only the EEPROM answers, the sensors of the later revisions are absent
+        case USRP2_CTRL_ID_DO_AN_I2C_READ_FOR_ME_BRO:
+            out.id = htonl(USRP2_CTRL_ID_HERES_THE_I2C_DATA_DUDE);
+            std::memset(out.data.i2c_args.data, 0, sizeof(out.data.i2c_args.data));
+            for (size_t i = 0; i < in.data.i2c_args.bytes and i < sizeof(out.data.i2c_args.data); i++)
+            {
+                if (in.data.i2c_args.addr == EEPROM_ADDR) out.data.i2c_args.data[i] = _eeprom[_eeprom_ptr++];
+            }
+            break;
+
+        case USRP2_CTRL_ID_WRITE_THESE_I2C_VALUES_BRO:
+            out.id = htonl(USRP2_CTRL_ID_COOL_IM_DONE_I2C_WRITE_DUDE);
+            if (in.data.i2c_args.addr == EEPROM_ADDR and in.data.i2c_args.bytes > 0)
+            {
+                _eeprom_ptr = in.data.i2c_args.data[0];
+                for (size_t i = 1; i < in.data.i2c_args.bytes and i < sizeof(in.data.i2c_args.data); i++)
+                {
+                    _eeprom[_eeprom_ptr++] = in.data.i2c_args.data[i];
+                }
+            }
+            break;
+
+        case UMTRX_CTRL_ID_ZPU_REQUEST:
+            out.id = htonl(UMTRX_CTRL_ID_ZPU_RESPONSE);
+            switch (ntohl(in.data.zpu_action.action))
+            {
+            case UMTRX_ZPU_REQUEST_GET_VCTCXO_DAC: out.data.zpu_action.data = htonl(_tcxo_dac); break;
+            case UMTRX_ZPU_REQUEST_SET_VCTCXO_DAC: _tcxo_dac = ntohl(in.data.zpu_action.data); break;
+            default: out.data.zpu_action.data = 0;
+            }
+            break;
+
+        default:
+            out.id = htonl(USRP2_CTRL_ID_HUH_WHAT);
+        }
+
+        std::vector<boost::uint8_t> reply(out_len, 0);
+        std::memcpy(&reply.front(), &out, sizeof(out));
+        boost::system::error_code ec;
+        _ctrl_sock.send_to(asio::buffer(reply), _ctrl_from, 0, ec);
+    }
+
+    /*******************************************************************
+     * Server port:
+     * Stream destination programming, fifo control and TX data.
+     * The host packets have one word before the VRT header.
+     ******************************************************************/
+    void start_data_recv(void)
+    {
+        _data_sock.async_receive_from(asio::buffer(_data_buff), _data_from, boost::bind(
+            &umtrx_emulator::handle_data, this, asio::placeholders::error, asio::placeholders::bytes_transferred));
+    }
+
+    void handle_data(const boost::system::error_code &error, const size_t len)
+    {
+        if (not error and len >= sizeof(usrp2_stream_ctrl_t) - sizeof(boost::uint32_t))
+        {
+            try
+            {
+                this->handle_data_packet(len/sizeof(boost::uint32_t));
+            }
+            catch (const std::exception &e)
+            {
+                if (_verbose) std::cerr << "Bad packet on the server port: " << e.what() << std::endl;
+            }
+        }
+        this->start_data_recv();
+    }
+
+    void handle_data_packet(const size_t num_words32)
+    {
+        const boost::uint32_t *words = &_data_buff.front();
+
+        if (ntohl(words[1]) == USRP2_INVALID_VRT_HEADER)
+        {
+            if (num_words32 < sizeof(usrp2_stream_ctrl_t)/sizeof(boost::uint32_t)) return;
+            const size_t which = ntohl(words[2]);
+            if (which >= EMU_NUM_FRAMERS) return;
+            _dest[which] = _data_from;
+            _dest_valid[which] = true;
+            if (_verbose) std::cout << "Framer " << which << " -> " << _data_from << std::endl;
+            return;
+        }
+
+        const boost::uint32_t fc_seq = ntohl(words[0]);
+        const boost::uint32_t *vrt_hdr = words + 1;
+        vrt::if_packet_info_t ifpi;
+        ifpi.num_packet_words32 = num_words32 - 1;
+        vrt::if_hdr_unpack_be(vrt_hdr, ifpi);
+        if (not ifpi.has_sid) return;
+        const boost::uint32_t *payload = vrt_hdr + ifpi.num_header_words32;
+
+        if (ifpi.sid == UMTRX_CTRL_SID)
+        {
+            //a batch of (address and command, data) pairs, acked one by one
+            for (size_t i = 0; i + 1 < ifpi.num_payload_words32; i += 2)
+            {
+                this->handle_fifo_ctrl(ntohl(payload[i]), ntohl(payload[i+1]));
+            }
+        }
+        if (ifpi.sid == UMTRX_DSP_TX0_SID and _tx.size() > 0) this->handle_tx_packet(0, fc_seq, ifpi, payload);
+        if (ifpi.sid == UMTRX_DSP_TX1_SID and _tx.size() > 1) this->handle_tx_packet(1, fc_seq, ifpi, payload);
+    }
+
+    //! Every fifo control packet is acked, a peek acks with the readback
+    void handle_fifo_ctrl(const boost::uint32_t ctrl_word, const boost::uint32_t data)
+    {
+        boost::uint32_t result = 0;
+        if ((ctrl_word & FIFO_POKE32_CMD) != 0) this->poke_setting(ctrl_word & 0xff, data);
+        else result = this->peek_readback(ctrl_word & 0xff);
+
+        const boost::uint32_t ack[2] = {ctrl_word, result};
+        this->send_context(UMTRX_CTRL_FRAMER, UMTRX_CTRL_SID, ack, 2, false, 0);
+    }
+
+    /*******************************************************************
+     * RX streaming:
+     * Packets go out when the time register passes their end,
+     * a stream that falls behind overflows and stops like the FPGA.
+     ******************************************************************/
+    size_t rx_ticks_per_sample(const size_t i)
+    {
+        const boost::uint32_t decim_word = _sr[SR_RX_DSP0 + i*(SR_RX_DSP1 - SR_RX_DSP0) + 2];
+        size_t decim = std::max<size_t>(decim_word & 0xff, 1);
+        if ((decim_word & (1 << 8)) != 0) decim *= 2;
+        if ((decim_word & (1 << 9)) != 0) decim *= 2;
+        return decim*EMU_TICKS_PER_DSP_CYCLE;
+    }
+
+    size_t rx_spp(const size_t i)
+    {
+        const size_t spp = _sr[SR_RX_CTRL0 + i*(SR_RX_CTRL1 - SR_RX_CTRL0) + 7];
+        const size_t max_spp = (EMU_MAX_PACKET/sizeof(boost::uint32_t)) - vrt::max_if_hdr_words32;
+        return std::min(std::max<size_t>(spp, 1), max_spp);
+    }
+
+    boost::uint32_t rx_sid(const size_t i)
+    {
+        return _sr[SR_RX_CTRL0 + i*(SR_RX_CTRL1 - SR_RX_CTRL0) + 5];
+    }
+
+    void issue_stream_cmd(const size_t i, const boost::uint32_t cmd_word, const boost::uint64_t ticks)
+    {
+        emu_rx_chain &rx = _rx[i];
+        const bool now = (cmd_word & (1 << 31)) != 0;
+        const bool chain = (cmd_word & (1 << 30)) != 0;
+        const bool reload = (cmd_word & (1 << 29)) != 0;
+        const bool stop = (cmd_word & (1 << 28)) != 0;
+        const boost::uint64_t time_now = this->ticks_now();
+
+        rx.active = false;
+        if (stop) return;
+        if (not now and ticks + EMU_SLACK_TICKS < time_now)
+        {
+            const boost::uint32_t code = uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND;
+            this->send_context(UMTRX_DSP_RX0_FRAMER + i, this->rx_sid(i), &code, 1, true, time_now);
+            return;
+        }
+        rx.active = true;
+        rx.eob_at_end = not chain;
+        rx.samps_left = reload? boost::uint64_t(~0) : (cmd_word & 0x0fffffff);
+        rx.next_ticks = now? time_now : ticks;
+    }
+
+    void service_rx(const size_t i, const boost::uint64_t time_now)
+    {
+        emu_rx_chain &rx = _rx[i];
+        if (not rx.active) return;
+        if (not _dest_valid[UMTRX_DSP_RX0_FRAMER + i])
+        {
+            rx.active = false; //nowhere to go, ex: the lingering packet flush
+            return;
+        }
+        const size_t tps = this->rx_ticks_per_sample(i);
+        const size_t spp = this->rx_spp(i);
+        const boost::uint32_t sid = this->rx_sid(i);
+
+        if (rx.next_ticks + EMU_OVERFLOW_TICKS < time_now)
+        {
+            const boost::uint32_t code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+            this->send_context(UMTRX_DSP_RX0_FRAMER + i, sid, &code, 1, true, rx.next_ticks);
+            rx.active = false;
+            return;
+        }
+
+        for (size_t n = 0; n < EMU_MAX_RX_BURST and rx.active; n++)
+        {
+            const size_t nsamps = size_t(std::min<boost::uint64_t>(spp, rx.samps_left));
+            if (rx.next_ticks + nsamps*tps > time_now) break;
+
+            vrt::if_packet_info_t ifpi;
+            ifpi.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
+            ifpi.num_payload_words32 = nsamps;
+            ifpi.num_payload_bytes = nsamps*sizeof(boost::uint32_t);
+            ifpi.packet_count = rx.seq++;
+            ifpi.sob = false;
+            ifpi.eob = rx.eob_at_end and nsamps == rx.samps_left;
+            ifpi.has_sid = true;
+            ifpi.sid = sid;
+            ifpi.has_cid = false;
+            ifpi.has_tsi = false;
+            ifpi.has_tsf = true;
+            ifpi.tsf = rx.next_ticks;
+            ifpi.has_tlr = true;
+            ifpi.tlr = 0;
+            boost::uint32_t *pkt = &_send_buff.front();
+            vrt::if_hdr_pack_be(pkt, ifpi);
+            boost::uint32_t *payload = pkt + ifpi.num_header_words32;
+            const size_t loopback = this->rx_loopback(i);
+            if (loopback < _tx.size()) this->fill_loopback(_tx[loopback], rx.next_ticks, tps, payload, nsamps);
+            else
+            {
+                const size_t phase = size_t(rx.next_ticks/tps);
+                for (size_t j = 0; j < nsamps; j++) payload[j] = _tone[(phase + j) % TONE_LEN];
+            }
+            this->send_to(UMTRX_DSP_RX0_FRAMER + i, ifpi.num_packet_words32);
+
+            rx.next_ticks += nsamps*tps;
+            rx.samps_left -= nsamps;
+            if (rx.samps_left == 0) rx.active = false;
+        }
+    }
+
+    /*******************************************************************
+     * RF loopback:
+     * The frontend switches pick the LMS of a dsp chain, an RX chain on
+     * an LMS with the loopback on hears the TX chain of that LMS.
+     ******************************************************************/
+    size_t tx_lms(const size_t i)
+    {
+        return i ^ (_sr[SR_TX_FE_SW] & 1);
+    }
+
+    //! The TX chain looped into an RX chain, or ~0 without the loopback
+    size_t rx_loopback(const size_t i)
+    {
+        const size_t lms = (_sr[SR_RX_FE_SW] >> i) & 1;
+        if (not _lms[lms].rf_loopback()) return ~0;
+        return lms ^ (_sr[SR_TX_FE_SW] & 1);
+    }
+
+    void fill_loopback(const emu_tx_chain &tx, const boost::uint64_t ticks, const size_t tps, boost::uint32_t *payload, const size_t nsamps)
+    {
+        std::fill(payload, payload + nsamps, 0);
+        for (std::deque<emu_tx_segment>::const_iterator it = tx.played.begin(); it != tx.played.end(); ++it)
+        {
+            const boost::uint64_t begin = it->start_ticks + EMU_LOOPBACK_TICKS;
+            const boost::uint64_t end = begin + it->samples.size()*it->ticks_per_sample;
+            if (end <= ticks or begin >= ticks + nsamps*tps) continue;
+            for (size_t j = 0; j < nsamps; j++)
+            {
+                const boost::uint64_t t = ticks + j*tps;
+                if (t >= begin and t < end) payload[j] = it->samples[(t - begin)/it->ticks_per_sample];
+            }
+        }
+    }
+
+    /*******************************************************************
+     * TX streaming:
+     * The packets are consumed at the sample rate, bursts start on time,
+     * the flow control word of the consumed packets is reported back
+     * at the configured update rate.
+     ******************************************************************/
+    size_t tx_ticks_per_sample(const size_t i)
+    {
+        const boost::uint32_t interp_word = _sr[SR_TX_DSP0 + i*(SR_TX_DSP1 - SR_TX_DSP0) + 2];
+        size_t interp = std::max<size_t>(interp_word & 0xff, 1);
+        if ((interp_word & (1 << 8)) != 0) interp *= 2;
+        if ((interp_word & (1 << 9)) != 0) interp *= 2;
+        return interp*EMU_TICKS_PER_DSP_CYCLE;
+    }
+
+    boost::uint32_t tx_ctrl(const size_t i, const size_t offset)
+    {
+        return _sr[SR_TX_CTRL0 + i*(SR_TX_CTRL1 - SR_TX_CTRL0) + offset];
+    }
+
+    void handle_tx_packet(const size_t i, const boost::uint32_t fc_seq, const vrt::if_packet_info_t &ifpi, const boost::uint32_t *payload)
+    {
+        emu_tx_chain &tx = _tx[i];
+        if (tx.seq_valid and ifpi.packet_count != ((tx.last_vrt_seq + 1) & 0xf))
+        {
+            this->send_tx_event(i, tx.playing?
+                uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST :
+                uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR, this->ticks_now());
+        }
+        tx.seq_valid = true;
+        tx.last_vrt_seq = ifpi.packet_count;
+
+        emu_tx_packet packet;
+        packet.fc_seq = fc_seq;
+        packet.nsamps = ifpi.num_payload_words32;
+        packet.has_tsf = ifpi.has_tsf;
+        packet.tsf = ifpi.tsf;
+        packet.eob = ifpi.eob;
+        tx.queue.push_back(packet);
+        if (_lms[this->tx_lms(i)].rf_loopback())
+        {
+            tx.queue.back().samples.assign(payload, payload + ifpi.num_payload_words32);
+        }
+        this->service_tx(i, this->ticks_now());
+    }
+
+    void service_tx(const size_t i, const boost::uint64_t time_now)
+    {
+        emu_tx_chain &tx = _tx[i];
+        const size_t tps = this->tx_ticks_per_sample(i);
+
+        while (true)
+        {
+            if (tx.queue.empty())
+            {
+                if (tx.playing and tx.play_ticks + EMU_SLACK_TICKS < time_now)
+                {
+                    this->send_tx_event(i, uhd::async_metadata_t::EVENT_CODE_UNDERFLOW, tx.play_ticks);
+                    tx.playing = false;
+                }
+                break;
+            }
+            emu_tx_packet &packet = tx.queue.front();
+
+            if (not tx.playing)
+            {
+                if (tx.dropping)
+                {
+                    tx.dropping = not packet.eob;
+                    this->consume_tx_packet(i, time_now);
+                    continue;
+                }
+                if (packet.has_tsf and packet.tsf + EMU_SLACK_TICKS < time_now)
+                {
+                    this->send_tx_event(i, uhd::async_metadata_t::EVENT_CODE_TIME_ERROR, packet.tsf);
+                    tx.dropping = not packet.eob and (this->tx_ctrl(i, 3) & (1 << 2)) != 0; //policy next burst
+                    this->consume_tx_packet(i, time_now);
+                    continue;
+                }
+                if (packet.has_tsf and packet.tsf > time_now) break; //wait for the time
+                tx.play_ticks = packet.has_tsf? packet.tsf : time_now;
+                tx.playing = true;
+            }
+
+            const boost::uint64_t end_ticks = tx.play_ticks + packet.nsamps*tps;
+            if (end_ticks > time_now) break;
+            if (not packet.samples.empty())
+            {
+                tx.played.push_back(emu_tx_segment());
+                tx.played.back().start_ticks = tx.play_ticks;
+                tx.played.back().ticks_per_sample = tps;
+                tx.played.back().samples.swap(packet.samples);
+            }
+            tx.play_ticks = end_ticks;
+            if (packet.eob)
+            {
+                this->send_tx_event(i, uhd::async_metadata_t::EVENT_CODE_BURST_ACK, end_ticks);
+                tx.playing = false;
+            }
+            this->consume_tx_packet(i, time_now);
+        }
+
+        //the RX chains are serviced after this, to the same time
+        while (not tx.played.empty() and tx.played.front().start_ticks + EMU_OVERFLOW_TICKS < time_now)
+        {
+            tx.played.pop_front();
+        }
+
+        //the time based updates
+        const boost::uint32_t cycles_per_up = this->tx_ctrl(i, 4);
+        if ((cycles_per_up & FLAG_TX_UP_ENB) != 0 and time_now - tx.last_up_ticks >= (cycles_per_up & ~FLAG_TX_UP_ENB))
+        {
+            this->send_tx_update(i, time_now);
+        }
+    }
+
+    void consume_tx_packet(const size_t i, const boost::uint64_t time_now)
+    {
+        emu_tx_chain &tx = _tx[i];
+        tx.last_fc_seq = tx.queue.front().fc_seq;
+        tx.queue.pop_front();
+
+        //the packet count based updates
+        const boost::uint32_t packets_per_up = this->tx_ctrl(i, 5);
+        if ((packets_per_up & FLAG_TX_UP_ENB) != 0 and ++tx.packets_since_up >= (packets_per_up & ~FLAG_TX_UP_ENB))
+        {
+            this->send_tx_update(i, time_now);
+        }
+    }
+
+    void send_tx_update(const size_t i, const boost::uint64_t time_now)
+    {
+        emu_tx_chain &tx = _tx[i];
+        tx.packets_since_up = 0;
+        tx.last_up_ticks = time_now;
+        const boost::uint32_t update[2] = {0, tx.last_fc_seq};
+        this->send_context(UMTRX_DSP_TX0_FRAMER + i, this->tx_ctrl(i, 2), update, 2, true, time_now);
+    }
+
+    void send_tx_event(const size_t i, const boost::uint32_t event_code, const boost::uint64_t ticks)
+    {
+        const boost::uint32_t event[2] = {event_code, 0};
+        this->send_context(UMTRX_DSP_TX0_FRAMER + i, this->tx_ctrl(i, 2), event, 2, true, ticks);
+    }
+
+    /*******************************************************************
+     * Packet output helpers
+     ******************************************************************/
+    void send_context(
+        const size_t framer, const boost::uint32_t sid,
+        const boost::uint32_t *words, const size_t num_words,
+        const bool has_tsf, const boost::uint64_t ticks
+    ){
+        vrt::if_packet_info_t ifpi;
+        ifpi.packet_type = vrt::if_packet_info_t::PACKET_TYPE_CONTEXT;
+        ifpi.num_payload_words32 = num_words;
+        ifpi.num_payload_bytes = num_words*sizeof(boost::uint32_t);
+        ifpi.packet_count = _context_seq++;
+        ifpi.sob = false;
+        ifpi.eob = false;
+        ifpi.has_sid = true;
+        ifpi.sid = sid;
+        ifpi.has_cid = false;
+        ifpi.has_tsi = false;
+        ifpi.has_tsf = has_tsf;
+        ifpi.tsf = ticks;
+        ifpi.has_tlr = false;
+        boost::uint32_t *pkt = &_send_buff.front();
+        vrt::if_hdr_pack_be(pkt, ifpi);
+        for (size_t j = 0; j < num_words; j++) pkt[ifpi.num_header_words32 + j] = htonl(words[j]);
+        this->send_to(framer, ifpi.num_packet_words32);
+    }
+
+    void send_to(const size_t framer, const size_t num_words32)
+    {
+        if (not _dest_valid[framer]) return;
+        boost::system::error_code ec; //a full socket buffer drops, like the link would
+        _data_sock.send_to(asio::buffer(&_send_buff.front(), num_words32*sizeof(boost::uint32_t)), _dest[framer], 0, ec);
+    }
+
+    /*******************************************************************
+     * Periodic service of the streams
+     ******************************************************************/
+    void start_timer(void)
+    {
+        _timer.expires_from_now(boost::posix_time::microseconds(EMU_SERVICE_US));
+        _timer.async_wait(boost::bind(&umtrx_emulator::handle_timer, this, asio::placeholders::error));
+    }
+
+    void handle_timer(const boost::system::error_code &error)
+    {
+        if (error) return;
+        const boost::uint64_t time_now = this->ticks_now();
+        for (size_t i = 0; i < _tx.size(); i++) this->service_tx(i, time_now); //first for the RF loopback
+        for (size_t i = 0; i < _rx.size(); i++) this->service_rx(i, time_now);
+        this->start_timer();
+    }
+
+    static const size_t TONE_LEN = 16;
+    static const boost::uint8_t EEPROM_ADDR = 0x50;
+    static const boost::uint32_t FLAG_TX_UP_ENB = (1ul << 31);
+
+    asio::ip::udp::socket _ctrl_sock, _data_sock;
+    asio::deadline_timer _timer;
+    const boost::uint32_t _ip_addr;
+    const size_t _num_ddc, _num_duc;
+    const bool _verbose;
+
+    std::vector<endpoint_type> _dest;
+    std::vector<bool> _dest_valid;
+    std::vector<boost::uint32_t> _sr;
+    std::vector<boost::uint32_t> _fw_regs;
+    std::vector<boost::uint8_t> _eeprom;
+    boost::uint8_t _eeprom_ptr;
+    std::vector<emu_lms> _lms;
+    boost::uint32_t _spi_rb;
+    boost::uint32_t _tcxo_dac;
+
+    const boost::uint64_t _start_ns;
+    boost::int64_t _time_offset;
+    bool _pps_pending;
+    boost::uint64_t _pps_ticks, _pps_at_ns;
+
+    std::vector<emu_rx_chain> _rx;
+    std::vector<emu_tx_chain> _tx;
+    size_t _context_seq;
+    boost::uint32_t _tone[TONE_LEN];
+
+    std::vector<boost::uint8_t> _ctrl_buff;
+    std::vector<boost::uint32_t> _data_buff;
+    std::vector<boost::uint32_t> _send_buff;
+    endpoint_type _ctrl_from, _data_from;
+};
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    //variables to be set by po
+    std::string addr;
+    std::string serial;
+    size_t num_ddc;
+    size_t num_duc;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("addr", po::value<std::string>(&addr)->default_value("127.0.0.1"), "local address to serve on")
+        ("serial", po::value<std::string>(&serial)->default_value("EMU0001"), "serial number in the EEPROM (up to 9 characters)")
+        ("ddc", po::value<size_t>(&num_ddc)->default_value(2), "number of RX dsp chains (2 to 4)")
+        ("duc", po::value<size_t>(&num_duc)->default_value(2), "number of TX dsp chains (1 or 2)")
+        ("verbose", "print the stream destinations and bad packets")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help") or num_ddc < 2 or num_ddc > 4 or num_duc < 1 or num_duc > 2){
+        std::cout << boost::format("UmTRX emulator %s") % desc << std::endl;
+        return ~0;
+    }
+
+    asio::io_service io_service;
+    umtrx_emulator emulator(io_service, addr, num_ddc, num_duc, serial, vm.count("verbose") != 0);
+    io_service.run();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * TX to RX round trip latency through the LMS6002D CAL loopback.
+ * See umtrx_loopback.hpp for what is measured. The stream args are
+ * passed to both streamers, so the host queueing can be compared
+ * across settings, ex: --stream_args="num_send_frames=8,ups_per_fifo=4"
+ * It runs against umtrx_emulator too, which loops the TX samples back
+ * when the RF loopback is enabled.
+ **********************************************************************/
+
+#include "../umtrx_loopback.hpp"
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <uhd/utils/algorithm.hpp>
+#include <boost/program_options.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+
+namespace po = boost::program_options;
+
+static void print_stat(const std::string &name, std::vector<double> v)
+{
+    if (v.empty())
+    {
+        std::cout << boost::format("%-8s %10s") % name % "-" << std::endl;
+        return;
+    }
+    std::sort(v.begin(), v.end());
+    std::cout << boost::format("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f")
+        % name % (v.front()*1e6) % (v[v.size()/2]*1e6) % (v[v.size()*9/10]*1e6)
+        % (v[std::min(v.size() - 1, v.size()*99/100)]*1e6) % (v.back()*1e6) << std::endl;
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    std::string args;
+    std::string stream_args_str;
+    std::string which;
+    double rate, freq;
+    double tx_gain, rx_gain;
+    umtrx_loopback_params params;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "help message")
+        ("args", po::value<std::string>(&args)->default_value(""), "single uhd device address args")
+        ("stream_args", po::value<std::string>(&stream_args_str)->default_value(""), "args of both streamers, ex: spp, num_recv_frames, ups_per_fifo")
+        ("which", po::value<std::string>(&which)->default_value("A"), "which LMS to loop back: A or B")
+        ("rate", po::value<double>(&rate)->default_value(13e6/12), "RX and TX sample rate")
+        ("freq", po::value<double>(&freq)->default_value(900e6), "RX and TX frequency")
+        ("tx_gain", po::value<double>(&tx_gain)->default_value(-10), "TX VGA1 gain in dB")
+        ("rx_gain", po::value<double>(&rx_gain)->default_value(10), "RX gain in dB")
+        ("trials", po::value<size_t>(&params.num_trials)->default_value(params.num_trials), "bursts sent now")
+        ("timed", po::value<size_t>(&params.num_timed)->default_value(params.num_timed), "timed bursts for the hardware pipeline")
+        ("pulse", po::value<size_t>(&params.pulse_len)->default_value(params.pulse_len), "samples in a burst")
+        ("ampl", po::value<float>(&params.ampl)->default_value(params.ampl), "burst amplitude")
+        ("threshold", po::value<double>(&params.threshold)->default_value(params.threshold), "detection level over the idle RX peak")
+        ("interval", po::value<double>(&params.interval)->default_value(params.interval), "seconds between the bursts")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX loopback latency %s") % desc << std::endl;
+        return ~0;
+    }
+
+    //create a usrp device
+    std::cout << boost::format("Creating the usrp device with: %s...") % args << std::endl;
+    uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(args);
+    std::cout << boost::format("Using Device: %s") % usrp->get_pp_string() << std::endl;
+
+    //one channel on the chosen LMS for both directions
+    usrp->set_rx_subdev_spec(which + ":0");
+    usrp->set_tx_subdev_spec(which + ":0");
+    if (not uhd::has(usrp->get_rx_antennas(), "CAL"))
+    {
+        throw std::runtime_error("This board does not have the CAL antenna option.");
+    }
+    usrp->set_rx_antenna("CAL");
+    usrp->set_rx_rate(rate);
+    usrp->set_tx_rate(rate);
+    usrp->set_tx_freq(freq);
+    usrp->set_rx_freq(freq);
+    usrp->set_tx_gain(tx_gain, "VGA1");
+    usrp->set_rx_gain(rx_gain);
+    rate = usrp->get_rx_rate();
+    std::cout << boost::format("Actual Rate: %f Msps") % (rate/1e6) << std::endl;
+
+    uhd::stream_args_t stream_args("fc32");
+    stream_args.args = uhd::device_addr_t(stream_args_str);
+    uhd::rx_streamer::sptr rx_stream = usrp->get_rx_stream(stream_args);
+    uhd::tx_streamer::sptr tx_stream = usrp->get_tx_stream(stream_args);
+    std::cout << boost::format("RX spp %u, TX spp %u, stream args: %s")
+        % rx_stream->get_max_num_samps() % tx_stream->get_max_num_samps() % stream_args.args.to_string() << std::endl;
+
+    const umtrx_loopback_result result = umtrx_measure_loopback(usrp, rx_stream, tx_stream, rate, params);
+
+    std::cout << std::endl;
+    std::cout << boost::format("Idle RX peak %f, %u missed bursts, %u overflows, time sync within %.1f us")
+        % result.noise_peak % result.misses % result.overflows % (result.sync_error*1e6) << std::endl;
+    std::cout << boost::format("%-8s %10s %10s %10s %10s %10s") % "us" % "min" % "median" % "p90" % "p99" % "max" << std::endl;
+    print_stat("total", result.total);
+    print_stat("tx_host", result.tx_host);
+    print_stat("hw", result.hw);
+    print_stat("rx_fill", result.rx_fill);
+    print_stat("rx_host", result.rx_host);
+
+    return EXIT_SUCCESS;
+}
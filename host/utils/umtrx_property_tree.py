@@ -47,6 +47,10 @@ class umtrx_property_tree:
     self._send_request('GET', path, value_type='INT')
     return self._recv_response()
 
+  def query_size_t_raw(self, path):
+    self._send_request('GET', path, value_type='SIZE_T')
+    return self._recv_response()
+
   def query_double_raw(self, path):
     self._send_request('GET', path, value_type='DOUBLE')
     return self._recv_response()
@@ -79,6 +83,10 @@ class umtrx_property_tree:
     res = self.query_int_raw(path)
     return int(res['result'])
 
+  def query_size_t_value(self, path):
+    res = self.query_size_t_raw(path)
+    return int(res['result'])
+
   def query_double_value(self, path):
     res = self.query_double_raw(path)
     return float(res['result'])
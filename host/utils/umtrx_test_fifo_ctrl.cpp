@@ -0,0 +1,255 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Offline check of the asynchronous peeks of the fifo control.
+ * A fake transport acks every command with its sequence number
+ * as the readback value, and loses acks on demand:
+ *  - a lost poke ack must not break a peek collected after it,
+ *    and fence() must report it,
+ *  - the guard must cancel the peeks that were not collected,
+ *  - a peek whose ack never comes must be forgotten after the
+ *    timeout of its collect, like a collected one.
+ **********************************************************************/
+
+#include "../umtrx_fifo_ctrl.hpp"
+#include "../umtrx_regs.hpp"
+#include <uhd/transport/vrt_if_packet.hpp>
+#include <uhd/transport/udp_simple.hpp>
+#include <uhd/exception.hpp>
+#include <uhd/utils/byteswap.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <deque>
+#include <vector>
+
+using namespace uhd::transport;
+
+/***********************************************************************
+ * Fake control transport:
+ * Each command of a sent packet gets an ack packet, unless lost.
+ * The readback value of a command is 0xab00 and its sequence.
+ **********************************************************************/
+class test_ctrl_xport : public zero_copy_if
+{
+public:
+    test_ctrl_xport(void):
+        lose_acks(false),
+        _send_buff(this),
+        _recv_mem(udp_simple::mtu/sizeof(boost::uint32_t))
+    {
+        //pass
+    }
+
+    managed_recv_buffer::sptr get_recv_buff(double)
+    {
+        if (_acks.empty()) return managed_recv_buffer::sptr(); //the fifo ctrl times out
+        _recv_mem = _acks.front();
+        _acks.pop_front();
+        return _recv_buff.get_new(_recv_mem);
+    }
+
+    managed_send_buffer::sptr get_send_buff(double)
+    {
+        return _send_buff.get_new();
+    }
+
+    size_t get_num_recv_frames(void) const {return 32;}
+    size_t get_recv_frame_size(void) const {return udp_simple::mtu;}
+    size_t get_num_send_frames(void) const {return 32;}
+    size_t get_send_frame_size(void) const {return udp_simple::mtu;}
+
+    bool lose_acks; //the acks of the commands sent meanwhile never come
+
+private:
+    class test_send_buffer : public managed_send_buffer
+    {
+    public:
+        test_send_buffer(test_ctrl_xport *xport):
+            _xport(xport), _mem(udp_simple::mtu/sizeof(boost::uint32_t)){}
+
+        void release(void)
+        {
+            _xport->handle_cmds(&_mem.front(), size()/sizeof(boost::uint32_t));
+        }
+
+        sptr get_new(void)
+        {
+            return make(this, &_mem.front(), _mem.size()*sizeof(boost::uint32_t));
+        }
+
+    private:
+        test_ctrl_xport *_xport;
+        std::vector<boost::uint32_t> _mem;
+    };
+
+    class test_recv_buffer : public managed_recv_buffer
+    {
+    public:
+        void release(void){}
+
+        sptr get_new(std::vector<boost::uint32_t> &mem)
+        {
+            return make(this, &mem.front(), mem.size()*sizeof(boost::uint32_t));
+        }
+    };
+
+    //! Ack the commands of a packet: the sequence word, then the VRT packet
+    void handle_cmds(const boost::uint32_t *trans, const size_t num_words32)
+    {
+        const boost::uint32_t *pkt = trans + 1;
+        vrt::if_packet_info_t ifpi;
+        ifpi.num_packet_words32 = num_words32 - 1;
+        vrt::if_hdr_unpack_be(pkt, ifpi);
+        for (size_t i = 0; i + 1 < ifpi.num_payload_words32; i += 2)
+        {
+            const boost::uint32_t ctrl_word = uhd::ntohx(pkt[ifpi.num_header_words32 + i]);
+            if (lose_acks) continue;
+
+            vrt::if_packet_info_t ack;
+            ack.packet_type = vrt::if_packet_info_t::PACKET_TYPE_CONTEXT;
+            ack.num_payload_words32 = 2;
+            ack.num_payload_bytes = 2*sizeof(boost::uint32_t);
+            ack.packet_count = 0;
+            ack.has_sid = true;
+            ack.sid = 0;
+            ack.has_cid = false;
+            ack.has_tsi = false;
+            ack.has_tsf = false;
+            ack.has_tlr = false;
+            std::vector<boost::uint32_t> mem(udp_simple::mtu/sizeof(boost::uint32_t));
+            vrt::if_hdr_pack_be(&mem.front(), ack);
+            mem[ack.num_header_words32 + 0] = uhd::htonx(ctrl_word);
+            mem[ack.num_header_words32 + 1] = uhd::htonx(boost::uint32_t(0xab000000 | (ctrl_word >> 16)));
+            mem.resize(ack.num_packet_words32);
+            _acks.push_back(mem);
+        }
+    }
+
+    test_send_buffer _send_buff;
+    test_recv_buffer _recv_buff;
+    std::vector<boost::uint32_t> _recv_mem;
+    std::deque<std::vector<boost::uint32_t> > _acks;
+};
+
+static size_t num_errors = 0;
+
+static void check(const bool ok, const std::string &what)
+{
+    if (ok) return;
+    std::cerr << "ERROR: " << what << std::endl;
+    num_errors++;
+}
+
+//! The readback value the fake transport gives to a peek handle
+static boost::uint32_t expected(const size_t handle)
+{
+    return 0xab000000 | boost::uint32_t(handle);
+}
+
+int UHD_SAFE_MAIN(int, char *[])
+{
+    boost::shared_ptr<test_ctrl_xport> xport(new test_ctrl_xport());
+    umtrx_fifo_ctrl::sptr ctrl = umtrx_fifo_ctrl::make(xport, 0, 15, true);
+
+    //a lost poke ack is left for fence(), the peek after it is good
+    xport->lose_acks = true;
+    ctrl->poke32(SETTING_REGS_BASE, 1);
+    xport->lose_acks = false;
+    {
+        umtrx_fifo_ctrl_peeks peeks(ctrl);
+        const size_t index = peeks.peek32(READBACK_BASE);
+        try
+        {
+            peeks.collect(index);
+        }
+        catch (const std::exception &ex)
+        {
+            check(false, std::string("a peek after a lost poke ack threw: ") + ex.what());
+        }
+    }
+    bool fence_threw = false;
+    try
+    {
+        ctrl->fence();
+    }
+    catch (const uhd::io_error &)
+    {
+        fence_threw = true;
+    }
+    check(fence_threw, "fence() did not report the lost poke ack");
+
+    //a cancelled peek is forgotten, the guard cancels the peeks it left
+    {
+        umtrx_fifo_ctrl_peeks peeks(ctrl);
+        peeks.peek32(READBACK_BASE);
+        const size_t index = peeks.peek32(READBACK_BASE);
+        check(peeks.collect(index) != 0, "no value for the second peek in the guard");
+    }
+    const size_t cancelled = ctrl->peek32_async(READBACK_BASE);
+    const size_t collected = ctrl->peek32_async(READBACK_BASE);
+    check(ctrl->peek32_collect(collected) == expected(collected), "wrong value for a peek without waiting");
+    ctrl->peek32_cancel(cancelled);
+    bool unknown = false;
+    try
+    {
+        ctrl->peek32_collect(cancelled);
+    }
+    catch (const uhd::key_error &)
+    {
+        unknown = true;
+    }
+    check(unknown, "a cancelled handle could be collected");
+
+    //a peek whose ack never comes is gone after the timeout of its collect
+    xport->lose_acks = true;
+    const size_t lost_handle = ctrl->peek32_async(READBACK_BASE);
+    xport->lose_acks = false;
+    bool timed_out = false;
+    try
+    {
+        ctrl->peek32_collect(lost_handle);
+    }
+    catch (const uhd::runtime_error &)
+    {
+        timed_out = true;
+    }
+    check(timed_out, "collecting a peek without ack did not time out");
+    unknown = false;
+    try
+    {
+        ctrl->peek32_collect(lost_handle);
+    }
+    catch (const uhd::key_error &)
+    {
+        unknown = true;
+    }
+    check(unknown, "a peek stayed in flight after the timeout of its collect");
+
+    //the ack of the next peek moves past the lost one
+    const size_t handle = ctrl->peek32_async(READBACK_BASE);
+    check(ctrl->peek32_collect(handle) == expected(handle), "wrong value for a peek after the timeout");
+
+    if (num_errors != 0)
+    {
+        std::cout << boost::format("FAIL: %u errors") % num_errors << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "PASS" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,248 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * Offline check of the zero copy receive.
+ * The same stream of packets with a lost packet every drop_period
+ * goes through recv_view() and through the copying recv(), with
+ * gap_fill=zeros. The views must hold the samples of the packets,
+ * the gaps must be reported with the time of the first lost sample,
+ * and the samples and gaps must add up to what recv() delivers.
+ * The handler is used through the extension interface, like the
+ * application would after a dynamic_cast of its rx_streamer.
+ **********************************************************************/
+
+#include "../cores/super_recv_packet_handler.hpp"
+#include "../umtrx_rx_view.hpp"
+#include <uhd/transport/udp_simple.hpp>
+#include <uhd/utils/byteswap.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <boost/program_options.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <complex>
+#include <vector>
+
+namespace po = boost::program_options;
+using namespace uhd::transport;
+
+/***********************************************************************
+ * Fake receive transport:
+ * Every sample is its tick number, so the payloads can be checked.
+ * Every drop_period packets one packet is lost, sequence and time.
+ **********************************************************************/
+class test_recv_buffer : public managed_recv_buffer
+{
+public:
+    test_recv_buffer(void):_mem(uhd::transport::udp_simple::mtu/sizeof(boost::uint32_t)){}
+
+    void release(void){}
+
+    sptr get_new(const size_t num_words32)
+    {
+        return make(this, &_mem.front(), num_words32*sizeof(boost::uint32_t));
+    }
+
+    std::vector<boost::uint32_t> _mem;
+};
+
+class test_recv_xport
+{
+public:
+    test_recv_xport(const size_t spp, const size_t drop_period):
+        _spp(spp), _drop_period(drop_period), _index(0), _seq(0), _ticks(0)
+    {
+        for (size_t i = 0; i < 16; i++)
+        {
+            _buffs.push_back(boost::shared_ptr<test_recv_buffer>(new test_recv_buffer()));
+        }
+    }
+
+    managed_recv_buffer::sptr get_buff(double)
+    {
+        test_recv_buffer &buff = *_buffs[_index++ % _buffs.size()];
+
+        //lose a packet on the way
+        if (_drop_period != 0 and (_index % _drop_period) == 0)
+        {
+            _seq++;
+            _ticks += _spp;
+        }
+
+        vrt::if_packet_info_t ifpi;
+        ifpi.packet_type = vrt::if_packet_info_t::PACKET_TYPE_DATA;
+        ifpi.num_payload_words32 = _spp;
+        ifpi.num_payload_bytes = _spp*sizeof(boost::uint32_t);
+        ifpi.packet_count = _seq++;
+        ifpi.has_sid = true;
+        ifpi.sid = 0;
+        ifpi.has_cid = false;
+        ifpi.has_tsi = false;
+        ifpi.has_tsf = true;
+        ifpi.tsf = _ticks;
+        ifpi.has_tlr = true;
+        vrt::if_hdr_pack_be(&buff._mem.front(), ifpi);
+        for (size_t i = 0; i < _spp; i++)
+        {
+            buff._mem[ifpi.num_header_words32 + i] = uhd::htonx(boost::uint32_t(_ticks + i));
+        }
+        _ticks += _spp;
+        return buff.get_new(ifpi.num_packet_words32);
+    }
+
+private:
+    const size_t _spp;
+    const size_t _drop_period;
+    size_t _index;
+    size_t _seq;
+    boost::uint64_t _ticks;
+    std::vector<boost::shared_ptr<test_recv_buffer> > _buffs;
+};
+
+/***********************************************************************
+ * Make a streamer on fake transports, rates of 1 tick per sample
+ **********************************************************************/
+static sph::recv_packet_streamer::sptr make_streamer(
+    const size_t num_chans, const size_t spp, const size_t drop_period
+){
+    sph::recv_packet_streamer::sptr streamer = sph::recv_packet_streamer::make(num_chans, spp);
+    streamer->set_vrt_unpacker(&vrt::if_hdr_unpack_be);
+    streamer->set_tick_rate(1e6);
+    streamer->set_samp_rate(1e6);
+    streamer->set_gap_fill(sph::recv_packet_streamer::GAP_FILL_ZEROS, 0.1);
+
+    uhd::convert::id_type id;
+    id.input_format = "sc16_item32_be";
+    id.num_inputs = 1;
+    id.output_format = "sc16";
+    id.num_outputs = 1;
+    streamer->set_converter(id);
+
+    for (size_t i = 0; i < num_chans; i++)
+    {
+        boost::shared_ptr<test_recv_xport> xport(new test_recv_xport(spp, drop_period));
+        streamer->set_xport_chan_get_buff(i, boost::bind(&test_recv_xport::get_buff, xport, _1));
+    }
+    return streamer;
+}
+
+static size_t num_errors = 0;
+
+static void check(const bool ok, const std::string &what)
+{
+    if (ok) return;
+    std::cerr << "ERROR: " << what << std::endl;
+    num_errors++;
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    //variables to be set by po
+    size_t num_chans;
+    size_t spp;
+    size_t drop_period;
+    size_t num_packets;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "help message")
+        ("chans", po::value<size_t>(&num_chans)->default_value(2), "number of channels")
+        ("spp", po::value<size_t>(&spp)->default_value(64), "samples per packet")
+        ("drop", po::value<size_t>(&drop_period)->default_value(7), "lose a packet every this many packets (0 = never)")
+        ("packets", po::value<size_t>(&num_packets)->default_value(1000), "packets to receive")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help")){
+        std::cout << boost::format("UmTRX zero copy receive check %s") % desc << std::endl;
+        return ~0;
+    }
+
+    //the view side, through the interface an application gets
+    sph::recv_packet_streamer::sptr view_streamer = make_streamer(num_chans, spp, drop_period);
+    uhd::rx_streamer::sptr rx_stream = view_streamer;
+    umtrx_rx_view_streamer *ext = dynamic_cast<umtrx_rx_view_streamer *>(rx_stream.get());
+    if (ext == NULL) throw std::runtime_error("the rx streamer has no recv_view()");
+
+    umtrx_rx_view view;
+    uhd::rx_metadata_t md;
+    boost::uint64_t next_tick = 0;
+    size_t view_samps = 0, view_gaps = 0, view_gap_samps = 0;
+    bool in_gap = false;
+    for (size_t n = 0; n < num_packets; n++)
+    {
+        const size_t nsamps = ext->recv_view(view, md, 0.1);
+        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW and md.out_of_sequence)
+        {
+            check(nsamps == 0 and view.get_nsamps() == 0, "a gap came with samples");
+            check(boost::uint64_t(md.time_spec.to_ticks(1e6)) == next_tick, str(boost::format("gap at tick %u, expected %u") % md.time_spec.to_ticks(1e6) % next_tick));
+            view_gaps++;
+            in_gap = true;
+            continue;
+        }
+        check(md.error_code == uhd::rx_metadata_t::ERROR_CODE_NONE, str(boost::format("error code 0x%x") % int(md.error_code)));
+        check(nsamps == spp and view.get_nsamps() == spp and view.get_num_channels() == num_chans, "short view");
+
+        const boost::uint64_t tick = md.time_spec.to_ticks(1e6);
+        if (in_gap) view_gap_samps += size_t(tick - next_tick);
+        else check(tick == next_tick, str(boost::format("view at tick %u, expected %u") % tick % next_tick));
+        in_gap = false;
+
+        for (size_t ch = 0; ch < view.get_num_channels(); ch++)
+        {
+            for (size_t i = 0; i < view.get_nsamps(); i++)
+            {
+                if (uhd::ntohx(view.get_payload(ch)[i]) == boost::uint32_t(tick + i)) continue;
+                check(false, str(boost::format("chan %u sample %u of tick %u") % ch % i % tick));
+                break;
+            }
+        }
+        next_tick = tick + nsamps;
+        view_samps += nsamps;
+    }
+    view.release();
+
+    //the copying side, the gaps come as zeros
+    sph::recv_packet_streamer::sptr copy_streamer = make_streamer(num_chans, spp, drop_period);
+    umtrx_stream_stats::sptr stats(new umtrx_stream_stats());
+    copy_streamer->set_xport_chan_stats(0, stats);
+    std::vector<std::vector<std::complex<boost::int16_t> > > mem(num_chans, std::vector<std::complex<boost::int16_t> >(spp));
+    std::vector<void *> buffs;
+    for (size_t i = 0; i < num_chans; i++) buffs.push_back(&mem[i].front());
+    size_t copy_samps = 0;
+    while (copy_samps < view_samps + view_gap_samps)
+    {
+        copy_samps += copy_streamer->recv(buffs, spp, md, 0.1, true);
+        check(md.error_code == uhd::rx_metadata_t::ERROR_CODE_NONE, str(boost::format("recv error code 0x%x") % int(md.error_code)));
+    }
+    check(copy_samps == view_samps + view_gap_samps, "recv and recv_view delivered different sample counts");
+    check(stats->gaps.read() == view_gaps, str(boost::format("recv filled %u gaps, recv_view reported %u") % stats->gaps.read() % view_gaps));
+    check(stats->gap_samps.read() == view_gap_samps, "recv and recv_view disagree on the gap samples");
+
+    std::cout << boost::format("%u samples in views, %u gaps of %u samples") % view_samps % view_gaps % view_gap_samps << std::endl;
+    if (num_errors != 0)
+    {
+        std::cout << boost::format("FAIL: %u errors") % num_errors << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "PASS" << std::endl;
+    return EXIT_SUCCESS;
+}
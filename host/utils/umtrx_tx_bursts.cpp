@@ -0,0 +1,148 @@
+//
+// Copyright 2016 Fairwaves LLC
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+/***********************************************************************
+ * GSM like TDMA transmission through the TX burst scheduler.
+ * A producer thread per timeslot submits a burst for its slot of every
+ * TDMA frame a little ahead of time, the scheduler puts them in order
+ * and sends them. Prints how far ahead of the air time the bursts were
+ * committed, and the underflows and late packets the device reported.
+ **********************************************************************/
+
+#include "../umtrx_tx_scheduler.hpp"
+#include <uhd/utils/thread_priority.hpp>
+#include <uhd/utils/safe_main.hpp>
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/program_options.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <complex>
+#include <vector>
+
+namespace po = boost::program_options;
+
+static const double GSM_SYMBOL_RATE = 1625e3/6;
+static const size_t GSM_SLOTS = 8;
+static const double GSM_SLOT_SYMBOLS = 156.25;
+static const size_t GSM_BURST_SYMBOLS = 148;
+
+static void producer(
+    umtrx_tx_scheduler *sched, const size_t slot, const double sps,
+    const uhd::time_spec_t &start_time, const boost::uint64_t start_ns,
+    const size_t num_frames, const double ahead
+){
+    const double slot_len = GSM_SLOT_SYMBOLS/GSM_SYMBOL_RATE;
+    std::vector<std::complex<float> > burst(size_t(GSM_BURST_SYMBOLS*sps), std::complex<float>(0.5f, 0.0f));
+    for (size_t frame = 0; frame < num_frames; frame++)
+    {
+        const double offset = (frame*GSM_SLOTS + slot)*slot_len;
+
+        //produce the burst ahead seconds before its time, like a BTS would
+        const boost::int64_t wait_ns = boost::int64_t(start_ns + (offset - ahead)*1e9) - boost::int64_t(umtrx_stats_now_ns());
+        if (wait_ns > 0) boost::this_thread::sleep(boost::posix_time::microseconds(wait_ns/1000));
+
+        while (not sched->submit(&burst.front(), burst.size(), start_time + uhd::time_spec_t(offset))){}
+    }
+}
+
+int UHD_SAFE_MAIN(int argc, char *argv[])
+{
+    uhd::set_thread_priority_safe();
+
+    //variables to be set by po
+    std::string args;
+    double sps;
+    size_t num_slots;
+    double duration;
+    double ahead;
+    umtrx_tx_scheduler::params_t params;
+
+    //setup the program options
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "help message")
+        ("args", po::value<std::string>(&args)->default_value(""), "single uhd device address args")
+        ("sps", po::value<double>(&sps)->default_value(4), "samples per GSM symbol")
+        ("slots", po::value<size_t>(&num_slots)->default_value(8), "active timeslots, one producer thread each")
+        ("duration", po::value<double>(&duration)->default_value(10), "seconds to transmit")
+        ("ahead", po::value<double>(&ahead)->default_value(0.05), "seconds ahead of the air time the bursts are produced")
+        ("lead", po::value<double>(&params.lead)->default_value(params.lead), "seconds ahead of the air time the bursts are committed")
+        ("max_gap", po::value<double>(&params.max_gap)->default_value(params.max_gap), "longest gap in seconds filled with zeros")
+    ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    //print the help message
+    if (vm.count("help") or num_slots == 0 or num_slots > GSM_SLOTS){
+        std::cout << boost::format("UmTRX TDMA TX bursts %s") % desc << std::endl;
+        return ~0;
+    }
+
+    //create a usrp device
+    std::cout << boost::format("Creating the usrp device with: %s...") % args << std::endl;
+    uhd::usrp::multi_usrp::sptr usrp = uhd::usrp::multi_usrp::make(args);
+    usrp->set_tx_rate(GSM_SYMBOL_RATE*sps);
+    const double rate = usrp->get_tx_rate();
+    std::cout << boost::format("Actual TX Rate: %f Msps") % (rate/1e6) << std::endl;
+
+    uhd::stream_args_t stream_args("fc32");
+    uhd::tx_streamer::sptr tx_stream = usrp->get_tx_stream(stream_args);
+
+    umtrx_tx_scheduler::time_fcn_type time_fcn = boost::bind(&uhd::usrp::multi_usrp::get_time_now, usrp, 0);
+    umtrx_tx_scheduler sched(tx_stream, "fc32", rate, time_fcn, params);
+
+    //the producers spread the active slots over the frame
+    const size_t num_frames = size_t(duration*GSM_SYMBOL_RATE/(GSM_SLOTS*GSM_SLOT_SYMBOLS));
+    const uhd::time_spec_t start_time = usrp->get_time_now() + uhd::time_spec_t(ahead + 0.1);
+    const boost::uint64_t start_ns = umtrx_stats_now_ns() + boost::uint64_t((ahead + 0.1)*1e9); //the host time of start_time
+    boost::thread_group producers;
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        producers.create_thread(boost::bind(&producer, &sched, i*GSM_SLOTS/num_slots, sps, start_time, start_ns, num_frames, ahead));
+    }
+
+    //collect the reports and the async messages while the producers run
+    std::vector<double> leads;
+    size_t dropped = 0, underflows = 0, time_errors = 0;
+    const size_t num_bursts = num_frames*num_slots;
+    const boost::uint64_t end_ns = start_ns + boost::uint64_t((duration + 5.0)*1e9);
+    while (leads.size() + dropped < num_bursts and umtrx_stats_now_ns() < end_ns)
+    {
+        umtrx_tx_scheduler::report_t report;
+        while (sched.get_report(report, 0.0))
+        {
+            if (report.sent) leads.push_back(report.lead);
+            else dropped++;
+        }
+        uhd::async_metadata_t async_md;
+        if (not tx_stream->recv_async_msg(async_md, 0.01)) continue;
+        if (async_md.event_code & (uhd::async_metadata_t::EVENT_CODE_UNDERFLOW | uhd::async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET)) underflows++;
+        if (async_md.event_code & uhd::async_metadata_t::EVENT_CODE_TIME_ERROR) time_errors++;
+    }
+    producers.join_all();
+
+    const umtrx_tx_scheduler::stats_t stats = sched.get_stats();
+    std::sort(leads.begin(), leads.end());
+    std::cout << boost::format("%u bursts sent, %u dropped, %u continued the previous one, %u device bursts, %u zero samples in the gaps")
+        % stats.bursts % stats.dropped % stats.gaps_filled % stats.eobs % stats.fill_samps << std::endl;
+    if (not leads.empty()) std::cout << boost::format("Commit lead ms: min %.3f, median %.3f, max %.3f")
+        % (leads.front()*1e3) % (leads[leads.size()/2]*1e3) % (leads.back()*1e3) << std::endl;
+    std::cout << boost::format("Device reports: %u underflows, %u time errors") % underflows % time_errors << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -15,6 +15,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include "../umtrx_tx_template.hpp"
 #include <uhd/utils/paths.hpp>
 #include <uhd/utils/thread_priority.hpp>
 #include <uhd/utils/algorithm.hpp>
@@ -245,6 +246,23 @@ static void tx_thread(uhd::usrp::multi_usrp::sptr usrp, const double tx_wave_fre
     const size_t step = boost::math::iround(wave_table_len * tx_wave_freq/tx_rate);
     wave_table table(tx_wave_ampl);
 
+    //the umtrx streamer converts the tone once and sends it from a template,
+    //the tone repeats every period samples, the table length being a power of two
+    umtrx_tx_template_streamer *tmpl_stream = dynamic_cast<umtrx_tx_template_streamer *>(tx_stream.get());
+    if (tmpl_stream != NULL){
+        size_t period = wave_table_len;
+        while (period > 1 and (step*(period/2)) % wave_table_len == 0) period /= 2;
+        buff.resize(((buff.size() + period - 1)/period)*period);
+        for (size_t i = 0; i < buff.size(); i++){
+            buff[i] = table(index += step);
+        }
+        const size_t handle = tmpl_stream->register_template(&buff.front(), buff.size());
+        while (not boost::this_thread::interruption_requested()){
+            tmpl_stream->send_template(handle, md);
+        }
+        tmpl_stream->release_template(handle);
+    }
+
     //fill buff and send until interrupted
     while (not boost::this_thread::interruption_requested()){
         for (size_t i = 0; i < buff.size(); i++){